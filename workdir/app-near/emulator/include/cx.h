@@ -0,0 +1,68 @@
+#ifndef __EMULATOR_CX_H__
+#define __EMULATOR_CX_H__
+
+// Host stand-in for the BOLOS SDK cx.h. Only the primitives used by the app
+// are provided, implemented in software by src/emulator_crypto.c.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CX_LAST (1 << 0)
+
+typedef enum {
+    CX_NONE = 0,
+    CX_SHA256 = 3,
+    CX_SHA512 = 5,
+} cx_md_t;
+
+typedef enum {
+    CX_CURVE_NONE = 0,
+    CX_CURVE_Ed25519 = 0x71,
+} cx_curve_t;
+
+#define HDW_NORMAL 0
+#define HDW_ED25519_SLIP10 1
+
+typedef struct {
+    cx_md_t algo;
+    uint64_t counter;
+    uint8_t block[128];
+    size_t blen;
+} cx_hash_t;
+
+typedef struct {
+    cx_hash_t header;
+    uint32_t acc[8];
+} cx_sha256_t;
+
+typedef struct {
+    cx_hash_t header;
+    uint64_t acc[8];
+} cx_sha512_t;
+
+typedef struct {
+    cx_curve_t curve;
+    size_t d_len;
+    uint8_t d[32];
+} cx_ecfp_private_key_t;
+
+typedef struct {
+    cx_curve_t curve;
+    size_t W_len;
+    uint8_t W[65];
+} cx_ecfp_public_key_t;
+
+int cx_sha256_init(cx_sha256_t *hash);
+int cx_sha512_init(cx_sha512_t *hash);
+int cx_hash(cx_hash_t *hash, int mode, const unsigned char *in, unsigned int len, unsigned char *out, unsigned int out_len);
+
+int cx_ecdsa_init_private_key(cx_curve_t curve, const unsigned char *raw_key, unsigned int key_len, cx_ecfp_private_key_t *pvkey);
+int cx_ecdsa_init_public_key(cx_curve_t curve, const unsigned char *raw_key, unsigned int key_len, cx_ecfp_public_key_t *pukey);
+int cx_ecfp_generate_pair(cx_curve_t curve, cx_ecfp_public_key_t *pubkey, cx_ecfp_private_key_t *privkey, int keepprivate);
+int cx_eddsa_sign(const cx_ecfp_private_key_t *pvkey, int mode, cx_md_t hashID, const unsigned char *hash, unsigned int hash_len,
+                  const unsigned char *ctx, unsigned int ctx_len, unsigned char *sig, unsigned int sig_len, unsigned int *info);
+
+void os_perso_derive_node_bip32_seed_key(unsigned int mode, cx_curve_t curve, const unsigned int *path, unsigned int pathLength,
+                                         unsigned char *privateKey, unsigned char *chain, unsigned char *seed_key, unsigned int seed_key_length);
+
+#endif // __EMULATOR_CX_H__
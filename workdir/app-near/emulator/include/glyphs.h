@@ -0,0 +1,18 @@
+#ifndef __EMULATOR_GLYPHS_H__
+#define __EMULATOR_GLYPHS_H__
+
+// The emulator has no screen: glyphs are declared so the UX flows compile,
+// nothing ever draws them.
+
+typedef struct {
+    unsigned int width;
+    unsigned int height;
+} bagl_icon_details_t;
+
+extern const bagl_icon_details_t C_icon_validate_14;
+extern const bagl_icon_details_t C_icon_crossmark;
+extern const bagl_icon_details_t C_icon_dashboard_x;
+extern const bagl_icon_details_t C_icon_back;
+extern const bagl_icon_details_t C_icon_eye;
+
+#endif // __EMULATOR_GLYPHS_H__
@@ -0,0 +1,141 @@
+#ifndef __EMULATOR_OS_H__
+#define __EMULATOR_OS_H__
+
+// Host stand-in for the BOLOS SDK os.h: just enough of the exception model,
+// IO layer and OS calls for the app sources to build and run unmodified.
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the SDK os.h pulls in the crypto API as well
+#include "cx.h"
+
+#ifndef UNUSED
+#define UNUSED(x) (void)x
+#endif
+
+#ifdef NEAR_EMULATOR_DEBUG
+#define PRINTF(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+#define PIC(x) (x)
+#define ARRAYLEN(array) (sizeof(array) / sizeof(array[0]))
+#define U4BE(buf, off) ((uint32_t)((buf)[off] << 24 | (buf)[(off) + 1] << 16 | (buf)[(off) + 2] << 8 | (buf)[(off) + 3]))
+
+// ----------------------------------------------------------------------------
+// Exceptions
+
+typedef unsigned short exception_t;
+
+typedef struct try_context_s {
+    jmp_buf jmp_buf;
+    struct try_context_s *previous;
+    exception_t ex;
+} try_context_t;
+
+extern try_context_t *G_try_last_open_context;
+
+void os_longjmp(unsigned int exception) __attribute__((noreturn));
+
+#define BEGIN_TRY_L(L) \
+    {                  \
+        try_context_t __try##L;
+
+#define TRY_L(L)                                        \
+    __try##L.previous = G_try_last_open_context;        \
+    G_try_last_open_context = &__try##L;                \
+    __try##L.ex = setjmp(__try##L.jmp_buf);             \
+    if (__try##L.ex == 0) {
+
+#define CATCH_L(L, x)                                   \
+    goto __FINALLY##L;                                  \
+    }                                                   \
+    else if (__try##L.ex == (x)) {                      \
+        G_try_last_open_context = __try##L.previous;    \
+        __try##L.ex = 0;
+
+#define CATCH_OTHER_L(L, e)                             \
+    goto __FINALLY##L;                                  \
+    }                                                   \
+    else {                                              \
+        exception_t e = __try##L.ex;                    \
+        G_try_last_open_context = __try##L.previous;    \
+        __try##L.ex = 0;
+
+#define CATCH_ALL_L(L)                                  \
+    goto __FINALLY##L;                                  \
+    }                                                   \
+    else {                                              \
+        G_try_last_open_context = __try##L.previous;    \
+        __try##L.ex = 0;
+
+#define FINALLY_L(L)                                    \
+    goto __FINALLY##L;                                  \
+    }                                                   \
+    __FINALLY##L:                                       \
+    if (G_try_last_open_context == &__try##L) {         \
+        G_try_last_open_context = __try##L.previous;    \
+    }
+
+#define END_TRY_L(L)                \
+    if (__try##L.ex != 0) {         \
+        os_longjmp(__try##L.ex);    \
+    }                               \
+    }
+
+#define BEGIN_TRY BEGIN_TRY_L(_)
+#define TRY TRY_L(_)
+#define CATCH(x) CATCH_L(_, x)
+#define CATCH_OTHER(e) CATCH_OTHER_L(_, e)
+#define CATCH_ALL CATCH_ALL_L(_)
+#define FINALLY FINALLY_L(_)
+#define END_TRY END_TRY_L(_)
+#define THROW(x) os_longjmp(x)
+
+#define EXCEPTION 1
+#define INVALID_PARAMETER 2
+#define EXCEPTION_OVERFLOW 3
+#define EXCEPTION_SECURITY 4
+#define INVALID_STATE 9
+#define EXCEPTION_IO_RESET 0x10
+
+// ----------------------------------------------------------------------------
+// IO
+
+#define IO_APDU_BUFFER_SIZE (5 + 255)
+
+#define CHANNEL_APDU 0
+#define CHANNEL_KEYBOARD 1
+#define CHANNEL_SPI 2
+#define IO_RESET_AFTER_REPLIED 0x80
+#define IO_RECEIVE_DATA 0x40
+#define IO_RETURN_AFTER_TX 0x20
+#define IO_ASYNCH_REPLY 0x10
+#define IO_FLAGS 0xF8
+
+typedef enum {
+    IO_APDU_MEDIA_NONE = 0,
+    IO_APDU_MEDIA_USB_HID = 1,
+} io_apdu_media_t;
+
+extern unsigned char G_io_apdu_buffer[IO_APDU_BUFFER_SIZE];
+extern io_apdu_media_t G_io_apdu_media;
+
+unsigned short io_exchange(unsigned char channel_and_flags, unsigned short tx_len);
+
+// ----------------------------------------------------------------------------
+// OS
+
+void os_boot(void);
+void os_sched_exit(int exit_code) __attribute__((noreturn));
+void reset(void);
+void nvm_write(void *dst_adr, void *src_adr, unsigned int src_len);
+
+#endif // __EMULATOR_OS_H__
@@ -0,0 +1,32 @@
+#ifndef __EMULATOR_OS_IO_SEPROXYHAL_H__
+#define __EMULATOR_OS_IO_SEPROXYHAL_H__
+
+// Host stand-in for the SE proxy HAL. There is no MCU: io_seproxyhal_init()
+// waits for an APDU client on TCP and io_exchange() talks to it, see
+// src/emulator_io.c.
+
+#include "os.h"
+
+#ifndef IO_SEPROXYHAL_BUFFER_SIZE_B
+#define IO_SEPROXYHAL_BUFFER_SIZE_B 300
+#endif
+
+#define SEPROXYHAL_TAG_BUTTON_PUSH_EVENT 0x05
+#define SEPROXYHAL_TAG_FINGER_EVENT 0x0C
+#define SEPROXYHAL_TAG_DISPLAY_PROCESSED_EVENT 0x0D
+#define SEPROXYHAL_TAG_TICKER_EVENT 0x0E
+#define SEPROXYHAL_TAG_STATUS_EVENT 0x15
+#define SEPROXYHAL_TAG_STATUS_EVENT_FLAG_USB_POWERED 0x00000008
+
+extern unsigned char G_io_seproxyhal_spi_buffer[IO_SEPROXYHAL_BUFFER_SIZE_B];
+
+void io_seproxyhal_init(void);
+// Defined by the app
+unsigned char io_event(unsigned char channel);
+void io_seproxyhal_general_status(void);
+unsigned int io_seproxyhal_spi_is_status_sent(void);
+void io_seproxyhal_spi_send(const unsigned char *buffer, unsigned short length);
+unsigned short io_seproxyhal_spi_recv(unsigned char *buffer, unsigned short maxlength, unsigned int flags);
+void USB_power(unsigned char enabled);
+
+#endif // __EMULATOR_OS_IO_SEPROXYHAL_H__
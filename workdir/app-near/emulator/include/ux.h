@@ -0,0 +1,74 @@
+#ifndef __EMULATOR_UX_H__
+#define __EMULATOR_UX_H__
+
+// Host stand-in for the BOLOS UX flow engine. Steps keep only their init
+// and validate callbacks; ux_flow_init() steps through the flow up to its
+// Approve step and runs it straight away or once a hold is over (or Reject,
+// see src/emulator_ux.c) instead of waiting for buttons.
+
+#include "os.h"
+#include "glyphs.h"
+
+typedef struct {
+    unsigned char type;
+} bagl_component_t;
+
+typedef struct {
+    bagl_component_t component;
+    const char *text;
+} bagl_element_t;
+
+typedef struct {
+    unsigned int stack_count;
+} ux_state_t;
+
+typedef struct {
+    unsigned int ux_id;
+} bolos_ux_params_t;
+
+extern ux_state_t G_ux;
+extern bolos_ux_params_t G_ux_params;
+
+typedef struct {
+    void (*validate)(void);
+    // Run as the step is entered
+    void (*init)(void);
+} ux_flow_step_t;
+
+#define FLOW_END_STEP NULL
+
+#define UX_STEP_NOCB(stepname, layoutkind, ...) \
+    const ux_flow_step_t stepname = {NULL, NULL}
+
+#define UX_STEP_VALID(stepname, layoutkind, validate_cb, ...) \
+    static void stepname##_validate(void) {                   \
+        validate_cb;                                          \
+    }                                                         \
+    const ux_flow_step_t stepname = {stepname##_validate, NULL}
+
+#define UX_STEP_INIT(stepname, validate_flow, error_flow, ...) \
+    static void stepname##_init(void) {                         \
+        __VA_ARGS__;                                            \
+    }                                                           \
+    const ux_flow_step_t stepname = {NULL, stepname##_init}
+
+#define UX_FLOW(flow_name, ...) \
+    const ux_flow_step_t *const flow_name[] = {__VA_ARGS__, FLOW_END_STEP}
+
+void ux_flow_init(unsigned int stack_slot, const ux_flow_step_t *const *steps, const ux_flow_step_t *const start_step);
+void ux_flow_next(void);
+void ux_flow_prev(void);
+// Answers a review held for NEAR_EMULATOR_HOLD_SECONDS once its time is up
+void ux_ticker(void);
+
+void io_seproxyhal_display(const bagl_element_t *element);
+void io_seproxyhal_display_default(const bagl_element_t *element);
+
+#define UX_INIT() memset(&G_ux, 0, sizeof(G_ux))
+#define UX_FINGER_EVENT(seph_packet) UNUSED(seph_packet)
+#define UX_BUTTON_PUSH_EVENT(seph_packet) UNUSED(seph_packet)
+#define UX_DEFAULT_EVENT()
+#define UX_DISPLAYED_EVENT(displayed_callback)
+#define UX_TICKER_EVENT(seph_packet, callback) ux_ticker()
+
+#endif // __EMULATOR_UX_H__
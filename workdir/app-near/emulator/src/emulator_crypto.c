@@ -0,0 +1,670 @@
+// Software replacements for the cx_* and os_perso_* services used by the app.
+//
+// Keys are derived like on a device: a BIP39 seed from the mnemonic in
+// NEAR_EMULATOR_MNEMONIC (the Speculos default mnemonic otherwise), then
+// SLIP-10 ed25519 along the requested path. The Ed25519 arithmetic follows
+// TweetNaCl: small and constant time, not fast, which is fine since the
+// emulator exists to load the app logic and transport, not the curve.
+//
+// None of this is meant to protect real funds.
+
+#include "os.h"
+#include "cx.h"
+
+#define DEFAULT_MNEMONIC                                                              \
+    "glory promote mansion idle axis finger extra february uncover one trip resource " \
+    "lawn turtle enact monster seven myth punch hobby comfort wild raise skin"
+
+#define BIP39_ITERATIONS 2048
+
+// ----------------------------------------------------------------------------
+// SHA-256
+
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(uint32_t acc[8], const uint8_t block[64])
+{
+    uint32_t w[64];
+    uint32_t a = acc[0], b = acc[1], c = acc[2], d = acc[3];
+    uint32_t e = acc[4], f = acc[5], g = acc[6], h = acc[7];
+
+    for (int i = 0; i < 16; i++) {
+        w[i] = U4BE(block, 4 * i);
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROR32(w[i - 15], 7) ^ ROR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROR32(w[i - 2], 17) ^ ROR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+        uint32_t t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    acc[0] += a;
+    acc[1] += b;
+    acc[2] += c;
+    acc[3] += d;
+    acc[4] += e;
+    acc[5] += f;
+    acc[6] += g;
+    acc[7] += h;
+}
+
+// ----------------------------------------------------------------------------
+// SHA-512
+
+static const uint64_t SHA512_K[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL,
+    0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL, 0x12835b0145706fbeULL,
+    0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL, 0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+    0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+    0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL, 0x983e5152ee66dfabULL,
+    0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+    0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL,
+    0x53380d139d95b3dfULL, 0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+    0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+    0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL, 0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL,
+    0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL,
+    0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL, 0xca273eceea26619cULL,
+    0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL,
+    0x113f9804bef90daeULL, 0x1b710b35131c471bULL, 0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+    0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL,
+};
+
+#define ROR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+static uint64_t load64_be(const uint8_t *p)
+{
+    return (uint64_t) U4BE(p, 0) << 32 | U4BE(p, 4);
+}
+
+static void sha512_block(uint64_t acc[8], const uint8_t block[128])
+{
+    uint64_t w[80];
+    uint64_t a = acc[0], b = acc[1], c = acc[2], d = acc[3];
+    uint64_t e = acc[4], f = acc[5], g = acc[6], h = acc[7];
+
+    for (int i = 0; i < 16; i++) {
+        w[i] = load64_be(block + 8 * i);
+    }
+    for (int i = 16; i < 80; i++) {
+        uint64_t s0 = ROR64(w[i - 15], 1) ^ ROR64(w[i - 15], 8) ^ (w[i - 15] >> 7);
+        uint64_t s1 = ROR64(w[i - 2], 19) ^ ROR64(w[i - 2], 61) ^ (w[i - 2] >> 6);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    for (int i = 0; i < 80; i++) {
+        uint64_t t1 = h + (ROR64(e, 14) ^ ROR64(e, 18) ^ ROR64(e, 41)) + ((e & f) ^ (~e & g)) + SHA512_K[i] + w[i];
+        uint64_t t2 = (ROR64(a, 28) ^ ROR64(a, 34) ^ ROR64(a, 39)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    acc[0] += a;
+    acc[1] += b;
+    acc[2] += c;
+    acc[3] += d;
+    acc[4] += e;
+    acc[5] += f;
+    acc[6] += g;
+    acc[7] += h;
+}
+
+// ----------------------------------------------------------------------------
+// cx_hash
+
+int cx_sha256_init(cx_sha256_t *hash)
+{
+    static const uint32_t iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    memset(hash, 0, sizeof(*hash));
+    hash->header.algo = CX_SHA256;
+    memcpy(hash->acc, iv, sizeof(iv));
+    return CX_SHA256;
+}
+
+int cx_sha512_init(cx_sha512_t *hash)
+{
+    static const uint64_t iv[8] = {
+        0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+        0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+    };
+
+    memset(hash, 0, sizeof(*hash));
+    hash->header.algo = CX_SHA512;
+    memcpy(hash->acc, iv, sizeof(iv));
+    return CX_SHA512;
+}
+
+static void hash_compress(cx_hash_t *hash)
+{
+    if (hash->algo == CX_SHA256) {
+        sha256_block(((cx_sha256_t *) hash)->acc, hash->block);
+    } else {
+        sha512_block(((cx_sha512_t *) hash)->acc, hash->block);
+    }
+}
+
+int cx_hash(cx_hash_t *hash, int mode, const unsigned char *in, unsigned int len, unsigned char *out, unsigned int out_len)
+{
+    size_t block_size = hash->algo == CX_SHA256 ? 64 : 128;
+    size_t length_size = hash->algo == CX_SHA256 ? 8 : 16;
+    size_t digest_size = hash->algo == CX_SHA256 ? 32 : 64;
+    uint64_t bits;
+
+    hash->counter += len;
+    while (len > 0) {
+        size_t n = block_size - hash->blen;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(hash->block + hash->blen, in, n);
+        hash->blen += n;
+        in += n;
+        len -= n;
+        if (hash->blen == block_size) {
+            hash_compress(hash);
+            hash->blen = 0;
+        }
+    }
+    if (!(mode & CX_LAST)) {
+        return 0;
+    }
+    if (out_len < digest_size) {
+        THROW(INVALID_PARAMETER);
+    }
+
+    hash->block[hash->blen++] = 0x80;
+    if (hash->blen > block_size - length_size) {
+        memset(hash->block + hash->blen, 0, block_size - hash->blen);
+        hash_compress(hash);
+        hash->blen = 0;
+    }
+    memset(hash->block + hash->blen, 0, block_size - hash->blen);
+    bits = hash->counter * 8;
+    for (int i = 0; i < 8; i++) {
+        hash->block[block_size - 1 - i] = bits >> (8 * i);
+    }
+    hash_compress(hash);
+
+    if (hash->algo == CX_SHA256) {
+        const uint32_t *acc = ((cx_sha256_t *) hash)->acc;
+        for (int i = 0; i < 32; i++) {
+            out[i] = acc[i / 4] >> (24 - 8 * (i % 4));
+        }
+    } else {
+        const uint64_t *acc = ((cx_sha512_t *) hash)->acc;
+        for (int i = 0; i < 64; i++) {
+            out[i] = acc[i / 8] >> (56 - 8 * (i % 8));
+        }
+    }
+    return digest_size;
+}
+
+static void sha512(const uint8_t *in, size_t len, uint8_t out[64])
+{
+    cx_sha512_t ctx;
+
+    cx_sha512_init(&ctx);
+    cx_hash(&ctx.header, CX_LAST, in, len, out, 64);
+}
+
+// ----------------------------------------------------------------------------
+// HMAC-SHA512, PBKDF2 and SLIP-10
+
+static void hmac_sha512(const uint8_t *key, size_t key_len, const uint8_t *msg, size_t msg_len, uint8_t out[64])
+{
+    uint8_t pad[128];
+    uint8_t key_block[128];
+    uint8_t inner[64];
+    cx_sha512_t ctx;
+
+    memset(key_block, 0, sizeof(key_block));
+    if (key_len > sizeof(key_block)) {
+        sha512(key, key_len, key_block);
+    } else {
+        memcpy(key_block, key, key_len);
+    }
+
+    for (size_t i = 0; i < sizeof(pad); i++) {
+        pad[i] = key_block[i] ^ 0x36;
+    }
+    cx_sha512_init(&ctx);
+    cx_hash(&ctx.header, 0, pad, sizeof(pad), NULL, 0);
+    cx_hash(&ctx.header, CX_LAST, msg, msg_len, inner, sizeof(inner));
+
+    for (size_t i = 0; i < sizeof(pad); i++) {
+        pad[i] = key_block[i] ^ 0x5c;
+    }
+    cx_sha512_init(&ctx);
+    cx_hash(&ctx.header, 0, pad, sizeof(pad), NULL, 0);
+    cx_hash(&ctx.header, CX_LAST, inner, sizeof(inner), out, 64);
+
+    explicit_bzero(key_block, sizeof(key_block));
+    explicit_bzero(pad, sizeof(pad));
+}
+
+// BIP39: PBKDF2-HMAC-SHA512(mnemonic, "mnemonic", 2048) with a single 64
+// byte output block. Computed once, the seed never changes while running.
+static const uint8_t *bip39_seed(void)
+{
+    static uint8_t seed[64];
+    static bool ready;
+    const char *mnemonic;
+    uint8_t salt[] = {'m', 'n', 'e', 'm', 'o', 'n', 'i', 'c', 0, 0, 0, 1};
+    uint8_t u[64];
+
+    if (ready) {
+        return seed;
+    }
+    mnemonic = getenv("NEAR_EMULATOR_MNEMONIC");
+    if (mnemonic == NULL) {
+        mnemonic = DEFAULT_MNEMONIC;
+    }
+
+    hmac_sha512((const uint8_t *) mnemonic, strlen(mnemonic), salt, sizeof(salt), u);
+    memcpy(seed, u, sizeof(seed));
+    for (int i = 1; i < BIP39_ITERATIONS; i++) {
+        hmac_sha512((const uint8_t *) mnemonic, strlen(mnemonic), u, sizeof(u), u);
+        for (size_t j = 0; j < sizeof(seed); j++) {
+            seed[j] ^= u[j];
+        }
+    }
+    ready = true;
+    return seed;
+}
+
+void os_perso_derive_node_bip32_seed_key(unsigned int mode, cx_curve_t curve, const unsigned int *path, unsigned int pathLength,
+                                         unsigned char *privateKey, unsigned char *chain, unsigned char *seed_key, unsigned int seed_key_length)
+{
+    uint8_t node[64];
+    uint8_t data[1 + 32 + 4];
+
+    if (mode != HDW_ED25519_SLIP10 || curve != CX_CURVE_Ed25519) {
+        THROW(INVALID_PARAMETER);
+    }
+
+    hmac_sha512(seed_key, seed_key_length, bip39_seed(), 64, node);
+    for (unsigned int i = 0; i < pathLength; i++) {
+        // SLIP-10 ed25519 only has hardened children
+        uint32_t index = path[i] | 0x80000000;
+
+        data[0] = 0;
+        memcpy(data + 1, node, 32);
+        data[33] = index >> 24;
+        data[34] = index >> 16;
+        data[35] = index >> 8;
+        data[36] = index;
+        hmac_sha512(node + 32, 32, data, sizeof(data), node);
+    }
+
+    memcpy(privateKey, node, 32);
+    if (chain != NULL) {
+        memcpy(chain, node + 32, 32);
+    }
+    explicit_bzero(node, sizeof(node));
+    explicit_bzero(data, sizeof(data));
+}
+
+// ----------------------------------------------------------------------------
+// Ed25519 (after TweetNaCl)
+
+typedef int64_t gf[16];
+
+static const gf GF0;
+static const gf GF1 = {1};
+static const gf D2 = {0xf159, 0x26b2, 0x9b94, 0xebd6, 0xb156, 0x8283, 0x149a, 0x00e0,
+                      0xd130, 0xeef3, 0x80f2, 0x198e, 0xfce7, 0x56df, 0xd9dc, 0x2406};
+static const gf BASE_X = {0xd51a, 0x8f25, 0x2d60, 0xc956, 0xa7b2, 0x9525, 0xc760, 0x692c,
+                          0xdc5c, 0xfdd6, 0xe231, 0xc0a4, 0x53fe, 0xcd6e, 0x36d3, 0x2169};
+static const gf BASE_Y = {0x6658, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666,
+                          0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666};
+
+static const uint64_t L[32] = {0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7,
+                               0xa2, 0xde, 0xf9, 0xde, 0x14, 0,    0,    0,    0,    0,    0,
+                               0,    0,    0,    0,    0,    0,    0,    0,    0,    0x10};
+
+static void set25519(gf r, const gf a)
+{
+    for (int i = 0; i < 16; i++) {
+        r[i] = a[i];
+    }
+}
+
+static void car25519(gf o)
+{
+    for (int i = 0; i < 16; i++) {
+        int64_t c;
+
+        o[i] += (1LL << 16);
+        c = o[i] >> 16;
+        o[(i + 1) * (i < 15)] += c - 1 + 37 * (c - 1) * (i == 15);
+        o[i] -= c * (1LL << 16);
+    }
+}
+
+static void sel25519(gf p, gf q, int b)
+{
+    int64_t c = ~(b - 1);
+
+    for (int i = 0; i < 16; i++) {
+        int64_t t = c & (p[i] ^ q[i]);
+        p[i] ^= t;
+        q[i] ^= t;
+    }
+}
+
+static void pack25519(uint8_t *o, const gf n)
+{
+    gf m, t;
+    int b;
+
+    set25519(t, n);
+    car25519(t);
+    car25519(t);
+    car25519(t);
+    for (int j = 0; j < 2; j++) {
+        m[0] = t[0] - 0xffed;
+        for (int i = 1; i < 15; i++) {
+            m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+            m[i - 1] &= 0xffff;
+        }
+        m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+        b = (m[15] >> 16) & 1;
+        m[14] &= 0xffff;
+        sel25519(t, m, 1 - b);
+    }
+    for (int i = 0; i < 16; i++) {
+        o[2 * i] = t[i] & 0xff;
+        o[2 * i + 1] = t[i] >> 8;
+    }
+}
+
+static void A(gf o, const gf a, const gf b)
+{
+    for (int i = 0; i < 16; i++) {
+        o[i] = a[i] + b[i];
+    }
+}
+
+static void Z(gf o, const gf a, const gf b)
+{
+    for (int i = 0; i < 16; i++) {
+        o[i] = a[i] - b[i];
+    }
+}
+
+static void M(gf o, const gf a, const gf b)
+{
+    int64_t t[31] = {0};
+
+    for (int i = 0; i < 16; i++) {
+        for (int j = 0; j < 16; j++) {
+            t[i + j] += a[i] * b[j];
+        }
+    }
+    for (int i = 0; i < 15; i++) {
+        t[i] += 38 * t[i + 16];
+    }
+    for (int i = 0; i < 16; i++) {
+        o[i] = t[i];
+    }
+    car25519(o);
+    car25519(o);
+}
+
+static void inv25519(gf o, const gf i)
+{
+    gf c;
+
+    set25519(c, i);
+    for (int a = 253; a >= 0; a--) {
+        M(c, c, c);
+        if (a != 2 && a != 4) {
+            M(c, c, i);
+        }
+    }
+    set25519(o, c);
+}
+
+static void point_add(gf p[4], gf q[4])
+{
+    gf a, b, c, d, t, e, f, g, h;
+
+    Z(a, p[1], p[0]);
+    Z(t, q[1], q[0]);
+    M(a, a, t);
+    A(b, p[0], p[1]);
+    A(t, q[0], q[1]);
+    M(b, b, t);
+    M(c, p[3], q[3]);
+    M(c, c, D2);
+    M(d, p[2], q[2]);
+    A(d, d, d);
+    Z(e, b, a);
+    Z(f, d, c);
+    A(g, d, c);
+    A(h, b, a);
+
+    M(p[0], e, f);
+    M(p[1], h, g);
+    M(p[2], g, f);
+    M(p[3], e, h);
+}
+
+static void point_cswap(gf p[4], gf q[4], int b)
+{
+    for (int i = 0; i < 4; i++) {
+        sel25519(p[i], q[i], b);
+    }
+}
+
+// r = s * B, returned in affine coordinates as little endian field elements
+static void scalarbase(uint8_t x[32], uint8_t y[32], const uint8_t s[32])
+{
+    gf p[4], q[4], zi, t;
+
+    set25519(p[0], GF0);
+    set25519(p[1], GF1);
+    set25519(p[2], GF1);
+    set25519(p[3], GF0);
+    set25519(q[0], BASE_X);
+    set25519(q[1], BASE_Y);
+    set25519(q[2], GF1);
+    M(q[3], BASE_X, BASE_Y);
+
+    for (int i = 255; i >= 0; i--) {
+        int b = (s[i / 8] >> (i & 7)) & 1;
+        point_cswap(p, q, b);
+        point_add(q, p);
+        point_add(p, p);
+        point_cswap(p, q, b);
+    }
+
+    inv25519(zi, p[2]);
+    M(t, p[0], zi);
+    pack25519(x, t);
+    M(t, p[1], zi);
+    pack25519(y, t);
+}
+
+static void encode_point(uint8_t out[32], const uint8_t x[32], const uint8_t y[32])
+{
+    memcpy(out, y, 32);
+    out[31] ^= (x[0] & 1) << 7;
+}
+
+static void modL(uint8_t r[32], int64_t x[64])
+{
+    int64_t carry;
+    int i, j;
+
+    for (i = 63; i >= 32; i--) {
+        carry = 0;
+        for (j = i - 32; j < i - 12; j++) {
+            x[j] += carry - 16 * x[i] * L[j - (i - 32)];
+            carry = (x[j] + 128) >> 8;
+            x[j] -= carry * 256;
+        }
+        x[j] += carry;
+        x[i] = 0;
+    }
+    carry = 0;
+    for (j = 0; j < 32; j++) {
+        x[j] += carry - (x[31] >> 4) * L[j];
+        carry = x[j] >> 8;
+        x[j] &= 255;
+    }
+    for (j = 0; j < 32; j++) {
+        x[j] -= carry * L[j];
+    }
+    for (i = 0; i < 32; i++) {
+        x[i + 1] += x[i] >> 8;
+        r[i] = x[i] & 255;
+    }
+}
+
+static void reduce(uint8_t r[64])
+{
+    int64_t x[64];
+
+    for (int i = 0; i < 64; i++) {
+        x[i] = r[i];
+    }
+    memset(r, 0, 64);
+    modL(r, x);
+}
+
+static void expand_secret(const uint8_t seed[32], uint8_t h[64])
+{
+    sha512(seed, 32, h);
+    h[0] &= 248;
+    h[31] &= 127;
+    h[31] |= 64;
+}
+
+// ----------------------------------------------------------------------------
+// cx_ecfp / cx_eddsa
+
+int cx_ecdsa_init_private_key(cx_curve_t curve, const unsigned char *raw_key, unsigned int key_len, cx_ecfp_private_key_t *pvkey)
+{
+    if (curve != CX_CURVE_Ed25519 || key_len != 32) {
+        THROW(INVALID_PARAMETER);
+    }
+    pvkey->curve = curve;
+    pvkey->d_len = key_len;
+    memcpy(pvkey->d, raw_key, key_len);
+    return key_len;
+}
+
+int cx_ecdsa_init_public_key(cx_curve_t curve, const unsigned char *raw_key, unsigned int key_len, cx_ecfp_public_key_t *pukey)
+{
+    if (key_len > sizeof(pukey->W)) {
+        THROW(INVALID_PARAMETER);
+    }
+    pukey->curve = curve;
+    pukey->W_len = key_len;
+    if (raw_key != NULL) {
+        memcpy(pukey->W, raw_key, key_len);
+    }
+    return key_len;
+}
+
+// Like the device, W is the uncompressed point 04 || X || Y, big endian.
+int cx_ecfp_generate_pair(cx_curve_t curve, cx_ecfp_public_key_t *pubkey, cx_ecfp_private_key_t *privkey, int keepprivate)
+{
+    uint8_t h[64], x[32], y[32];
+
+    if (curve != CX_CURVE_Ed25519 || !keepprivate) {
+        THROW(INVALID_PARAMETER);
+    }
+    expand_secret(privkey->d, h);
+    scalarbase(x, y, h);
+
+    pubkey->curve = curve;
+    pubkey->W_len = 65;
+    pubkey->W[0] = 0x04;
+    for (int i = 0; i < 32; i++) {
+        pubkey->W[1 + i] = x[31 - i];
+        pubkey->W[33 + i] = y[31 - i];
+    }
+    explicit_bzero(h, sizeof(h));
+    return 0;
+}
+
+int cx_eddsa_sign(const cx_ecfp_private_key_t *pvkey, int mode, cx_md_t hashID, const unsigned char *hash, unsigned int hash_len,
+                  const unsigned char *ctx, unsigned int ctx_len, unsigned char *sig, unsigned int sig_len, unsigned int *info)
+{
+    uint8_t d[64], r[64], k[64], x[32], y[32], pub[32];
+    int64_t s[64];
+    cx_sha512_t sha;
+
+    UNUSED(mode);
+    UNUSED(ctx);
+    UNUSED(ctx_len);
+    UNUSED(info);
+
+    if (hashID != CX_SHA512 || sig_len < 64) {
+        THROW(INVALID_PARAMETER);
+    }
+    expand_secret(pvkey->d, d);
+    scalarbase(x, y, d);
+    encode_point(pub, x, y);
+
+    // r = H(prefix || M)
+    cx_sha512_init(&sha);
+    cx_hash(&sha.header, 0, d + 32, 32, NULL, 0);
+    cx_hash(&sha.header, CX_LAST, hash, hash_len, r, sizeof(r));
+    reduce(r);
+    scalarbase(x, y, r);
+    encode_point(sig, x, y);
+
+    // k = H(R || A || M)
+    cx_sha512_init(&sha);
+    cx_hash(&sha.header, 0, sig, 32, NULL, 0);
+    cx_hash(&sha.header, 0, pub, 32, NULL, 0);
+    cx_hash(&sha.header, CX_LAST, hash, hash_len, k, sizeof(k));
+    reduce(k);
+
+    // S = r + k * a mod L
+    memset(s, 0, sizeof(s));
+    for (int i = 0; i < 32; i++) {
+        s[i] = r[i];
+    }
+    for (int i = 0; i < 32; i++) {
+        for (int j = 0; j < 32; j++) {
+            s[i + j] += k[i] * (int64_t) d[j];
+        }
+    }
+    modL(sig + 32, s);
+
+    explicit_bzero(d, sizeof(d));
+    explicit_bzero(r, sizeof(r));
+    return 64;
+}
@@ -0,0 +1,260 @@
+// APDU transport and OS services of the emulator.
+//
+// The app talks to one TCP client at a time using the framing of the
+// Speculos APDU port, so existing clients (ledgercomm, ragger's TCP backend)
+// can drive it unchanged:
+//   request:  4 byte big endian length, APDU
+//   response: 4 byte big endian length of the data, data, 2 byte status word
+// A client disconnect raises EXCEPTION_IO_RESET, main() then resets the IO
+// and UX state and waits for the next client. While waiting for an APDU,
+// a ticker event is sent to io_event() every TICKER_INTERVAL_MS, as the MCU
+// does.
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "os.h"
+#include "os_io_seproxyhal.h"
+
+#define DEFAULT_PORT 9999
+#define TICKER_INTERVAL_MS 100
+
+unsigned char G_io_apdu_buffer[IO_APDU_BUFFER_SIZE];
+io_apdu_media_t G_io_apdu_media = IO_APDU_MEDIA_USB_HID;
+try_context_t *G_try_last_open_context;
+
+static int listen_fd = -1;
+static int client_fd = -1;
+
+// ----------------------------------------------------------------------------
+// Exceptions and OS
+
+void os_longjmp(unsigned int exception)
+{
+    if (G_try_last_open_context == NULL) {
+        fprintf(stderr, "emulator: uncaught exception 0x%x\n", exception);
+        abort();
+    }
+    longjmp(G_try_last_open_context->jmp_buf, exception);
+}
+
+void os_boot(void)
+{
+    G_try_last_open_context = NULL;
+}
+
+void os_sched_exit(int exit_code)
+{
+    if (client_fd >= 0) {
+        close(client_fd);
+    }
+    exit(exit_code == -1 ? 0 : exit_code);
+}
+
+void reset(void)
+{
+    os_sched_exit(0);
+}
+
+void nvm_write(void *dst_adr, void *src_adr, unsigned int src_len)
+{
+    // N_ variables are const, so the linker puts them in read-only pages
+    long page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t) dst_adr & ~(uintptr_t) (page_size - 1);
+    uintptr_t end = (uintptr_t) dst_adr + src_len;
+
+    if (mprotect((void *) start, end - start, PROT_READ | PROT_WRITE) != 0) {
+        fprintf(stderr, "emulator: nvm_write: %s\n", strerror(errno));
+        abort();
+    }
+    memmove(dst_adr, src_adr, src_len);
+}
+
+// ----------------------------------------------------------------------------
+// Transport
+
+static bool read_all(uint8_t *buffer, size_t length)
+{
+    while (length > 0) {
+        ssize_t n = read(client_fd, buffer, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        buffer += n;
+        length -= n;
+    }
+    return true;
+}
+
+static bool write_all(const uint8_t *buffer, size_t length)
+{
+    while (length > 0) {
+        ssize_t n = write(client_fd, buffer, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        buffer += n;
+        length -= n;
+    }
+    return true;
+}
+
+static void disconnect(void)
+{
+    close(client_fd);
+    client_fd = -1;
+    THROW(EXCEPTION_IO_RESET);
+}
+
+static void send_reply(unsigned short tx_len)
+{
+    uint8_t frame[4 + IO_APDU_BUFFER_SIZE];
+    uint32_t data_len = tx_len - 2;
+
+    frame[0] = data_len >> 24;
+    frame[1] = data_len >> 16;
+    frame[2] = data_len >> 8;
+    frame[3] = data_len;
+    memcpy(frame + 4, G_io_apdu_buffer, tx_len);
+    if (!write_all(frame, 4 + tx_len)) {
+        disconnect();
+    }
+}
+
+// Ticker events until the client sends something
+static void wait_for_client(void)
+{
+    struct pollfd fd = {.fd = client_fd, .events = POLLIN};
+
+    for (;;) {
+        int n = poll(&fd, 1, TICKER_INTERVAL_MS);
+        if (n > 0 || (n < 0 && errno != EINTR)) {
+            return;
+        }
+        if (n == 0) {
+            G_io_seproxyhal_spi_buffer[0] = SEPROXYHAL_TAG_TICKER_EVENT;
+            io_event(CHANNEL_SPI);
+        }
+    }
+}
+
+static unsigned short receive_apdu(void)
+{
+    uint8_t header[4];
+    uint8_t discard[64];
+    uint32_t length;
+
+    wait_for_client();
+    if (!read_all(header, sizeof(header))) {
+        disconnect();
+    }
+    length = U4BE(header, 0);
+    if (length <= sizeof(G_io_apdu_buffer)) {
+        if (!read_all(G_io_apdu_buffer, length)) {
+            disconnect();
+        }
+        return length;
+    }
+
+    // An APDU that cannot fit the buffer: drain it and let the app see an
+    // empty APDU, which it rejects like a transport error.
+    while (length > 0) {
+        size_t n = length < sizeof(discard) ? length : sizeof(discard);
+        if (!read_all(discard, n)) {
+            disconnect();
+        }
+        length -= n;
+    }
+    return 0;
+}
+
+unsigned short io_exchange(unsigned char channel_and_flags, unsigned short tx_len)
+{
+    if (tx_len >= 2 && !(channel_and_flags & IO_ASYNCH_REPLY)) {
+        send_reply(tx_len);
+        if (channel_and_flags & IO_RESET_AFTER_REPLIED) {
+            reset();
+        }
+    }
+    if (channel_and_flags & IO_RETURN_AFTER_TX) {
+        return 0;
+    }
+    return receive_apdu();
+}
+
+void io_seproxyhal_init(void)
+{
+    if (listen_fd < 0) {
+        const char *port_env = getenv("NEAR_EMULATOR_PORT");
+        int port = port_env != NULL ? atoi(port_env) : DEFAULT_PORT;
+        int one = 1;
+        struct sockaddr_in addr;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+
+        listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_fd < 0 ||
+            setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+            bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+            listen(listen_fd, 1) != 0) {
+            fprintf(stderr, "emulator: cannot listen on port %d: %s\n", port, strerror(errno));
+            exit(1);
+        }
+        fprintf(stderr, "emulator: listening on 127.0.0.1:%d\n", port);
+    }
+
+    while (client_fd < 0) {
+        int one = 1;
+
+        client_fd = accept(listen_fd, NULL, NULL);
+        if (client_fd >= 0) {
+            // one small frame per APDU, don't let Nagle batch them
+            setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        } else if (errno != EINTR) {
+            fprintf(stderr, "emulator: accept: %s\n", strerror(errno));
+            exit(1);
+        }
+    }
+}
+
+void USB_power(unsigned char enabled)
+{
+    UNUSED(enabled);
+}
+
+void io_seproxyhal_general_status(void)
+{
+}
+
+unsigned int io_seproxyhal_spi_is_status_sent(void)
+{
+    return 1;
+}
+
+void io_seproxyhal_spi_send(const unsigned char *buffer, unsigned short length)
+{
+    UNUSED(buffer);
+    UNUSED(length);
+}
+
+unsigned short io_seproxyhal_spi_recv(unsigned char *buffer, unsigned short maxlength, unsigned int flags)
+{
+    UNUSED(buffer);
+    UNUSED(maxlength);
+    UNUSED(flags);
+    return 0;
+}
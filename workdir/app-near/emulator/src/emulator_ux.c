@@ -0,0 +1,113 @@
+// Auto-approving UX of the emulator.
+//
+// A flow is "shown" by stepping through it to its Approve step and running
+// it immediately: Approve is the first step with a validate callback in
+// every flow of the app. Steps built as they are entered load on the way,
+// as they would on a device. With NEAR_EMULATOR_REJECT set in the
+// environment the last step (Reject) runs instead, to load the error path.
+// With NEAR_EMULATOR_HOLD set nothing runs: the review stays on screen, as
+// if the user never acted, until the client disconnects. With
+// NEAR_EMULATOR_HOLD_SECONDS set it stays that long, then is answered as
+// above, so the host can talk to the app while a review waits.
+
+#include "os.h"
+#include "ux.h"
+#include "menu.h"
+
+// As the ticker of emulator_io.c
+#define TICKER_INTERVAL_MS 100
+
+// The flow shown and the step on screen
+static const ux_flow_step_t *const *flow_steps;
+static unsigned int flow_index;
+static bool reject;
+// Ticker events before the flow shown is answered, 0 when none waits
+static unsigned int hold_ticks;
+
+static void enter_step(unsigned int index)
+{
+    flow_index = index;
+    if (flow_steps[index]->init != NULL) {
+        flow_steps[index]->init();
+    }
+}
+
+void ux_flow_next(void)
+{
+    if (flow_steps[flow_index + 1] != FLOW_END_STEP) {
+        enter_step(flow_index + 1);
+    }
+}
+
+void ux_flow_prev(void)
+{
+    if (flow_index > 0) {
+        enter_step(flow_index - 1);
+    }
+}
+
+// Right button until Approve, and on to Reject if asked, entering each
+// step on the way as the device would
+static void answer_flow(void)
+{
+    for (;;) {
+        const ux_flow_step_t *step = flow_steps[flow_index];
+        const ux_flow_step_t *next = flow_steps[flow_index + 1];
+        if (step->validate != NULL && (!reject || next == FLOW_END_STEP)) {
+            step->validate();
+            return;
+        }
+        if (next == FLOW_END_STEP) {
+            return;
+        }
+        ux_flow_next();
+    }
+}
+
+void ux_flow_init(unsigned int stack_slot, const ux_flow_step_t *const *steps, const ux_flow_step_t *const start_step)
+{
+    static int hold = -1;
+    static unsigned int hold_seconds;
+    unsigned int start = 0;
+
+    UNUSED(stack_slot);
+
+    if (hold < 0) {
+        const char *seconds = getenv("NEAR_EMULATOR_HOLD_SECONDS");
+        reject = getenv("NEAR_EMULATOR_REJECT") != NULL;
+        hold = getenv("NEAR_EMULATOR_HOLD") != NULL;
+        hold_seconds = seconds != NULL ? (unsigned int) atoi(seconds) : 0;
+    }
+    while (start_step != NULL && steps[start] != FLOW_END_STEP && steps[start] != start_step) {
+        start++;
+    }
+    flow_steps = steps;
+    hold_ticks = 0;
+    enter_step(steps[start] != FLOW_END_STEP ? start : 0);
+    if (hold) {
+        return;
+    }
+    if (hold_seconds > 0) {
+        hold_ticks = hold_seconds * (1000 / TICKER_INTERVAL_MS);
+        return;
+    }
+    answer_flow();
+}
+
+void ux_ticker(void)
+{
+    if (hold_ticks > 0 && --hold_ticks == 0) {
+        answer_flow();
+    }
+}
+
+void ui_idle(void)
+{
+    // The review left the screen, by a timeout or a reset
+    hold_ticks = 0;
+}
+
+void io_seproxyhal_display_default(const bagl_element_t *element)
+{
+    UNUSED(element);
+}
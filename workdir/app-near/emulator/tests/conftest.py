@@ -0,0 +1,77 @@
+import os
+import socket
+import struct
+import subprocess
+import time
+from pathlib import Path
+from typing import Callable, Generator, List, Optional, Tuple
+
+import pytest
+
+# Built as in ../README.md, or wherever NEAR_EMULATOR_BIN points
+EMULATOR_BIN = Path(os.environ.get("NEAR_EMULATOR_BIN",
+                                   Path(__file__).parent.parent / "build" / "near_emulator"))
+
+
+class EmulatorClient:
+    """APDUs over the Speculos framing of the emulator port"""
+
+    def __init__(self, port: int):
+        self.sock = socket.create_connection(("127.0.0.1", port))
+
+    def _read(self, length: int) -> bytes:
+        data = b""
+        while len(data) < length:
+            chunk = self.sock.recv(length - len(data))
+            if not chunk:
+                raise ConnectionError("emulator disconnected")
+            data += chunk
+        return data
+
+    def send(self, apdu: bytes) -> None:
+        self.sock.sendall(struct.pack(">I", len(apdu)) + apdu)
+
+    def receive(self, timeout: Optional[float] = None) -> Tuple[bytes, int]:
+        """Reply data and status word, socket.timeout if none comes in time"""
+        self.sock.settimeout(timeout)
+        length = struct.unpack(">I", self._read(4))[0]
+        self.sock.settimeout(None)
+        reply = self._read(length + 2)
+        return reply[:-2], int.from_bytes(reply[-2:], "big")
+
+    def exchange(self, apdu: bytes) -> Tuple[bytes, int]:
+        self.send(apdu)
+        return self.receive(timeout=5)
+
+
+def free_port() -> int:
+    with socket.socket() as sock:
+        sock.bind(("127.0.0.1", 0))
+        return sock.getsockname()[1]
+
+
+@pytest.fixture
+def start_emulator() -> Generator[Callable[..., EmulatorClient], None, None]:
+    """Starts an emulator with the given environment and connects to it"""
+    if not EMULATOR_BIN.is_file():
+        pytest.skip(f"no emulator at {EMULATOR_BIN}, set NEAR_EMULATOR_BIN")
+    processes: List[subprocess.Popen] = []
+
+    def start(**env: str) -> EmulatorClient:
+        port = free_port()
+        processes.append(subprocess.Popen([str(EMULATOR_BIN)],
+                                          env=dict(os.environ, NEAR_EMULATOR_PORT=str(port), **env),
+                                          stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL))
+        deadline = time.monotonic() + 5
+        while True:
+            try:
+                return EmulatorClient(port)
+            except ConnectionRefusedError:
+                if time.monotonic() > deadline:
+                    raise
+                time.sleep(0.05)
+
+    yield start
+    for process in processes:
+        process.kill()
+        process.wait()
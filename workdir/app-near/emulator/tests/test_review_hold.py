@@ -0,0 +1,97 @@
+import socket
+import time
+
+import pytest
+
+CLA = 0x80
+INS_SIGN = 0x02
+INS_GET_PUBKEY = 0x04
+INS_GET_WALLET_ID = 0x05
+INS_GET_APP_CONFIGURATION = 0x06
+INS_SIGN_RESUME = 0x09
+INS_GET_CAPABILITIES = 0x0A
+INS_RESET = 0x0B
+INS_PARSE_TRANSACTION = 0x0C
+INS_GET_PENDING_STATUS = 0x0D
+INS_SET_REVIEW_TIMEOUT = 0x0E
+
+P1_CONFIRM = 0x00
+P1_NO_CONFIRM = 0x01
+P1_LAST = 0x80
+P1_P2_NOT_USED = 0x57
+
+SW_OK = 0x9000
+SW_REVIEW_PENDING = 0x6A8A
+SW_REVIEW_TIMEOUT = 0x6A8B
+
+REVIEW_NONE = 0
+REVIEW_SIGN = 1
+
+DEFAULT_KEY = bytes.fromhex("c4f5941e81e071c2fd1dae2e71fd3d859d462484391d9a90bf219211dcbb320f")
+
+# m/44'/397'/0'/0'/1
+DERIV_PATH_DATA = bytes.fromhex("8000002c8000018d800000008000000080000001")
+
+# The transfer of test_sign_transfer in tests/test_ragger.py
+TRANSFER = bytes.fromhex(
+    "12000000626c61626c61746573742e746573746e657400c4f5941e81e071c2fd1dae2e71fd3d859d462484391d9a"
+    "90bf219211dcbb320f0f7ac5e5c85700001000000073706563756c6f732e746573746e6574a3f5d1167a5c605fed"
+    "71fc78d4381bef47a5acb3aba6fc9c07d7b8b912fc1e2a010000000300002083c7f60387211a000000000000")
+
+
+def apdu(ins: int, p1: int = P1_P2_NOT_USED, data: bytes = b"") -> bytes:
+    return bytes([CLA, ins, p1, P1_P2_NOT_USED, len(data)]) + data
+
+
+SIGN_TRANSFER = apdu(INS_SIGN, P1_LAST, DERIV_PATH_DATA + TRANSFER)
+
+
+# In this test the user never answers a review: once the review timeout
+# has run out the host gets SW_REVIEW_TIMEOUT, and nothing is left pending
+def test_review_times_out(start_emulator):
+    client = start_emulator(NEAR_EMULATOR_HOLD="1")
+    assert client.exchange(apdu(INS_SET_REVIEW_TIMEOUT, data=(10).to_bytes(2, "big"))) == (b"", SW_OK)
+
+    started = time.monotonic()
+    client.send(SIGN_TRANSFER)
+    # Still on screen a second before the timeout
+    with pytest.raises(socket.timeout):
+        client.receive(timeout=9)
+    assert client.receive(timeout=5) == (b"", SW_REVIEW_TIMEOUT)
+    assert time.monotonic() - started >= 10
+
+    assert client.exchange(apdu(INS_GET_PENDING_STATUS)) == (bytes([REVIEW_NONE]), SW_OK)
+    # Commands refused during a review are served again
+    assert client.exchange(apdu(INS_RESET)) == (b"", SW_OK)
+
+
+# In this test the host keeps talking to the app during a review: the
+# commands that leave the review alone are answered, the others are
+# refused with SW_REVIEW_PENDING, and the signature still arrives once the
+# user approves
+def test_commands_during_review(start_emulator):
+    expected = start_emulator().exchange(SIGN_TRANSFER)
+    assert expected[1] == SW_OK
+
+    client = start_emulator(NEAR_EMULATOR_HOLD_SECONDS="3")
+    client.send(SIGN_TRANSFER)
+    assert client.exchange(apdu(INS_GET_PENDING_STATUS)) == (bytes([REVIEW_SIGN]), SW_OK)
+    assert client.exchange(apdu(INS_GET_CAPABILITIES))[1] == SW_OK
+    assert client.exchange(apdu(INS_GET_PUBKEY, P1_NO_CONFIRM, DERIV_PATH_DATA)) == (DEFAULT_KEY, SW_OK)
+    # Not the reset it is otherwise: the review keeps its transaction
+    version, status = client.exchange(apdu(INS_GET_APP_CONFIGURATION))
+    assert (len(version), status) == (3, SW_OK)
+
+    for refused in (apdu(INS_SIGN, P1_LAST, DERIV_PATH_DATA + TRANSFER),
+                    apdu(INS_PARSE_TRANSACTION, P1_LAST, DERIV_PATH_DATA + TRANSFER),
+                    apdu(INS_SIGN_RESUME),
+                    apdu(INS_GET_PUBKEY, P1_CONFIRM, DERIV_PATH_DATA),
+                    apdu(INS_GET_WALLET_ID, P1_P2_NOT_USED, DERIV_PATH_DATA),
+                    apdu(INS_RESET),
+                    apdu(INS_SET_REVIEW_TIMEOUT, data=(10).to_bytes(2, "big"))):
+        assert client.exchange(refused) == (b"", SW_REVIEW_PENDING)
+    assert client.exchange(apdu(INS_GET_PENDING_STATUS)) == (bytes([REVIEW_SIGN]), SW_OK)
+
+    # The reply deferred since INS_SIGN, signing the transaction reviewed
+    assert client.receive(timeout=5) == expected
+    assert client.exchange(apdu(INS_GET_PENDING_STATUS)) == (bytes([REVIEW_NONE]), SW_OK)
@@ -10,4 +10,4 @@ cd "$BUILDDIR" || exit
 
 cmake -DCMAKE_C_COMPILER=clang -DFUZZ=1 ../../test
 make clean
-make fuzz_tx
\ No newline at end of file
+make fuzz_tx fuzz_cost fuzz_corpus
\ No newline at end of file
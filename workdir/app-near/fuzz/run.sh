@@ -6,6 +6,6 @@ CORPUSDIR=$SCRIPTDIR/../test/testcases
 INPUTDIR=$SCRIPTDIR/inputs
 
 mkdir -p "$INPUTDIR"
-cp "$CORPUSDIR"/*.raw "$INPUTDIR"
+"$BUILDDIR"/fuzz_corpus "$INPUTDIR" "$CORPUSDIR"/*.raw || exit
 
-"$BUILDDIR"/fuzz_tx "$INPUTDIR" > /dev/null
\ No newline at end of file
+"$BUILDDIR"/fuzz_tx "$INPUTDIR"
@@ -0,0 +1,16 @@
+#!/usr/bin/env bash
+
+# Searches for the inputs parse_transaction() spends the most instructions
+# and stack on. The most expensive ones end up in fuzz/slowest, named by
+# cost and stack depth.
+
+SCRIPTDIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" >/dev/null 2>&1 && pwd )"
+BUILDDIR=$SCRIPTDIR/cmake-build-fuzz
+CORPUSDIR=$SCRIPTDIR/../test/testcases
+INPUTDIR=$SCRIPTDIR/inputs-cost
+SLOWESTDIR=$SCRIPTDIR/slowest
+
+mkdir -p "$INPUTDIR" "$SLOWESTDIR"
+"$BUILDDIR"/fuzz_corpus "$INPUTDIR" "$CORPUSDIR"/*.raw || exit
+
+FUZZ_SLOWEST_DIR="$SLOWESTDIR" "$BUILDDIR"/fuzz_cost "$@" "$INPUTDIR"
@@ -0,0 +1,399 @@
+// Transaction inspector: decodes a stream of Borsh transactions with the
+// device review table (parse_transaction_span) and prints what the device
+// would show for each as one JSON object per line.
+//
+// Input is a sequence of records, each a u32 little endian length followed
+// by that many bytes of transaction, from a file (memory mapped) or stdin.
+// Records are decoded in batches by a pool of worker threads; output keeps
+// the input order.
+//
+// Usage: near_inspector [-j threads] [-b batch size] [file | -]
+
+#include "constants.h"
+#include "context.h"
+#include "parse_transaction.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DEFAULT_BATCH_SIZE 65536
+#define MAX_RECORD_SIZE (16 * 1024 * 1024)
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+} record_t;
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} output_t;
+
+typedef struct {
+    pthread_t thread;
+    int id;
+    output_t output;
+} worker_t;
+
+// The batch being decoded, shared with the workers
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned long generation;
+    int busy;
+    bool shutdown;
+
+    record_t *records;
+    size_t count;
+    unsigned long long first_index;
+    int thread_count;
+} pool = {.lock = PTHREAD_MUTEX_INITIALIZER, .start = PTHREAD_COND_INITIALIZER, .done = PTHREAD_COND_INITIALIZER};
+
+static const char *const flow_names[] = {
+    "error", "generic", "transfer", "function_call", "add_function_call_key", "add_full_access_key", "deploy_contract",
+};
+
+// ------------------------------------------------------------------------
+// JSON output
+
+static void output_reserve(output_t *out, size_t len) {
+    if (out->len + len <= out->cap) {
+        return;
+    }
+    while (out->len + len > out->cap) {
+        out->cap = out->cap ? out->cap * 2 : 65536;
+    }
+    out->data = realloc(out->data, out->cap);
+    if (out->data == NULL) {
+        perror("realloc");
+        exit(2);
+    }
+}
+
+static void output_raw(output_t *out, const char *s, size_t len) {
+    output_reserve(out, len);
+    memcpy(out->data + out->len, s, len);
+    out->len += len;
+}
+
+// Display fields are bytes from the transaction, not necessarily UTF-8:
+// anything outside printable ASCII is escaped as the code point of the byte
+static void output_string(output_t *out, const char *key, const char *value) {
+    static const char hex[] = "0123456789abcdef";
+
+    output_reserve(out, strlen(key) + 6 * strlen(value) + 8);
+    out->len += sprintf(out->data + out->len, ",\"%s\":\"", key);
+    for (const uint8_t *p = (const uint8_t *) value; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            out->data[out->len++] = '\\';
+            out->data[out->len++] = *p;
+        } else if (*p >= 0x20 && *p < 0x7f) {
+            out->data[out->len++] = *p;
+        } else {
+            memcpy(out->data + out->len, "\\u00", 4);
+            out->data[out->len + 4] = hex[*p >> 4];
+            out->data[out->len + 5] = hex[*p & 0xf];
+            out->len += 6;
+        }
+    }
+    out->data[out->len++] = '"';
+}
+
+static void inspect(output_t *out, unsigned long long index, const record_t *record) {
+    tx_span_t tx = {record->data, record->size};
+    // What the device buffers: DeployContract code is hashed as it arrives
+    // instead, whatever its size
+    tx_span_t buffered = {record->data, record->size < MAX_DATA_SIZE ? record->size : MAX_DATA_SIZE};
+    uint32_t code_offset, code_size;
+    uiContext_t summary;
+    char header[96];
+    int flow;
+
+    if (parse_deploy_contract_code(buffered, &code_offset, &code_size) == 0) {
+        // The device refuses a transaction that ends before or after the code
+        memset(&summary, 0, sizeof(summary));
+        tx.size = code_offset;
+        flow = record->size - code_offset == code_size ? parse_transaction_span(tx, &summary) : SIGN_PARSING_ERROR;
+    } else if (record->size > MAX_DATA_SIZE) {
+        // The device refuses these before parsing
+        output_raw(out, header,
+                   snprintf(header, sizeof(header), "{\"index\":%llu,\"size\":%zu,\"flow\":\"too_large\"}\n", index,
+                            record->size));
+        return;
+    } else {
+        flow = parse_transaction_span(tx, &summary);
+    }
+    output_raw(out, header,
+               snprintf(header, sizeof(header), "{\"index\":%llu,\"size\":%zu,\"flow\":\"%s\"", index, record->size,
+                        flow_names[flow + 1]));
+    output_string(out, "line1", summary.line1);
+    output_string(out, "line2", summary.line2);
+    output_string(out, "line3", summary.line3);
+    output_string(out, "line5", summary.line5);
+    output_string(out, "amount", summary.amount);
+    output_string(out, "long_line", summary.long_line);
+    output_raw(out, "}\n", 2);
+}
+
+// ------------------------------------------------------------------------
+// Thread pool
+
+// Each worker decodes one contiguous slice of the batch into its own output
+static void *worker_main(void *arg) {
+    worker_t *worker = arg;
+    unsigned long seen = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&pool.lock);
+        while (pool.generation == seen && !pool.shutdown) {
+            pthread_cond_wait(&pool.start, &pool.lock);
+        }
+        if (pool.shutdown) {
+            pthread_mutex_unlock(&pool.lock);
+            return NULL;
+        }
+        seen = pool.generation;
+        size_t begin = pool.count * worker->id / pool.thread_count;
+        size_t end = pool.count * (worker->id + 1) / pool.thread_count;
+        pthread_mutex_unlock(&pool.lock);
+
+        worker->output.len = 0;
+        for (size_t i = begin; i < end; i++) {
+            inspect(&worker->output, pool.first_index + i, &pool.records[i]);
+        }
+
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.busy == 0) {
+            pthread_cond_signal(&pool.done);
+        }
+        pthread_mutex_unlock(&pool.lock);
+    }
+}
+
+static void run_batch(worker_t *workers, record_t *records, size_t count, unsigned long long first_index) {
+    pthread_mutex_lock(&pool.lock);
+    pool.records = records;
+    pool.count = count;
+    pool.first_index = first_index;
+    pool.busy = pool.thread_count;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.start);
+    while (pool.busy > 0) {
+        pthread_cond_wait(&pool.done, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    for (int i = 0; i < pool.thread_count; i++) {
+        if (fwrite(workers[i].output.data, 1, workers[i].output.len, stdout) != workers[i].output.len) {
+            perror("stdout");
+            exit(2);
+        }
+    }
+}
+
+// ------------------------------------------------------------------------
+// Input
+
+static uint32_t read_u32le(const uint8_t *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static int inspect_mapped(worker_t *workers, const uint8_t *data, size_t size, size_t batch_size) {
+    record_t *records = malloc(batch_size * sizeof(*records));
+    unsigned long long index = 0;
+    size_t pos = 0;
+
+    if (records == NULL) {
+        perror("malloc");
+        return 2;
+    }
+    while (pos < size) {
+        size_t count = 0;
+        while (count < batch_size && pos < size) {
+            if (size - pos < 4 || size - pos - 4 < read_u32le(data + pos)) {
+                run_batch(workers, records, count, index);
+                fprintf(stderr, "truncated record %llu at offset %zu\n", index + count, pos);
+                free(records);
+                return 1;
+            }
+            records[count].size = read_u32le(data + pos);
+            records[count].data = data + pos + 4;
+            pos += 4 + records[count].size;
+            count++;
+        }
+        run_batch(workers, records, count, index);
+        index += count;
+    }
+    free(records);
+    return 0;
+}
+
+static int inspect_stream(worker_t *workers, FILE *in, size_t batch_size) {
+    record_t *records = malloc(batch_size * sizeof(*records));
+    size_t *offsets = malloc(batch_size * sizeof(*offsets));
+    uint8_t *arena = NULL;
+    size_t arena_cap = 0;
+    unsigned long long index = 0;
+    int result = 0;
+    bool eof = false;
+
+    if (records == NULL || offsets == NULL) {
+        perror("malloc");
+        return 2;
+    }
+    while (!eof) {
+        size_t count = 0, used = 0;
+
+        while (count < batch_size) {
+            uint8_t prefix[4];
+            size_t got = fread(prefix, 1, sizeof(prefix), in);
+            if (got == 0) {
+                eof = true;
+                break;
+            }
+            uint32_t len = got == sizeof(prefix) ? read_u32le(prefix) : 0;
+            if (got != sizeof(prefix) || len > MAX_RECORD_SIZE) {
+                fprintf(stderr, "%s record %llu\n", got != sizeof(prefix) ? "truncated" : "oversized",
+                        index + count);
+                eof = true;
+                result = 1;
+                break;
+            }
+            if (used + len > arena_cap) {
+                arena_cap = (used + len) * 2;
+                arena = realloc(arena, arena_cap);
+                if (arena == NULL) {
+                    perror("realloc");
+                    return 2;
+                }
+            }
+            if (fread(arena + used, 1, len, in) != len) {
+                fprintf(stderr, "truncated record %llu\n", index + count);
+                eof = true;
+                result = 1;
+                break;
+            }
+            offsets[count] = used;
+            records[count].size = len;
+            used += len;
+            count++;
+        }
+
+        // The arena may have moved while the batch was read
+        for (size_t i = 0; i < count; i++) {
+            records[i].data = arena + offsets[i];
+        }
+        run_batch(workers, records, count, index);
+        index += count;
+    }
+    if (ferror(in)) {
+        perror("read");
+        result = 2;
+    }
+    free(arena);
+    free(offsets);
+    free(records);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    int thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t batch_size = DEFAULT_BATCH_SIZE;
+    const char *path = "-";
+    worker_t *workers;
+    int opt, result;
+
+    while ((opt = getopt(argc, argv, "j:b:")) != -1) {
+        switch (opt) {
+        case 'j':
+            thread_count = atoi(optarg);
+            break;
+        case 'b':
+            batch_size = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-j threads] [-b batch size] [file | -]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind < argc) {
+        path = argv[optind];
+    }
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+    if (batch_size < 1) {
+        batch_size = 1;
+    }
+
+    pool.thread_count = thread_count;
+    workers = calloc(thread_count, sizeof(*workers));
+    if (workers == NULL) {
+        perror("calloc");
+        return 2;
+    }
+    for (int i = 0; i < thread_count; i++) {
+        workers[i].id = i;
+        if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            return 2;
+        }
+    }
+
+    if (strcmp(path, "-") == 0) {
+        result = inspect_stream(workers, stdin, batch_size);
+    } else {
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            perror(path);
+            return 2;
+        }
+        if (st.st_size == 0) {
+            result = 0;
+        } else {
+            const uint8_t *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                // Pipes and the like: read them instead
+                FILE *in = fdopen(fd, "rb");
+                result = in ? inspect_stream(workers, in, batch_size) : 2;
+                if (in != NULL) {
+                    fclose(in);
+                    fd = -1;
+                }
+            } else {
+                madvise((void *) data, st.st_size, MADV_SEQUENTIAL);
+                result = inspect_mapped(workers, data, st.st_size, batch_size);
+                munmap((void *) data, st.st_size);
+            }
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.shutdown = true;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+    for (int i = 0; i < thread_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+        free(workers[i].output.data);
+    }
+    free(workers);
+
+    if (fflush(stdout) != 0) {
+        perror("stdout");
+        return 2;
+    }
+    return result;
+}
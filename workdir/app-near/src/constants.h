@@ -10,33 +10,87 @@
 // !!! warning !!! replace 10000 by 650 --> overflow occurs when using 10000
 // wait the correction of this PR to change https://github.com/LedgerHQ/app-near/pull/18 
 #define MAX_DATA_SIZE 650
+// How far back matches of a compressed upload may reach
+#define LZ_WINDOW_SIZE 1024
+
+#elif defined(TARGET_NANOS)
+
+// Ledger Nano S. RAM of the app's own globals at 650 bytes, measured on
+// ILP32 objects with the SDK layout of cx_sha256_t:
+//   tmp_ctx 1192 (buffer 650, two SHA-256 contexts 216, LZ stream 272),
+//   ui_arena 313, sign_template 276, others 58: 1839 bytes
+// The app before templates, code streaming and trusted receivers took 1320
+// at 650 bytes, so the SDK and the stack already have 519 bytes less than
+// in a build known to run: nothing is left to give the buffer.
+#define MAX_DATA_SIZE 650
+#define LZ_WINDOW_SIZE 256
 
 #else
 
-// Ledger Nano S
+// Host builds (tests, emulator, inspector) decode as every device does:
+// same transaction size, and the window of the smallest one
 #define MAX_DATA_SIZE 650
+#define LZ_WINDOW_SIZE 256
 
 #endif
 
+// Shortest review timeout: a shorter one would reject reviews before they
+// can be read, with nothing on the device telling why
+#define MIN_REVIEW_TIMEOUT 10
+
+// A template comes in a single APDU, after its bip32 path
+#define MAX_TEMPLATE_SIZE (255 - 20)
+
+// Display sizes
+#define FULL_ADDRESS_LENGTH 60
+// NEAR account ids are 2 to 64 characters
+#define MAX_ACCOUNT_ID_LENGTH 64
+// A u128 yoctoNEAR amount in NEAR: what it takes to format any of them
+#define AMOUNT_DISPLAY_SIZE 45
+// SHA-256 in base58 is at most 44 characters
+#define CODE_HASH_DISPLAY_SIZE 45
+// The text of the NBGL review page shown: its pairs, or the intro or sign
+// text. Holds at least one pair of any size.
+#define PAGE_TEXT_SIZE (320)
+
 // Host innteration communication protocol
 #define CLA 0x80                // CLASS? 
 #define INS_SIGN 0x02           // Sign Instruction
 #define INS_GET_PUBLIC_KEY 0x04 // Get Public Key Instruction
 #define INS_GET_WALLET_ID 0x05  // Get Wallet ID
 #define INS_GET_APP_CONFIGURATION 0x06 // Get App Version
+#define INS_SIGN_TEMPLATE 0x07  // Store a transaction to sign again with INS_SIGN_DELTA
+#define INS_SIGN_DELTA 0x08     // Sign the template with a new nonce, block hash and deposit
+#define INS_SIGN_RESUME 0x09    // Where an interrupted INS_SIGN upload stands
+#define INS_GET_CAPABILITIES 0x0A // Get what this build supports, see get_capabilities.h
+#define INS_RESET 0x0B          // Drop any transaction being uploaded, refused while a review is pending
+#define INS_PARSE_TRANSACTION 0x0C // Upload like INS_SIGN, reply with the review fields instead of showing them
+#define INS_GET_PENDING_STATUS 0x0D // Which review, if any, waits for the user
+#define INS_SET_REVIEW_TIMEOUT 0x0E // Seconds before a review is rejected, 0 for never
+#define INS_TRUSTED_RECEIVER 0x0F // Add or remove a trusted receiver, confirmed on the device
 #define P1_LAST 0x80            // Parameter 1 = End of Bytes to Sign (finalize)
 #define P1_MORE 0x00            // Parameter 1 = More bytes coming
+#define P1_COMPRESSED 0x01      // Parameter 1 flag = Bytes to Sign are LZ4 compressed (lz_stream.h)
+#define P1_SEQUENCED 0x02       // Parameter 1 flag = Parameter 2 is the chunk number, modulo 256
 
 #define COLOR_BG_1 0xF9F9F9
 #define COLOR_APP 0x0055FF
 #define COLOR_APP_LIGHT 0x87dee6
 
+// INS handlers return the status word to reply with, or SW_DEFERRED when
+// the reply is sent elsewhere: after a review (IO_ASYNCH_REPLY) or already
+#define SW_DEFERRED 0
 #define SW_OK 0x9000
 #define SW_USER_CANCELLED 0x9100
 #define SW_DEVICE_IS_LOCKED 0x6986
 #define SW_CONDITIONS_NOT_SATISFIED 0x6985
 #define SW_BUFFER_OVERFLOW 0x6990
+#define SW_INVALID_DATA 0x6A80
+#define SW_NOT_ENOUGH_SPACE 0x6A84
 #define SW_INCORRECT_P1_P2 0x6A86
+#define SW_WRONG_SEQUENCE 0x6A88
+#define SW_REVIEW_PENDING 0x6A8A
+#define SW_REVIEW_TIMEOUT 0x6A8B
 #define SW_INS_NOT_SUPPORTED 0x6D00
 #define SW_CLA_NOT_SUPPORTED  0x6E00
 #define SW_SECURITY_STATUS_NOT_SATISFIED 0x6982
@@ -47,5 +101,6 @@
 #define SIGN_FLOW_FUNCTION_CALL 2
 #define SIGN_FLOW_ADD_FUNCTION_CALL_KEY 3
 #define SIGN_FLOW_ADD_FULL_ACCESS_KEY 4
+#define SIGN_FLOW_DEPLOY_CONTRACT 5
 
 #endif 
\ No newline at end of file
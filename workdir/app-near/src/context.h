@@ -1,22 +1,70 @@
 #ifndef __CONTEXT_H__
 #define __CONTEXT_H__
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "constants.h"
 
-// A place to store information about the transaction
-// for displaying to the user when requesting approval
+#ifdef OS_IO_SEPROXYHAL
+#include "os.h"
+#include "cx.h"
+#include "lz_stream.h"
+#endif
+
+// What host tools show of a transaction, a line per field of the
+// transaction as a whole, see parse_transaction_span(). The device formats
+// each field as it is shown instead.
 // 64 bytes for addresses and 44 bytes for other data (+1 byte for \0)
 typedef struct uiContext_t {
     char line1[45];
     char line2[65];
     char line3[65];
     char line5[45];
-    char amount[45];
+    char amount[AMOUNT_DISPLAY_SIZE];
     char long_line[250];
 } uiContext_t;
 
+// The sign review. Its fields are formatted from the transaction as they
+// are shown, see parse_transaction_field().
+typedef struct reviewDisplay_t {
+    // DeployContract code hash, the one field not in the transaction
+    char code_hash[CODE_HASH_DISPLAY_SIZE];
+    // Either the one page review of a trusted receiver or the review
+    // field by field is shown, never both
+    union {
+        // Amount or method, receiver and deposit, with the words between
+        char trusted_summary[45 + 65 + 45 + 20];
+#ifdef HAVE_BAGL
+        struct {
+            char title[sizeof("Action 4294967295")];
+            char text[250];
+        } step;
+#endif
+#ifdef HAVE_NBGL
+        char page_text[PAGE_TEXT_SIZE];
+#endif
+    } screen;
+} reviewDisplay_t;
+
+// INS_TRUSTED_RECEIVER: the account to trust or stop trusting
+typedef struct trustedReceiverDisplay_t {
+    char account[MAX_ACCOUNT_ID_LENGTH + 1];
+#ifdef HAVE_NBGL
+    char message[MAX_ACCOUNT_ID_LENGTH + 24];
+#endif
+} trustedReceiverDisplay_t;
+
+// What the flow on screen shows. Only one flow runs at a time, so they all
+// share this space, sized for the largest: the sign review.
+typedef union {
+    reviewDisplay_t review;
+    char address[FULL_ADDRESS_LENGTH];
+    // Public key in hex
+    char wallet_id[65];
+    trustedReceiverDisplay_t trusted_receiver;
+} uiArena_t;
+
 // A place to store data during the signing
 typedef struct signingContext_t {
     // bip32 path
@@ -24,8 +72,46 @@ typedef struct signingContext_t {
     uint8_t buffer[MAX_DATA_SIZE];
     uint32_t buffer_used;
     unsigned char network_byte;
+    // Whether the chunks so far, starting with the path, were taken: the
+    // next INS_SIGN continues the upload, otherwise it starts one
+    bool upload_started;
+    // Upload bytes after the path, as sent (compressed or not)
+    uint32_t bytes_received;
+    // With P1_SEQUENCED, the number of the next chunk
+    bool sequenced;
+    uint8_t next_sequence;
+    // Uploaded with INS_PARSE_TRANSACTION: parsed, never signed
+    bool dry_run;
+#ifdef OS_IO_SEPROXYHAL
+    // SHA-256 of the transaction as received, which is what gets signed
+    cx_sha256_t tx_hash;
+    // DeployContract code is hashed as it arrives instead of being buffered:
+    // 'buffer' then ends right before the code
+    bool code_streaming;
+    uint32_t code_size;
+    uint32_t code_received;
+    cx_sha256_t code_hash;
+    // Upload with P1_COMPRESSED: the chunks after the path are decoded
+    // into the steps above
+    bool compressed;
+    lz_stream_t lz_stream;
+#endif
 } signingContext_t;
 
+// A transaction stored by INS_SIGN_TEMPLATE. INS_SIGN_DELTA only sends the
+// nonce, block hash and deposit (transfers only) and signs the template
+// with them, its review formatted from the patched template.
+typedef struct signTemplate_t {
+    uint32_t bip32[5];
+    uint8_t tx[MAX_TEMPLATE_SIZE];
+    uint32_t size;
+    uint32_t nonce_offset;
+    uint32_t block_hash_offset;
+    // 0 unless the template is a single Transfer
+    uint32_t deposit_offset;
+    int flow;
+} signTemplate_t;
+
 // A place to store data during the confirming the address
 typedef struct addressesContext_t {
     uint8_t public_key[32];
@@ -36,7 +122,12 @@ typedef union {
     addressesContext_t address_context;
 } tmpContext_t;
 
+#ifdef OS_IO_SEPROXYHAL
+extern uiArena_t ui_arena;
+#else
+// Host builds: the summary parse_transaction() writes
 extern uiContext_t ui_context;
+#endif
 
 extern tmpContext_t tmp_ctx; // Temporary area to store stuff
 
@@ -12,5 +12,7 @@ typedef unsigned char ed25519_public_key[32];
 typedef unsigned char ed25519_secret_key[32];
 
 void near_message_sign(const cx_ecfp_private_key_t *private_key, const unsigned char *message, const size_t message_size, ed25519_signature signature);
+// Sign a transaction by its SHA-256, when it was hashed as it arrived
+void near_hash_sign(const cx_ecfp_private_key_t *private_key, const uint8_t hash[32], ed25519_signature signature);
 
 #endif
@@ -0,0 +1,39 @@
+#include "get_capabilities.h"
+#include "os.h"
+#include "utils.h"
+#include "main.h"
+
+#define SIGN_MODES (SIGN_MODE_COMPRESSED | SIGN_MODE_SEQUENCED | SIGN_MODE_TEMPLATE | SIGN_MODE_CODE_STREAMING | SIGN_MODE_PARSE)
+
+// Appends tag, length and 'size' bytes of 'value', big endian
+static uint32_t add_capability(uint32_t offset, uint8_t tag, uint8_t size, uint32_t value) {
+    G_io_apdu_buffer[offset++] = tag;
+    G_io_apdu_buffer[offset++] = size;
+    while (size-- > 0) {
+        G_io_apdu_buffer[offset++] = value >> (8 * size);
+    }
+    return offset;
+}
+
+uint16_t handle_get_capabilities(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx) {
+    UNUSED(p1);
+    UNUSED(p2);
+    UNUSED(input_buffer);
+    UNUSED(input_length);
+    UNUSED(flags);
+
+    // Unlike INS_GET_APP_CONFIGURATION, this leaves any state alone
+    uint32_t offset = 0;
+    offset = add_capability(offset, CAPABILITY_VERSION, 3,
+                            LEDGER_MAJOR_VERSION << 16 | LEDGER_MINOR_VERSION << 8 | LEDGER_PATCH_VERSION);
+    offset = add_capability(offset, CAPABILITY_MAX_CHUNK_SIZE, 1, 255);
+    offset = add_capability(offset, CAPABILITY_MAX_DATA_SIZE, 2, MAX_DATA_SIZE);
+    offset = add_capability(offset, CAPABILITY_SIGN_MODES, 2, SIGN_MODES);
+    offset = add_capability(offset, CAPABILITY_LZ_WINDOW_SIZE, 2, LZ_WINDOW_SIZE);
+    offset = add_capability(offset, CAPABILITY_MAX_TEMPLATE_SIZE, 1, MAX_TEMPLATE_SIZE);
+    offset = add_capability(offset, CAPABILITY_TEMPLATE_SLOTS, 1, 1);
+    offset = add_capability(offset, CAPABILITY_REVIEW_TIMEOUT, 2, N_storage.review_timeout);
+    offset = add_capability(offset, CAPABILITY_TRUSTED_RECEIVERS, 1, TRUSTED_RECEIVER_SLOTS);
+    *tx = offset;
+    return SW_OK;
+}
@@ -0,0 +1,29 @@
+#include "os.h"
+#include "cx.h"
+#include "globals.h"
+
+#ifndef _GET_CAPABILITIES_H_
+#define _GET_CAPABILITIES_H_
+
+// Capability block tags, see doc/api.asc
+#define CAPABILITY_VERSION 0x01
+#define CAPABILITY_MAX_CHUNK_SIZE 0x02
+#define CAPABILITY_MAX_DATA_SIZE 0x03
+#define CAPABILITY_SIGN_MODES 0x04
+#define CAPABILITY_LZ_WINDOW_SIZE 0x05
+#define CAPABILITY_MAX_TEMPLATE_SIZE 0x06
+#define CAPABILITY_TEMPLATE_SLOTS 0x07
+#define CAPABILITY_REVIEW_TIMEOUT 0x08
+#define CAPABILITY_TRUSTED_RECEIVERS 0x09
+
+// CAPABILITY_SIGN_MODES bits
+#define SIGN_MODE_COMPRESSED 0x0001     // INS_SIGN with P1_COMPRESSED
+#define SIGN_MODE_SEQUENCED 0x0002      // INS_SIGN with P1_SEQUENCED, INS_SIGN_RESUME
+#define SIGN_MODE_TEMPLATE 0x0004       // INS_SIGN_TEMPLATE, INS_SIGN_DELTA
+#define SIGN_MODE_CODE_STREAMING 0x0008 // DeployContract code past MAX_DATA_SIZE
+#define SIGN_MODE_EXTENDED_APDU 0x0010  // Chunks over 255 bytes, not supported
+#define SIGN_MODE_PARSE 0x0020          // INS_PARSE_TRANSACTION
+
+uint16_t handle_get_capabilities(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx);
+
+#endif
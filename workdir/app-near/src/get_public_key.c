@@ -9,8 +9,6 @@
 #define ADDRESS_PREFIX "ed25519:"
 #define ADDRESS_PREFIX_SIZE strlen(ADDRESS_PREFIX)
 
-static char address[FULL_ADDRESS_LENGTH];
-
 static uint32_t set_result_get_public_key()
 {
     memcpy(G_io_apdu_buffer, tmp_ctx.address_context.public_key, 32);
@@ -26,7 +24,7 @@ UX_STEP_NOCB(
     bnnn_paging,
     {
         .title = "Public Key",
-        .text = address,
+        .text = ui_arena.address,
     });
 UX_STEP_VALID(
     ux_display_public_flow_6_step,
@@ -96,7 +94,7 @@ static void display_address_callback(bool confirm)
 static void display_addr(void) 
 {
     
-    nbgl_useCaseAddressConfirmation(address, &display_address_callback);
+    nbgl_useCaseAddressConfirmation(ui_arena.address, &display_address_callback);
 }
 
 static void display_public_key(void)
@@ -113,12 +111,9 @@ static void display_public_key(void)
 
 #endif
 
-void handle_get_public_key(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx)
+uint16_t handle_get_public_key(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx)
 {
     UNUSED(p2);
-    UNUSED(tx);
-
-    init_context();
 
     // Get the public key and return it.
     cx_ecfp_public_key_t public_key;
@@ -135,27 +130,31 @@ void handle_get_public_key(uint8_t p1, uint8_t p2, const uint8_t *input_buffer,
         THROW(INVALID_PARAMETER);
     }
 
-    memcpy(tmp_ctx.address_context.public_key, public_key.W, 32);
-
-    memset(address, 0, sizeof(address));
-    strcpy(address, ADDRESS_PREFIX);
-    if (base58_encode(tmp_ctx.address_context.public_key, sizeof(tmp_ctx.address_context.public_key),
-                      address + ADDRESS_PREFIX_SIZE, sizeof(address) - ADDRESS_PREFIX_SIZE - 1) < 0)
-    {
-        THROW(INVALID_PARAMETER);
-    }
-
     if (p1 == RETURN_ONLY)
     {
-        send_response(set_result_get_public_key(), true);
+        // Leaves the context and the UI alone: also answered during a review
+        memcpy(G_io_apdu_buffer, public_key.W, 32);
+        *tx = 32;
+        return SW_OK;
     }
-    else if (p1 == DISPLAY_AND_CONFIRM)
+    else if (p1 != DISPLAY_AND_CONFIRM)
     {
-        display_public_key();
-        *flags |= IO_ASYNCH_REPLY;
+        return SW_INCORRECT_P1_P2;
     }
-    else
+
+    init_context();
+    memcpy(tmp_ctx.address_context.public_key, public_key.W, 32);
+
+    memset(ui_arena.address, 0, sizeof(ui_arena.address));
+    strcpy(ui_arena.address, ADDRESS_PREFIX);
+    if (base58_encode(tmp_ctx.address_context.public_key, sizeof(tmp_ctx.address_context.public_key),
+                      ui_arena.address + ADDRESS_PREFIX_SIZE, sizeof(ui_arena.address) - ADDRESS_PREFIX_SIZE - 1) < 0)
     {
-        THROW(SW_INCORRECT_P1_P2);
+        THROW(INVALID_PARAMETER);
     }
+
+    start_pending_review(REVIEW_PUBLIC_KEY);
+    *flags |= IO_ASYNCH_REPLY;
+    display_public_key();
+    return SW_DEFERRED;
 }
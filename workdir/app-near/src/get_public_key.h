@@ -10,6 +10,6 @@ enum p1_values_e {
     RETURN_ONLY = 1,
 };
 
-void handle_get_public_key(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx);
+uint16_t handle_get_public_key(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx);
 
 #endif
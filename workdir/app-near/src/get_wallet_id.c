@@ -4,8 +4,6 @@
 #include "utils.h"
 #include "main.h"
 
-static char wallet_id[65];
-
 static uint32_t set_result_get_public_key() {
     memcpy(G_io_apdu_buffer, tmp_ctx.address_context.public_key, 32);
     return 32;
@@ -20,7 +18,7 @@ UX_STEP_NOCB(
     bnnn_paging,
     {
         .title = "Wallet Id",
-        .text = wallet_id,
+        .text = ui_arena.wallet_id,
     });
 UX_STEP_VALID(
     ux_display_wallet_flow_accept_step,
@@ -89,7 +87,7 @@ static void display_wallet_id_callback(bool confirm)
 // called when tapping on review start page to actually display wallet id
 static void display_wallet(void) 
 {
-    nbgl_useCaseAddressConfirmation(wallet_id, &display_wallet_id_callback);
+    nbgl_useCaseAddressConfirmation(ui_arena.wallet_id, &display_wallet_id_callback);
 }
 
 static void display_wallet_id(void)
@@ -107,7 +105,7 @@ static void display_wallet_id(void)
 
 #endif
 
-void handle_get_wallet_id(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx) {
+uint16_t handle_get_wallet_id(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx) {
     UNUSED(p1);
     UNUSED(p2);
     UNUSED(tx);
@@ -130,7 +128,9 @@ void handle_get_wallet_id(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, u
 
     memcpy(tmp_ctx.address_context.public_key, public_key.W, 32);
 
-    bin_to_hex(wallet_id, public_key.W, 32);
-    display_wallet_id();
+    bin_to_hex(ui_arena.wallet_id, public_key.W, 32);
+    start_pending_review(REVIEW_WALLET_ID);
     *flags |= IO_ASYNCH_REPLY;
+    display_wallet_id();
+    return SW_DEFERRED;
 }
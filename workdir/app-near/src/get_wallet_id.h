@@ -5,6 +5,6 @@
 #ifndef _GET_WALLET_ID_H_
 #define _GET_WALLET_ID_H_
 
-void handle_get_wallet_id(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx);
+uint16_t handle_get_wallet_id(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx);
 
 #endif
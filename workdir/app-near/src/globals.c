@@ -9,3 +9,4 @@ bolos_ux_params_t G_ux_params;
 unsigned int ux_step;
 unsigned int ux_step_count;
 const internalStorage_t N_storage_real;
+const trustedReceivers_t N_trusted_receivers_real;
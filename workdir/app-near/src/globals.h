@@ -8,7 +8,6 @@
 #define P1_CONFIRM 0x01
 #define P1_NON_CONFIRM 0x00
 
-#define FULL_ADDRESS_LENGTH 60
 #define BIP32_PATH 5
 
 // display stepped screens
@@ -19,8 +18,20 @@ typedef struct internalStorage_t {
     unsigned char dummy_setting_1;
     unsigned char dummy_setting_2;
     uint8_t initialized;
+    // Seconds a review waits for the user before it is rejected, 0 for ever
+    uint16_t review_timeout;
 } internalStorage_t;
 
 extern const internalStorage_t N_storage_real;
 #define N_storage (*(volatile internalStorage_t*) PIC(&N_storage_real))
+
+// Receivers whose transfers and function calls get a one page review, as
+// SHA-256 of their account id. A free slot is all zero, as installed.
+#define TRUSTED_RECEIVER_SLOTS 16
+typedef struct trustedReceivers_t {
+    uint8_t hashes[TRUSTED_RECEIVER_SLOTS][32];
+} trustedReceivers_t;
+
+extern const trustedReceivers_t N_trusted_receivers_real;
+#define N_trusted_receivers (*(volatile trustedReceivers_t*) PIC(&N_trusted_receivers_real))
 #endif
@@ -0,0 +1,159 @@
+#include "lz_stream.h"
+
+#include <string.h>
+
+#define LZ_WINDOW_MASK (LZ_WINDOW_SIZE - 1)
+#define LZ_MIN_MATCH 4
+// No transaction comes anywhere near this, it only keeps lengths from overflowing
+#define LZ_MAX_LENGTH (1UL << 24)
+
+#if (LZ_WINDOW_SIZE & LZ_WINDOW_MASK) != 0 || LZ_WINDOW_SIZE > 0x10000
+#error "LZ_WINDOW_SIZE must be a power of two of at most 64K"
+#endif
+
+enum {
+    LZ_TOKEN,
+    LZ_LITERAL_LENGTH,
+    LZ_LITERALS,
+    LZ_OFFSET_LOW,
+    LZ_OFFSET_HIGH,
+    LZ_MATCH_LENGTH,
+};
+
+void lz_stream_init(lz_stream_t *stream) {
+    stream->total = 0;
+    stream->flushed = 0;
+    stream->length = 0;
+    stream->offset = 0;
+    stream->token = 0;
+    stream->state = LZ_TOKEN;
+}
+
+// Passes what was decoded since the last flush to the sink. The window is
+// flushed every time it wraps, so this is always one contiguous piece.
+static int flush(lz_stream_t *stream, lz_sink_t sink) {
+    if (stream->total != stream->flushed) {
+        if (!sink(&stream->window[stream->flushed & LZ_WINDOW_MASK], stream->total - stream->flushed)) {
+            return -1;
+        }
+        stream->flushed = stream->total;
+    }
+    return 0;
+}
+
+static int add_literals(lz_stream_t *stream, const uint8_t *input, size_t length, lz_sink_t sink) {
+    while (length > 0) {
+        size_t position = stream->total & LZ_WINDOW_MASK;
+        size_t count = LZ_WINDOW_SIZE - position;
+        if (count > length) {
+            count = length;
+        }
+        memcpy(&stream->window[position], input, count);
+        stream->total += count;
+        input += count;
+        length -= count;
+        if ((stream->total & LZ_WINDOW_MASK) == 0 && flush(stream, sink) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Byte by byte, as matches may overlap what they produce
+static int add_match(lz_stream_t *stream, lz_sink_t sink) {
+    uint32_t length = stream->length + LZ_MIN_MATCH;
+
+    while (length-- > 0) {
+        stream->window[stream->total & LZ_WINDOW_MASK] =
+            stream->window[(stream->total - stream->offset) & LZ_WINDOW_MASK];
+        stream->total++;
+        if ((stream->total & LZ_WINDOW_MASK) == 0 && flush(stream, sink) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int add_length(lz_stream_t *stream, uint8_t byte) {
+    stream->length += byte;
+    return stream->length > LZ_MAX_LENGTH ? -1 : 0;
+}
+
+int lz_stream_decode(lz_stream_t *stream, const uint8_t *input, size_t length, lz_sink_t sink) {
+    const uint8_t *end = input + length;
+
+    while (input < end) {
+        switch (stream->state) {
+            case LZ_TOKEN:
+                stream->token = *input++;
+                stream->length = stream->token >> 4;
+                if (stream->length == 15) {
+                    stream->state = LZ_LITERAL_LENGTH;
+                } else {
+                    stream->state = stream->length > 0 ? LZ_LITERALS : LZ_OFFSET_LOW;
+                }
+                break;
+            case LZ_LITERAL_LENGTH:
+                if (add_length(stream, *input) != 0) {
+                    return -1;
+                }
+                if (*input++ != 255) {
+                    stream->state = LZ_LITERALS;
+                }
+                break;
+            case LZ_LITERALS: {
+                size_t count = end - input;
+                if (count > stream->length) {
+                    count = stream->length;
+                }
+                if (add_literals(stream, input, count, sink) != 0) {
+                    return -1;
+                }
+                input += count;
+                stream->length -= count;
+                if (stream->length == 0) {
+                    stream->state = LZ_OFFSET_LOW;
+                }
+                break;
+            }
+            case LZ_OFFSET_LOW:
+                stream->offset = *input++;
+                stream->state = LZ_OFFSET_HIGH;
+                break;
+            case LZ_OFFSET_HIGH:
+                stream->offset |= *input++ << 8;
+                if (stream->offset == 0 || stream->offset > LZ_WINDOW_SIZE || stream->offset > stream->total) {
+                    return -1;
+                }
+                stream->length = stream->token & 15;
+                if (stream->length == 15) {
+                    stream->state = LZ_MATCH_LENGTH;
+                } else {
+                    if (add_match(stream, sink) != 0) {
+                        return -1;
+                    }
+                    stream->state = LZ_TOKEN;
+                }
+                break;
+            case LZ_MATCH_LENGTH:
+                if (add_length(stream, *input) != 0) {
+                    return -1;
+                }
+                if (*input++ != 255) {
+                    if (add_match(stream, sink) != 0) {
+                        return -1;
+                    }
+                    stream->state = LZ_TOKEN;
+                }
+                break;
+            default:
+                return -1;
+        }
+    }
+    return flush(stream, sink);
+}
+
+int lz_stream_end(const lz_stream_t *stream) {
+    // Either between sequences or right after the literals of the last one
+    return stream->state == LZ_TOKEN || stream->state == LZ_OFFSET_LOW ? 0 : -1;
+}
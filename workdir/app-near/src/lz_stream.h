@@ -0,0 +1,48 @@
+#ifndef __LZ_STREAM_H__
+#define __LZ_STREAM_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "constants.h"
+
+// Streaming decoder for the LZ4 block format, for transactions uploaded
+// compressed. Input may be split anywhere; output is passed to a sink in
+// pieces as it is decoded, so only the last LZ_WINDOW_SIZE bytes are kept.
+//
+// A stream is a sequence of LZ4 sequences:
+//   token        high nibble: literal count, low nibble: match length - 4,
+//                15 in either means more length bytes follow
+//   [length]*    literal count continued, bytes added until one is not 255
+//   literals
+//   offset       u16 little endian, 1 .. LZ_WINDOW_SIZE back in the output
+//   [length]*    match length continued
+// The last sequence stops after its literals. Unlike plain LZ4, matches
+// may only reach LZ_WINDOW_SIZE bytes back.
+
+// Returns false to stop decoding
+typedef bool (*lz_sink_t)(const uint8_t *data, size_t length);
+
+typedef struct {
+    uint8_t window[LZ_WINDOW_SIZE];
+    // Bytes decoded so far and how many of them went to the sink
+    uint32_t total;
+    uint32_t flushed;
+    // Literal count or match length being read or copied
+    uint32_t length;
+    uint16_t offset;
+    uint8_t token;
+    uint8_t state;
+} lz_stream_t;
+
+void lz_stream_init(lz_stream_t *stream);
+
+// Decodes 'length' more bytes of input, passing the output to 'sink'.
+// Returns 0, or -1 if the input is malformed or the sink refused output.
+int lz_stream_decode(lz_stream_t *stream, const uint8_t *input, size_t length, lz_sink_t sink);
+
+// Returns 0 if the input so far is a complete stream, -1 otherwise
+int lz_stream_end(const lz_stream_t *stream);
+
+#endif
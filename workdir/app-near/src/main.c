@@ -23,7 +23,9 @@
 #include "ui.h"
 #include "get_public_key.h"
 #include "get_wallet_id.h"
+#include "get_capabilities.h"
 #include "sign_transaction.h"
+#include "trusted_receivers.h"
 #include "menu.h"
 #include "main.h"
 #include "near.h"
@@ -31,7 +33,8 @@
 
 // Temporary area to sore stuff and reuse the same memory
 tmpContext_t tmp_ctx;
-uiContext_t ui_context;
+// Display state of the flow on screen
+uiArena_t ui_arena;
 
 // SPI Buffer for io_event
 unsigned char G_io_seproxyhal_spi_buffer[IO_SEPROXYHAL_BUFFER_SIZE_B];
@@ -63,8 +66,10 @@ uint32_t set_result_sign() {
 
     BEGIN_TRY {
         TRY {
+            uint8_t hash[32];
             uint8_t signature[64];
-            near_message_sign(&private_key, (unsigned char *)tmp_ctx.signing_context.buffer, tmp_ctx.signing_context.buffer_used, signature);
+            cx_hash(&tmp_ctx.signing_context.tx_hash.header, CX_LAST, NULL, 0, hash, sizeof(hash));
+            near_hash_sign(&private_key, hash, signature);
 
             memcpy(G_io_apdu_buffer, signature, sizeof(signature));
         } FINALLY {
@@ -84,63 +89,143 @@ uint32_t set_result_sign() {
 #define OFFSET_LC 4
 #define OFFSET_CDATA 5
 
-// Called by both the U2F and the standard communications channel
-void handle_apdu(volatile unsigned int *flags, volatile unsigned int *tx, volatile unsigned int rx) {
-    unsigned short sw = 0;
+// Whether the command in G_io_apdu_buffer leaves the context and the UI
+// alone, so it can be answered while a review waits for the user
+static bool allowed_during_review(void) {
+    switch (G_io_apdu_buffer[OFFSET_INS]) {
+    case INS_GET_APP_CONFIGURATION:
+    case INS_GET_CAPABILITIES:
+    case INS_GET_PENDING_STATUS:
+        return true;
+    case INS_GET_PUBLIC_KEY:
+        return G_io_apdu_buffer[OFFSET_P1] == RETURN_ONLY;
+    default:
+        return false;
+    }
+}
 
-    BEGIN_TRY {
-        TRY {
-            if (G_io_apdu_buffer[OFFSET_CLA] != CLA) {
-                THROW(SW_CLA_NOT_SUPPORTED);
-            }
+// Runs the command in G_io_apdu_buffer. Returns the status word to reply
+// with, or SW_DEFERRED. Faults are still thrown.
+static uint16_t dispatch_apdu(volatile unsigned int *flags, volatile unsigned int *tx, volatile unsigned int rx) {
+    if (G_io_apdu_buffer[OFFSET_CLA] != CLA) {
+        return SW_CLA_NOT_SUPPORTED;
+    }
+    if (pending_review != REVIEW_NONE && !allowed_during_review()) {
+        // The review still replies once the user is done with it
+        return SW_REVIEW_PENDING;
+    }
 
-            PRINTF("command: %d\n", G_io_apdu_buffer[OFFSET_INS]);
-            switch (G_io_apdu_buffer[OFFSET_INS]) {
-            case INS_SIGN: {
-                if (G_io_apdu_buffer[OFFSET_LC] != rx - 5) {
-                    // the length of the APDU should match what's in the 5-byte header.
-                    // If not fail.  Don't want to buffer overrun or anything.
-                    THROW(SW_CONDITIONS_NOT_SATISFIED);
-                }
+    PRINTF("command: %d\n", G_io_apdu_buffer[OFFSET_INS]);
+    switch (G_io_apdu_buffer[OFFSET_INS]) {
+    case INS_SIGN:
+        if (G_io_apdu_buffer[OFFSET_LC] != rx - 5) {
+            // the length of the APDU should match what's in the 5-byte header.
+            // If not fail.  Don't want to buffer overrun or anything.
+            return SW_CONDITIONS_NOT_SATISFIED;
+        }
 
-                handle_sign_transaction(G_io_apdu_buffer[OFFSET_P1], G_io_apdu_buffer[OFFSET_P2], G_io_apdu_buffer + OFFSET_CDATA, G_io_apdu_buffer[OFFSET_LC], flags, tx);
-            } break;
+        return handle_sign_transaction(G_io_apdu_buffer[OFFSET_P1], G_io_apdu_buffer[OFFSET_P2], G_io_apdu_buffer + OFFSET_CDATA, G_io_apdu_buffer[OFFSET_LC], flags, tx);
 
-            case INS_GET_PUBLIC_KEY: {
-                if (G_io_apdu_buffer[OFFSET_LC] != rx - 5 || G_io_apdu_buffer[OFFSET_LC] != 20) {
-                    // the length of the APDU should match what's in the 5-byte header.
-                    // If not fail.  Don't want to buffer overrun or anything.
-                    THROW(SW_CONDITIONS_NOT_SATISFIED);
-                }
+    case INS_PARSE_TRANSACTION:
+        if (G_io_apdu_buffer[OFFSET_LC] != rx - 5) {
+            return SW_CONDITIONS_NOT_SATISFIED;
+        }
 
-                handle_get_public_key(G_io_apdu_buffer[OFFSET_P1], G_io_apdu_buffer[OFFSET_P2], G_io_apdu_buffer + OFFSET_CDATA, G_io_apdu_buffer[OFFSET_LC], flags, tx);
-            } break;
+        return handle_parse_transaction(G_io_apdu_buffer[OFFSET_P1], G_io_apdu_buffer[OFFSET_P2], G_io_apdu_buffer + OFFSET_CDATA, G_io_apdu_buffer[OFFSET_LC], flags, tx);
 
-            case INS_GET_WALLET_ID: {
-                if (G_io_apdu_buffer[OFFSET_LC] != rx - 5 || G_io_apdu_buffer[OFFSET_LC] != 20) {
-                    // the length of the APDU should match what's in the 5-byte header.
-                    // If not fail.  Don't want to buffer overrun or anything.
-                    THROW(SW_CONDITIONS_NOT_SATISFIED);
-                }
+    case INS_SIGN_RESUME:
+        return handle_sign_resume(G_io_apdu_buffer[OFFSET_P1], G_io_apdu_buffer[OFFSET_P2], G_io_apdu_buffer + OFFSET_CDATA, G_io_apdu_buffer[OFFSET_LC], flags, tx);
 
-                handle_get_wallet_id(G_io_apdu_buffer[OFFSET_P1], G_io_apdu_buffer[OFFSET_P2], G_io_apdu_buffer + OFFSET_CDATA, G_io_apdu_buffer[OFFSET_LC], flags, tx);
-            } break;
+    case INS_SIGN_TEMPLATE:
+        if (G_io_apdu_buffer[OFFSET_LC] != rx - 5) {
+            return SW_CONDITIONS_NOT_SATISFIED;
+        }
 
-            case INS_GET_APP_CONFIGURATION:
-                // NOTE: This allows using INS_GET_APP_CONFIGURATION as "reset state" command
-                init_context();
+        return handle_sign_template(G_io_apdu_buffer[OFFSET_P1], G_io_apdu_buffer[OFFSET_P2], G_io_apdu_buffer + OFFSET_CDATA, G_io_apdu_buffer[OFFSET_LC], flags, tx);
 
-                G_io_apdu_buffer[0] = LEDGER_MAJOR_VERSION;
-                G_io_apdu_buffer[1] = LEDGER_MINOR_VERSION;
-                G_io_apdu_buffer[2] = LEDGER_PATCH_VERSION;
-                *tx = 3;
-                THROW(SW_OK);
-                break;
+    case INS_SIGN_DELTA:
+        if (G_io_apdu_buffer[OFFSET_LC] != rx - 5) {
+            return SW_CONDITIONS_NOT_SATISFIED;
+        }
 
-            default:
-                THROW(0x6D00);
-                break;
-            }
+        return handle_sign_delta(G_io_apdu_buffer[OFFSET_P1], G_io_apdu_buffer[OFFSET_P2], G_io_apdu_buffer + OFFSET_CDATA, G_io_apdu_buffer[OFFSET_LC], flags, tx);
+
+    case INS_GET_PUBLIC_KEY:
+        if (G_io_apdu_buffer[OFFSET_LC] != rx - 5 || G_io_apdu_buffer[OFFSET_LC] != 20) {
+            // the length of the APDU should match what's in the 5-byte header.
+            // If not fail.  Don't want to buffer overrun or anything.
+            return SW_CONDITIONS_NOT_SATISFIED;
+        }
+
+        return handle_get_public_key(G_io_apdu_buffer[OFFSET_P1], G_io_apdu_buffer[OFFSET_P2], G_io_apdu_buffer + OFFSET_CDATA, G_io_apdu_buffer[OFFSET_LC], flags, tx);
+
+    case INS_GET_WALLET_ID:
+        if (G_io_apdu_buffer[OFFSET_LC] != rx - 5 || G_io_apdu_buffer[OFFSET_LC] != 20) {
+            // the length of the APDU should match what's in the 5-byte header.
+            // If not fail.  Don't want to buffer overrun or anything.
+            return SW_CONDITIONS_NOT_SATISFIED;
+        }
+
+        return handle_get_wallet_id(G_io_apdu_buffer[OFFSET_P1], G_io_apdu_buffer[OFFSET_P2], G_io_apdu_buffer + OFFSET_CDATA, G_io_apdu_buffer[OFFSET_LC], flags, tx);
+
+    case INS_GET_APP_CONFIGURATION:
+        // NOTE: This allows using INS_GET_APP_CONFIGURATION as "reset state" command.
+        // Kept for existing hosts, new ones use INS_GET_CAPABILITIES and INS_RESET.
+        // The context of a review waiting for the user is kept.
+        if (pending_review == REVIEW_NONE) {
+            init_context();
+        }
+
+        G_io_apdu_buffer[0] = LEDGER_MAJOR_VERSION;
+        G_io_apdu_buffer[1] = LEDGER_MINOR_VERSION;
+        G_io_apdu_buffer[2] = LEDGER_PATCH_VERSION;
+        *tx = 3;
+        return SW_OK;
+
+    case INS_GET_CAPABILITIES:
+        return handle_get_capabilities(G_io_apdu_buffer[OFFSET_P1], G_io_apdu_buffer[OFFSET_P2], G_io_apdu_buffer + OFFSET_CDATA, G_io_apdu_buffer[OFFSET_LC], flags, tx);
+
+    case INS_RESET:
+        init_context();
+        return SW_OK;
+
+    case INS_GET_PENDING_STATUS:
+        G_io_apdu_buffer[0] = pending_review;
+        *tx = 1;
+        return SW_OK;
+
+    case INS_SET_REVIEW_TIMEOUT: {
+        if (G_io_apdu_buffer[OFFSET_LC] != rx - 5 || G_io_apdu_buffer[OFFSET_LC] != 2) {
+            return SW_CONDITIONS_NOT_SATISFIED;
+        }
+
+        uint16_t seconds = G_io_apdu_buffer[OFFSET_CDATA] << 8 | G_io_apdu_buffer[OFFSET_CDATA + 1];
+        if (seconds != 0 && seconds < MIN_REVIEW_TIMEOUT) {
+            return SW_INVALID_DATA;
+        }
+        set_review_timeout(seconds);
+        return SW_OK;
+    }
+
+    case INS_TRUSTED_RECEIVER:
+        if (G_io_apdu_buffer[OFFSET_LC] != rx - 5) {
+            return SW_CONDITIONS_NOT_SATISFIED;
+        }
+
+        return handle_trusted_receiver(G_io_apdu_buffer[OFFSET_P1], G_io_apdu_buffer[OFFSET_P2], G_io_apdu_buffer + OFFSET_CDATA, G_io_apdu_buffer[OFFSET_LC], flags, tx);
+
+    default:
+        return SW_INS_NOT_SUPPORTED;
+    }
+}
+
+// Called by both the U2F and the standard communications channel
+void handle_apdu(volatile unsigned int *flags, volatile unsigned int *tx, volatile unsigned int rx) {
+    unsigned short sw = 0;
+
+    BEGIN_TRY {
+        TRY {
+            sw = dispatch_apdu(flags, tx, rx);
         }
         CATCH(EXCEPTION_IO_RESET) {
             THROW(EXCEPTION_IO_RESET);
@@ -159,15 +244,19 @@ void handle_apdu(volatile unsigned int *flags, volatile unsigned int *tx, volati
                 sw = 0x6800 | (e & 0x7FF);
                 break;
             }
-            // Unexpected exception => report
-            G_io_apdu_buffer[*tx] = sw >> 8;
-            G_io_apdu_buffer[*tx + 1] = sw;
-            *tx += 2;
         }
         FINALLY {
         }
     END_TRY;
     }
+
+    if (sw != SW_DEFERRED) {
+        // Replied now, not after a review
+        *flags &= ~IO_ASYNCH_REPLY;
+        G_io_apdu_buffer[*tx] = sw >> 8;
+        G_io_apdu_buffer[*tx + 1] = sw;
+        *tx += 2;
+    }
 }
 
 void init_context() {
@@ -283,6 +372,7 @@ unsigned char io_event(unsigned char channel) {
     #endif
 
         case SEPROXYHAL_TAG_TICKER_EVENT:
+            review_timeout_tick();
             UX_TICKER_EVENT(G_io_seproxyhal_spi_buffer, {});
             break;
     }
@@ -338,22 +428,22 @@ void app_exit(void) {
 }
 
 void nv_app_state_init(){
-    #if 0
     if (N_storage.initialized != 0x01) {
         internalStorage_t storage;
         storage.dummy_setting_1 = 0x00;
         storage.dummy_setting_2 = 0x00;
+        // Reviews wait for the user until INS_SET_REVIEW_TIMEOUT says otherwise
+        storage.review_timeout = 0;
         storage.initialized = 0x01;
         nvm_write((internalStorage_t*)&N_storage, (void*)&storage, sizeof(internalStorage_t));
     }
-    dummy_setting_1 = N_storage.dummy_setting_1;
-    dummy_setting_2 = N_storage.dummy_setting_2;
-    #endif
 }
 
 __attribute__((section(".boot"))) int main(void) {
+#ifndef NEAR_EMULATOR
     // exit critical section
     __asm volatile("cpsie i");
+#endif
 
     init_context();
     // ensure exception will work as planned
@@ -375,6 +465,8 @@ __attribute__((section(".boot"))) int main(void) {
                 USB_power(0);
                 USB_power(1);
 
+                // A review left on screen is dropped with the transport
+                pending_review = REVIEW_NONE;
                 ui_idle();
 
 #ifdef HAVE_BLE
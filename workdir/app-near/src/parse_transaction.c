@@ -12,7 +12,7 @@
  Adapted from https://en.wikipedia.org/wiki/Double_dabble#C_implementation
  Returns: length of resulting string or -1 for error
 */
-static int format_long_int_amount(size_t input_size, char *input, size_t output_size, char *output) {
+static int format_long_int_amount(size_t input_size, const char *input, size_t output_size, char *output) {
     // NOTE: Have to copy to have word-aligned array (otherwise crashing on read)
     // Lots of time has been lost debugging this, make sure to avoid unaligned RAM access (as compiler in BOLOS SDK won't)
     uint16_t aligned_amount[8];
@@ -79,7 +79,7 @@ static int format_long_int_amount(size_t input_size, char *input, size_t output_
     return nscratch;
 }
 
-static int format_long_decimal_amount(size_t input_size, char *input, size_t output_size, char *output, int nomination) {
+static int format_long_decimal_amount(size_t input_size, const char *input, size_t output_size, char *output, int nomination) {
     int len = format_long_int_amount(input_size, input, output_size, output);
 
     if (len < 0 || (size_t) len + 2 > output_size) {
@@ -120,57 +120,62 @@ static int format_long_decimal_amount(size_t input_size, char *input, size_t out
     return len;
 }
 
-static int check_overflow(unsigned int processed, unsigned int size) {
-    PRINTF("check_overflow %d %d %d\n", processed, size, tmp_ctx.signing_context.buffer_used);
-    if (size > tmp_ctx.signing_context.buffer_used || processed + size > tmp_ctx.signing_context.buffer_used) {
+// Position in the transaction being parsed
+typedef struct {
+    const uint8_t *buffer;
+    size_t size;
+    unsigned int processed;
+} parser_t;
+
+static int check_overflow(const parser_t *parser, unsigned int size) {
+    PRINTF("check_overflow %d %d %d\n", parser->processed, size, (unsigned int) parser->size);
+    if (size > parser->size || parser->processed + size > parser->size) {
         return SIGN_PARSING_ERROR;
     }
     return 0;
 }
 
-#define PRINT_REMAINING_BUFFER() \
-    PRINTF("remaining buffer: %.*h\n", tmp_ctx.signing_context.buffer_used - processed, &tmp_ctx.signing_context.buffer[processed]);
-
-static int borsh_read_uint8(unsigned int *processed, uint8_t *n) {
-    if (check_overflow(*processed, 1)) {
+static int borsh_read_uint8(parser_t *parser, uint8_t *n) {
+    if (check_overflow(parser, 1)) {
         return SIGN_PARSING_ERROR;
     }
-    *n = *((uint8_t *) &tmp_ctx.signing_context.buffer[*processed]);
-    *processed += 1;
+    *n = parser->buffer[parser->processed];
+    parser->processed += 1;
     return 0;
 }
 
-static int borsh_read_uint32(unsigned int *processed, uint32_t *n) {
-    if (check_overflow(*processed, 4)) {
+static int borsh_read_uint32(parser_t *parser, uint32_t *n) {
+    if (check_overflow(parser, 4)) {
         return SIGN_PARSING_ERROR;
     }
-    *n = *((uint32_t *) &tmp_ctx.signing_context.buffer[*processed]);
-    *processed += 4;
+    // The span may start anywhere: don't load a word from it directly
+    memcpy(n, &parser->buffer[parser->processed], 4);
+    parser->processed += 4;
     return 0;
 }
 
-static int borsh_read_buffer(uint32_t *buffer_len, uint8_t **buffer, unsigned int *processed) {
-    if (borsh_read_uint32(processed, buffer_len)) {
+static int borsh_read_buffer(parser_t *parser, uint32_t *buffer_len, const uint8_t **buffer) {
+    if (borsh_read_uint32(parser, buffer_len)) {
         return SIGN_PARSING_ERROR;
     }
-    if (check_overflow(*processed, *buffer_len)) {
+    if (check_overflow(parser, *buffer_len)) {
         return SIGN_PARSING_ERROR;
     }
-    *buffer = &tmp_ctx.signing_context.buffer[*processed];
-    *processed += *buffer_len;
+    *buffer = &parser->buffer[parser->processed];
+    parser->processed += *buffer_len;
     return 0;
 }
 
-static int borsh_read_fixed_buffer(unsigned int buffer_len, uint8_t **buffer, unsigned int *processed) {
-    if (check_overflow(*processed, buffer_len)) {
+static int borsh_read_fixed_buffer(parser_t *parser, unsigned int buffer_len, const uint8_t **buffer) {
+    if (check_overflow(parser, buffer_len)) {
         return SIGN_PARSING_ERROR;
     }
-    *buffer = &tmp_ctx.signing_context.buffer[*processed];
-    *processed += buffer_len;
+    *buffer = &parser->buffer[parser->processed];
+    parser->processed += buffer_len;
     return 0;
 }
 
-static void strcpy_ellipsis(size_t dst_size, char *dst, size_t src_size, char *src) {
+static void strcpy_ellipsis(size_t dst_size, char *dst, size_t src_size, const char *src) {
     if (dst_size >= src_size + 1) {
         memcpy(dst, src, src_size);
         dst[src_size] = 0;
@@ -187,30 +192,25 @@ static void strcpy_ellipsis(size_t dst_size, char *dst, size_t src_size, char *s
 }
 
 #define BORSH_SKIP(size) \
-    if (check_overflow(processed, size)) { \
-        return SIGN_PARSING_ERROR; \
-    } \
-    processed += size;
-
-#define BORSH_DISPLAY_STRING(var_name, ui_line) \
-    uint32_t var_name##_len; \
-    char *var_name; \
-    if (borsh_read_buffer(&var_name##_len, (uint8_t **) &var_name, &processed)) { \
+    if (check_overflow(&parser, size)) { \
         return SIGN_PARSING_ERROR; \
     } \
-    strcpy_ellipsis(sizeof(ui_line), ui_line, var_name##_len, var_name); \
-    PRINTF("%s: %s\n", #var_name, ui_line);
-
-#define BORSH_DISPLAY_AMOUNT(var_name, ui_line) \
-    if (check_overflow(processed, 16)) { \
-        return SIGN_PARSING_ERROR; \
-    } \
-    char *var_name = (char *) &tmp_ctx.signing_context.buffer[processed]; \
-    processed += 16; \
-    format_long_decimal_amount(16, var_name, sizeof(ui_line), ui_line, 24);
-
-#define COPY_LITERAL(dst, src) \
-    memcpy(dst, src, sizeof(src))
+    parser.processed += size;
+
+// "<size> bytes"
+static void format_byte_size(uint32_t size, char *output) {
+    char digits[10];
+    int len = 0;
+
+    do {
+        digits[len++] = '0' + size % 10;
+        size /= 10;
+    } while (size > 0);
+    while (len > 0) {
+        *output++ = digits[--len];
+    }
+    memcpy(output, " bytes", sizeof(" bytes"));
+}
 
 typedef enum {
     at_create_account,
@@ -224,179 +224,558 @@ typedef enum {
     at_last_value = at_delete_account
 } action_type_t;
 
-// Parse the transaction details for the user to approve
-int parse_transaction() {
-    memset(&ui_context, 0, sizeof(uiContext_t));
+int parse_deploy_contract_code(tx_span_t tx, uint32_t *code_offset, uint32_t *code_size) {
+    parser_t parser = {tx.data, tx.size, 0};
+    const uint8_t *string;
+    uint32_t string_len;
+    uint32_t actions_len;
+    uint8_t action_type;
 
-    // TODO: Validate data when parsing tx
+    // signer, public key, nonce, receiver, block hash
+    if (borsh_read_buffer(&parser, &string_len, &string)) {
+        return SIGN_PARSING_ERROR;
+    }
+    BORSH_SKIP(33 + 8);
+    if (borsh_read_buffer(&parser, &string_len, &string)) {
+        return SIGN_PARSING_ERROR;
+    }
+    BORSH_SKIP(32);
 
-    unsigned int processed = 0;
+    if (borsh_read_uint32(&parser, &actions_len) || actions_len != 1) {
+        return SIGN_PARSING_ERROR;
+    }
+    if (borsh_read_uint8(&parser, &action_type) || action_type != at_deploy_contract) {
+        return SIGN_PARSING_ERROR;
+    }
+    if (borsh_read_uint32(&parser, code_size)) {
+        return SIGN_PARSING_ERROR;
+    }
+    *code_offset = parser.processed;
+    return 0;
+}
 
-    // signer
-    BORSH_DISPLAY_STRING(signer_id, ui_context.line3);
+int parse_transaction_template(tx_span_t tx, uint32_t *nonce_offset, uint32_t *block_hash_offset, uint32_t *deposit_offset) {
+    parser_t parser = {tx.data, tx.size, 0};
+    const uint8_t *string;
+    uint32_t string_len;
+    uint32_t actions_len;
+    uint8_t action_type;
 
-    // public key
+    if (borsh_read_buffer(&parser, &string_len, &string)) {
+        return SIGN_PARSING_ERROR;
+    }
     BORSH_SKIP(33);
-
-    // nonce
+    *nonce_offset = parser.processed;
     BORSH_SKIP(8);
-
-    // receiver
-    BORSH_DISPLAY_STRING(receiver_id, ui_context.line2);
-
-    // block hash
+    if (borsh_read_buffer(&parser, &string_len, &string)) {
+        return SIGN_PARSING_ERROR;
+    }
+    *block_hash_offset = parser.processed;
     BORSH_SKIP(32);
 
-    // actions
-    uint32_t actions_len;
-    if (borsh_read_uint32(&processed, &actions_len)) {
+    if (borsh_read_uint32(&parser, &actions_len)) {
         return SIGN_PARSING_ERROR;
     }
-    PRINTF("actions_len: %d\n", actions_len);
+    *deposit_offset = 0;
+    if (actions_len == 1 && borsh_read_uint8(&parser, &action_type) == 0 && action_type == at_transfer) {
+        *deposit_offset = parser.processed;
+        BORSH_SKIP(16);
+    }
+    return 0;
+}
 
-    if (actions_len != 1) {
-        COPY_LITERAL(ui_context.line1, "multiple actions");
-        return SIGN_FLOW_GENERIC;
+void apply_template_delta(uint8_t *tx, uint32_t nonce_offset, uint32_t block_hash_offset, uint32_t deposit_offset, const uint8_t *delta) {
+    memcpy(&tx[nonce_offset], delta, 8);
+    memcpy(&tx[block_hash_offset], delta + 8, 32);
+    if (deposit_offset) {
+        memcpy(&tx[deposit_offset], delta + 8 + 32, 16);
     }
+}
 
-    // TODO: Parse more than one action
+int parse_transaction_receiver(tx_span_t tx, const uint8_t **receiver_id, uint32_t *receiver_id_len) {
+    parser_t parser = {tx.data, tx.size, 0};
+    const uint8_t *string;
+    uint32_t string_len;
 
-    // action type
-    uint8_t action_type;
-    if (borsh_read_uint8(&processed, &action_type)) {
+    // signer, public key, nonce
+    if (borsh_read_buffer(&parser, &string_len, &string)) {
         return SIGN_PARSING_ERROR;
     }
-    PRINTF("action_type: %d\n", action_type);
-
-    // TODO: assert action_type <= at_last_value
+    BORSH_SKIP(33 + 8);
+    return borsh_read_buffer(&parser, receiver_id_len, receiver_id);
+}
 
-    switch (action_type) {
-    case at_transfer: {
-        COPY_LITERAL(ui_context.line1, "transfer");
-        BORSH_DISPLAY_AMOUNT(amount, ui_context.amount);
+// Where the value of a field comes from
+typedef enum {
+    // Method name, the action in words, or "multiple actions"
+    FROM_ACTION,
+    FROM_RECEIVER,
+    FROM_SIGNER,
+    // Action amount, "Unlimited" for a key allowance without one
+    FROM_AMOUNT,
+    // Function call args, if they look like JSON
+    FROM_ARGS,
+    // Function call key contract or beneficiary
+    FROM_NAME,
+    FROM_CODE_SIZE,
+    // Left empty: the code is hashed as it arrives, it is not in 'tx'
+    FROM_STREAMED_CODE,
+    FROM_FULL_ACCESS_WARNING,
+} field_source_t;
+
+// Reviews of the table below besides the SIGN_FLOW_* of single actions:
+// the start of a transaction with several actions, then each of them by
+// what it shows
+#define REVIEW_MULTIPLE_ACTIONS 0x10
+#define REVIEW_OF_SEVERAL 0x20
+#define REVIEW_STAKE (SIGN_FLOW_DEPLOY_CONTRACT + 1)
+#define REVIEW_DELETE_ACCOUNT (SIGN_FLOW_DEPLOY_CONTRACT + 2)
+
+typedef struct {
+    // SIGN_FLOW_* or REVIEW_*
+    uint8_t review;
+    // TX_FIELD_*
+    uint8_t kind;
+    uint8_t source;
+    // What both BAGL and NBGL call it
+    const char *label;
+} field_row_t;
+
+// Every review, field by field in the order shown. Its own SIGN_FLOW_* is
+// the review of a single action.
+static const field_row_t review_rows[] = {
+    {SIGN_FLOW_GENERIC, TX_FIELD_ACTION, FROM_ACTION, "Confirm"},
+    {SIGN_FLOW_GENERIC, TX_FIELD_RECEIVER, FROM_RECEIVER, "To"},
+    {SIGN_FLOW_GENERIC, TX_FIELD_SIGNER, FROM_SIGNER, "From"},
+
+    {SIGN_FLOW_TRANSFER, TX_FIELD_ACTION, FROM_ACTION, "Confirm"},
+    {SIGN_FLOW_TRANSFER, TX_FIELD_AMOUNT, FROM_AMOUNT, "Amount (NEAR)"},
+    {SIGN_FLOW_TRANSFER, TX_FIELD_RECEIVER, FROM_RECEIVER, "To"},
+    {SIGN_FLOW_TRANSFER, TX_FIELD_SIGNER, FROM_SIGNER, "From"},
+
+    {SIGN_FLOW_FUNCTION_CALL, TX_FIELD_ACTION, FROM_ACTION, "Confirm"},
+    {SIGN_FLOW_FUNCTION_CALL, TX_FIELD_DEPOSIT, FROM_AMOUNT, "Deposit"},
+    {SIGN_FLOW_FUNCTION_CALL, TX_FIELD_RECEIVER, FROM_RECEIVER, "To"},
+    {SIGN_FLOW_FUNCTION_CALL, TX_FIELD_SIGNER, FROM_SIGNER, "From"},
+    {SIGN_FLOW_FUNCTION_CALL, TX_FIELD_ARGS, FROM_ARGS, "Args"},
+
+    {SIGN_FLOW_ADD_FUNCTION_CALL_KEY, TX_FIELD_ACTION, FROM_ACTION, "Confirm"},
+    {SIGN_FLOW_ADD_FUNCTION_CALL_KEY, TX_FIELD_TO_ACCOUNT, FROM_SIGNER, "To Account"},
+    {SIGN_FLOW_ADD_FUNCTION_CALL_KEY, TX_FIELD_CONTRACT, FROM_NAME, "Contract"},
+    {SIGN_FLOW_ADD_FUNCTION_CALL_KEY, TX_FIELD_ALLOWANCE, FROM_AMOUNT, "Allowance"},
+
+    // The contract of a full access key is the transaction receiver
+    {SIGN_FLOW_ADD_FULL_ACCESS_KEY, TX_FIELD_ACTION, FROM_ACTION, "Confirm"},
+    {SIGN_FLOW_ADD_FULL_ACCESS_KEY, TX_FIELD_DANGER, FROM_FULL_ACCESS_WARNING, "DANGER"},
+    {SIGN_FLOW_ADD_FULL_ACCESS_KEY, TX_FIELD_CONTRACT, FROM_RECEIVER, "Contract"},
+
+    {SIGN_FLOW_DEPLOY_CONTRACT, TX_FIELD_ACTION, FROM_ACTION, "Confirm"},
+    {SIGN_FLOW_DEPLOY_CONTRACT, TX_FIELD_CODE_SIZE, FROM_CODE_SIZE, "Code size"},
+    {SIGN_FLOW_DEPLOY_CONTRACT, TX_FIELD_CODE_HASH, FROM_STREAMED_CODE, "Code hash"},
+    {SIGN_FLOW_DEPLOY_CONTRACT, TX_FIELD_RECEIVER, FROM_RECEIVER, "To"},
+    {SIGN_FLOW_DEPLOY_CONTRACT, TX_FIELD_SIGNER, FROM_SIGNER, "From"},
+
+    {REVIEW_MULTIPLE_ACTIONS, TX_FIELD_ACTION, FROM_ACTION, "Confirm"},
+    {REVIEW_MULTIPLE_ACTIONS, TX_FIELD_RECEIVER, FROM_RECEIVER, "To"},
+    {REVIEW_MULTIPLE_ACTIONS, TX_FIELD_SIGNER, FROM_SIGNER, "From"},
+
+    {REVIEW_OF_SEVERAL | SIGN_FLOW_GENERIC, TX_FIELD_ACTION, FROM_ACTION, "Action"},
+
+    {REVIEW_OF_SEVERAL | SIGN_FLOW_TRANSFER, TX_FIELD_ACTION, FROM_ACTION, "Action"},
+    {REVIEW_OF_SEVERAL | SIGN_FLOW_TRANSFER, TX_FIELD_AMOUNT, FROM_AMOUNT, "Amount (NEAR)"},
+
+    {REVIEW_OF_SEVERAL | SIGN_FLOW_FUNCTION_CALL, TX_FIELD_ACTION, FROM_ACTION, "Action"},
+    {REVIEW_OF_SEVERAL | SIGN_FLOW_FUNCTION_CALL, TX_FIELD_DEPOSIT, FROM_AMOUNT, "Deposit"},
+    {REVIEW_OF_SEVERAL | SIGN_FLOW_FUNCTION_CALL, TX_FIELD_ARGS, FROM_ARGS, "Args"},
+
+    {REVIEW_OF_SEVERAL | SIGN_FLOW_ADD_FUNCTION_CALL_KEY, TX_FIELD_ACTION, FROM_ACTION, "Action"},
+    {REVIEW_OF_SEVERAL | SIGN_FLOW_ADD_FUNCTION_CALL_KEY, TX_FIELD_CONTRACT, FROM_NAME, "Contract"},
+    {REVIEW_OF_SEVERAL | SIGN_FLOW_ADD_FUNCTION_CALL_KEY, TX_FIELD_ALLOWANCE, FROM_AMOUNT, "Allowance"},
+
+    {REVIEW_OF_SEVERAL | SIGN_FLOW_ADD_FULL_ACCESS_KEY, TX_FIELD_ACTION, FROM_ACTION, "Action"},
+    {REVIEW_OF_SEVERAL | SIGN_FLOW_ADD_FULL_ACCESS_KEY, TX_FIELD_DANGER, FROM_FULL_ACCESS_WARNING, "DANGER"},
+
+    // Only a single DeployContract action has its code hashed
+    {REVIEW_OF_SEVERAL | SIGN_FLOW_DEPLOY_CONTRACT, TX_FIELD_ACTION, FROM_ACTION, "Action"},
+    {REVIEW_OF_SEVERAL | SIGN_FLOW_DEPLOY_CONTRACT, TX_FIELD_CODE_SIZE, FROM_CODE_SIZE, "Code size"},
+
+    {REVIEW_OF_SEVERAL | REVIEW_STAKE, TX_FIELD_ACTION, FROM_ACTION, "Action"},
+    {REVIEW_OF_SEVERAL | REVIEW_STAKE, TX_FIELD_STAKE, FROM_AMOUNT, "Stake (NEAR)"},
+
+    {REVIEW_OF_SEVERAL | REVIEW_DELETE_ACCOUNT, TX_FIELD_ACTION, FROM_ACTION, "Action"},
+    {REVIEW_OF_SEVERAL | REVIEW_DELETE_ACCOUNT, TX_FIELD_BENEFICIARY, FROM_NAME, "Beneficiary"},
+};
+
+// Display size of each TX_FIELD_*: that of the uiContext_t line
+// parse_transaction_span() shows it in
+#define UI_LINE_SIZE(line) sizeof(((uiContext_t *) 0)->line)
+
+static const uint8_t field_sizes[] = {
+    [TX_FIELD_ACTION] = UI_LINE_SIZE(line1),
+    [TX_FIELD_RECEIVER] = UI_LINE_SIZE(line2),
+    [TX_FIELD_SIGNER] = UI_LINE_SIZE(line3),
+    [TX_FIELD_AMOUNT] = UI_LINE_SIZE(amount),
+    [TX_FIELD_DEPOSIT] = UI_LINE_SIZE(line5),
+    [TX_FIELD_ARGS] = UI_LINE_SIZE(long_line),
+    [TX_FIELD_TO_ACCOUNT] = UI_LINE_SIZE(line3),
+    [TX_FIELD_CONTRACT] = UI_LINE_SIZE(line2),
+    [TX_FIELD_ALLOWANCE] = UI_LINE_SIZE(line5),
+    [TX_FIELD_CODE_SIZE] = UI_LINE_SIZE(line5),
+    [TX_FIELD_CODE_HASH] = UI_LINE_SIZE(long_line),
+    [TX_FIELD_STAKE] = UI_LINE_SIZE(amount),
+    [TX_FIELD_BENEFICIARY] = UI_LINE_SIZE(line2),
+    [TX_FIELD_DANGER] = UI_LINE_SIZE(long_line),
+};
+
+// An action, as far as its fields show it
+typedef struct {
+    uint8_t type;
+    // Function call method, function call key contract or beneficiary
+    const uint8_t *name;
+    uint32_t name_len;
+    const uint8_t *args;
+    uint32_t args_len;
+    // Transfer or stake amount, function call deposit or key allowance,
+    // NULL for an unlimited allowance
+    const uint8_t *amount;
+    uint32_t code_len;
+    bool full_access;
+} action_t;
+
+static int borsh_skip_public_key(parser_t *parser) {
+    uint8_t key_type;
+    const uint8_t *key;
+
+    // ED25519 or SECP256K1
+    if (borsh_read_uint8(parser, &key_type) || key_type > 1) {
+        return SIGN_PARSING_ERROR;
+    }
+    return borsh_read_fixed_buffer(parser, key_type == 0 ? 32 : 64, &key);
+}
 
-        return SIGN_FLOW_TRANSFER;
+// Reads an action up to its DeployContract code, which may not be buffered
+static int read_action(parser_t *parser, action_t *action) {
+    memset(action, 0, sizeof(*action));
+    if (borsh_read_uint8(parser, &action->type) || action->type > at_last_value) {
+        return SIGN_PARSING_ERROR;
     }
 
-    case at_function_call: {
-        // method name
-        BORSH_DISPLAY_STRING(method_name, ui_context.line1);
+    const uint8_t *skipped;
+    switch (action->type) {
+    case at_deploy_contract:
+        return borsh_read_uint32(parser, &action->code_len);
 
-        // args
-        uint32_t args_len;
-        char *args;
-        if (borsh_read_buffer(&args_len, (uint8_t **) &args, &processed)) {
+    case at_function_call:
+        if (borsh_read_buffer(parser, &action->name_len, &action->name) ||
+            borsh_read_buffer(parser, &action->args_len, &action->args)) {
             return SIGN_PARSING_ERROR;
         }
-        if (args_len > 0 && args[0] == '{') {
-            // Args look like JSON
-            strcpy_ellipsis(sizeof(ui_context.long_line), ui_context.long_line, args_len, args);
-            // TODO: Make sure destination buffer is big enough
-            PRINTF("args: %s\n", ui_context.long_line);
-        } else {
-            // TODO: Hexdump args otherwise
+        // gas, then deposit
+        if (borsh_read_fixed_buffer(parser, 8, &skipped)) {
+            return SIGN_PARSING_ERROR;
         }
+        return borsh_read_fixed_buffer(parser, 16, &action->amount);
 
-        // gas
-        BORSH_SKIP(8);
+    case at_transfer:
+        return borsh_read_fixed_buffer(parser, 16, &action->amount);
 
-        // deposit
-        BORSH_DISPLAY_AMOUNT(deposit, ui_context.line5);
-
-        return SIGN_FLOW_FUNCTION_CALL;
-    }
+    case at_stake:
+        if (borsh_read_fixed_buffer(parser, 16, &action->amount)) {
+            return SIGN_PARSING_ERROR;
+        }
+        return borsh_skip_public_key(parser);
 
     case at_add_key: {
-        COPY_LITERAL(ui_context.line1, "add key");
-        // TODO: Assert that sender/receiver are the same?
-
-        // public key
-
-        // key type
-        BORSH_SKIP(1);
-        // TODO: assert ed25519 key type
+        uint8_t permission_type;
+        uint8_t has_allowance;
+        uint32_t method_names_len;
 
-        // key data
-        uint8_t *key;
-        if (borsh_read_fixed_buffer(32, &key, &processed)) {
+        // public key, then access key nonce
+        if (borsh_skip_public_key(parser) || borsh_read_fixed_buffer(parser, 8, &skipped) ||
+            borsh_read_uint8(parser, &permission_type) || permission_type > 1) {
             return SIGN_PARSING_ERROR;
         }
-        // TODO: Display Base58 key?
-
-        // access key
-
-        // nonce
-        BORSH_SKIP(8);
-
-        // permission
-        uint8_t permission_type;
-        if (borsh_read_uint8(&processed, &permission_type)) {
+        if (permission_type == 1) {
+            action->full_access = true;
+            return 0;
+        }
+        if (borsh_read_uint8(parser, &has_allowance) ||
+            (has_allowance && borsh_read_fixed_buffer(parser, 16, &action->amount)) ||
+            borsh_read_buffer(parser, &action->name_len, &action->name) ||
+            borsh_read_uint32(parser, &method_names_len)) {
             return SIGN_PARSING_ERROR;
         }
-        PRINTF("permission_type: %d\n", permission_type);
-        if (permission_type == 0) {
-            // function call
-
-            // allowance
-            uint8_t has_allowance;
-            if (borsh_read_uint8(&processed, &has_allowance)) {
+        for (uint32_t i = 0; i < method_names_len; i++) {
+            uint32_t method_name_len;
+            if (borsh_read_buffer(parser, &method_name_len, &skipped)) {
                 return SIGN_PARSING_ERROR;
             }
-            if (has_allowance) {
-                BORSH_DISPLAY_AMOUNT(allowance, ui_context.line5);
-            } else {
-                COPY_LITERAL(ui_context.line5, "Unlimited");
-            }
+        }
+        return 0;
+    }
 
-            // receiver
-            BORSH_DISPLAY_STRING(permission_receiver_id, ui_context.line2);
+    case at_delete_key:
+        return borsh_skip_public_key(parser);
 
-            // TODO: read method names array
-            // TODO: Need to display one (multiple not supported yet – can just display "multiple methods")
-            return SIGN_FLOW_ADD_FUNCTION_CALL_KEY;
+    case at_delete_account:
+        return borsh_read_buffer(parser, &action->name_len, &action->name);
+
+    default:
+        // at_create_account
+        return 0;
+    }
+}
+
+// Which review of review_rows shows 'action'. That of a single action is
+// its SIGN_FLOW_*, as parse_transaction_flow() returns it.
+static uint8_t action_review(const action_t *action, bool several) {
+    switch (action->type) {
+    case at_transfer:
+        return SIGN_FLOW_TRANSFER;
+    case at_function_call:
+        return SIGN_FLOW_FUNCTION_CALL;
+    case at_add_key:
+        return action->full_access ? SIGN_FLOW_ADD_FULL_ACCESS_KEY : SIGN_FLOW_ADD_FUNCTION_CALL_KEY;
+    case at_deploy_contract:
+        return SIGN_FLOW_DEPLOY_CONTRACT;
+    case at_stake:
+        return several ? REVIEW_STAKE : SIGN_FLOW_GENERIC;
+    case at_delete_account:
+        return several ? REVIEW_DELETE_ACCOUNT : SIGN_FLOW_GENERIC;
+    default:
+        return SIGN_FLOW_GENERIC;
+    }
+}
+
+// The parts of a transaction its fields come from
+typedef struct {
+    const uint8_t *signer;
+    uint32_t signer_len;
+    const uint8_t *receiver;
+    uint32_t receiver_len;
+    // NULL for the start of a transaction with several actions
+    const action_t *action;
+} field_data_t;
+
+// Where parse_transaction_field() stands: the fields before 'next' are
+// passed, the one at 'index' is written out
+typedef struct {
+    unsigned int index;
+    unsigned int next;
+    tx_field_t *field;
+    char *value;
+    size_t value_size;
+    // The SIGN_FLOW_* of the transaction, once its actions are read
+    int flow;
+} field_cursor_t;
+
+static void format_field(const field_row_t *row, const field_data_t *data, char *value, size_t size) {
+    static const char *const action_names[] = {
+        [at_create_account] = "create account",
+        [at_deploy_contract] = "deploy contract",
+        [at_transfer] = "transfer",
+        [at_stake] = "stake",
+        [at_add_key] = "add key",
+        [at_delete_key] = "delete key",
+        [at_delete_account] = "delete account",
+    };
+    const action_t *action = data->action;
+    const char *text = NULL;
+
+    memset(value, 0, size);
+    switch (row->source) {
+    case FROM_ACTION:
+        if (action == NULL) {
+            text = "multiple actions";
+        } else if (action->type == at_function_call) {
+            strcpy_ellipsis(size, value, action->name_len, (const char *) action->name);
         } else {
-            // full access
-            COPY_LITERAL(ui_context.line5, "Full access");
-            return SIGN_FLOW_ADD_FULL_ACCESS_KEY;
+            text = action_names[action->type];
+        }
+        break;
+    case FROM_RECEIVER:
+        strcpy_ellipsis(size, value, data->receiver_len, (const char *) data->receiver);
+        break;
+    case FROM_SIGNER:
+        strcpy_ellipsis(size, value, data->signer_len, (const char *) data->signer);
+        break;
+    case FROM_AMOUNT:
+        if (action->amount == NULL) {
+            text = "Unlimited";
+        } else {
+            format_long_decimal_amount(16, (const char *) action->amount, size, value, 24);
+        }
+        break;
+    case FROM_ARGS:
+        if (action->args_len > 0 && action->args[0] == '{') {
+            strcpy_ellipsis(size, value, action->args_len, (const char *) action->args);
         }
+        break;
+    case FROM_NAME:
+        strcpy_ellipsis(size, value, action->name_len, (const char *) action->name);
+        break;
+    case FROM_CODE_SIZE:
+        // "4294967295 bytes" needs 17
+        if (size >= 17) {
+            format_byte_size(action->code_len, value);
+        }
+        break;
+    case FROM_FULL_ACCESS_WARNING:
+        text = "This gives full access to a device other than Ledger";
+        break;
+    default:
+        // FROM_STREAMED_CODE
+        break;
+    }
+    if (text != NULL) {
+        strcpy_ellipsis(size, value, strlen(text), text);
     }
+}
 
-    case at_create_account: {
-        COPY_LITERAL(ui_context.line1, "create account");
-        // Use generic UI
-        break;
+// Walks the fields of 'review', action 'number' (0 for the transaction as
+// a whole). Returns 0 once at the field asked for, 1 otherwise.
+static int take_review(field_cursor_t *cursor, uint8_t review, uint32_t number, const field_data_t *data) {
+    for (size_t i = 0; i < sizeof(review_rows) / sizeof(review_rows[0]); i++) {
+        const field_row_t *row = &review_rows[i];
+
+        if (row->review != review || cursor->next++ != cursor->index) {
+            continue;
+        }
+        size_t size = cursor->value_size < field_sizes[row->kind] ? cursor->value_size : field_sizes[row->kind];
+        cursor->field->kind = row->kind;
+        cursor->field->action = number;
+        cursor->field->label = row->label;
+        format_field(row, data, cursor->value, size);
+        return 0;
     }
+    return 1;
+}
 
-    case at_deploy_contract: {
-        COPY_LITERAL(ui_context.line1, "deploy contract");
-        // Use generic UI
-        break;
+// Walks the fields of 'tx' up to the one at 'cursor->index'. Returns 0 once
+// there, 1 if 'tx' has fewer fields or SIGN_PARSING_ERROR.
+static int take_fields(tx_span_t tx, field_cursor_t *cursor) {
+    parser_t parser = {tx.data, tx.size, 0};
+    field_data_t data = {0};
+    uint32_t actions_len;
+    action_t action;
+
+    if (borsh_read_buffer(&parser, &data.signer_len, &data.signer)) {
+        return SIGN_PARSING_ERROR;
+    }
+    BORSH_SKIP(33 + 8);
+    if (borsh_read_buffer(&parser, &data.receiver_len, &data.receiver)) {
+        return SIGN_PARSING_ERROR;
+    }
+    BORSH_SKIP(32);
+    if (borsh_read_uint32(&parser, &actions_len)) {
+        return SIGN_PARSING_ERROR;
     }
 
-    case at_stake: {
-        COPY_LITERAL(ui_context.line1, "stake");
-        // Use generic UI
-        break;
+    if (actions_len == 1) {
+        if (read_action(&parser, &action)) {
+            return SIGN_PARSING_ERROR;
+        }
+        data.action = &action;
+        cursor->flow = action_review(&action, false);
+        return take_review(cursor, cursor->flow, 0, &data);
     }
 
-    case at_delete_key: {
-        COPY_LITERAL(ui_context.line1, "delete key");
-        // Use generic UI
-        break;
+    cursor->flow = SIGN_FLOW_GENERIC;
+    if (take_review(cursor, REVIEW_MULTIPLE_ACTIONS, 0, &data) == 0) {
+        return 0;
     }
+    data.action = &action;
+    for (uint32_t i = 1; i <= actions_len; i++) {
+        if (read_action(&parser, &action)) {
+            return SIGN_PARSING_ERROR;
+        }
+        // Only a single DeployContract action has its code streamed
+        if (action.type == at_deploy_contract) {
+            BORSH_SKIP(action.code_len);
+        }
+        if (take_review(cursor, REVIEW_OF_SEVERAL | action_review(&action, true), i, &data) == 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
 
-    case at_delete_account: {
-        COPY_LITERAL(ui_context.line1, "delete account");
-        // Use generic UI
-        break;
+int parse_transaction_field(tx_span_t tx, unsigned int index, tx_field_t *field, char *value, size_t value_size) {
+    field_cursor_t cursor = {index, 0, field, value, value_size, SIGN_PARSING_ERROR};
+
+    return take_fields(tx, &cursor) == 0 ? 0 : SIGN_PARSING_ERROR;
+}
+
+// Walks all the fields of 'tx'. Returns 0 or SIGN_PARSING_ERROR.
+static int take_all_fields(tx_span_t tx, field_cursor_t *cursor) {
+    // Asks for a field past any transaction
+    return take_fields(tx, cursor) == 1 ? 0 : SIGN_PARSING_ERROR;
+}
+
+int parse_transaction_field_count(tx_span_t tx) {
+    tx_field_t field;
+    char value;
+    field_cursor_t cursor = {~0u, 0, &field, &value, 1, SIGN_PARSING_ERROR};
+
+    if (take_all_fields(tx, &cursor)) {
+        return SIGN_PARSING_ERROR;
     }
+    return cursor.next;
+}
 
-    default:
-        // TODO: Return more specific error?
+int parse_transaction_flow(tx_span_t tx) {
+    tx_field_t field;
+    char value;
+    field_cursor_t cursor = {~0u, 0, &field, &value, 1, SIGN_PARSING_ERROR};
+
+    if (take_all_fields(tx, &cursor)) {
         return SIGN_PARSING_ERROR;
-    } // switch
+    }
+    return cursor.flow;
+}
 
-    PRINT_REMAINING_BUFFER();
+#ifndef OS_IO_SEPROXYHAL
+// Where parse_transaction_span() puts each TX_FIELD_*, in a line of the
+// size given by field_sizes
+static const uint16_t summary_lines[] = {
+    [TX_FIELD_ACTION] = offsetof(uiContext_t, line1),
+    [TX_FIELD_RECEIVER] = offsetof(uiContext_t, line2),
+    [TX_FIELD_SIGNER] = offsetof(uiContext_t, line3),
+    [TX_FIELD_AMOUNT] = offsetof(uiContext_t, amount),
+    [TX_FIELD_DEPOSIT] = offsetof(uiContext_t, line5),
+    [TX_FIELD_ARGS] = offsetof(uiContext_t, long_line),
+    [TX_FIELD_TO_ACCOUNT] = offsetof(uiContext_t, line3),
+    [TX_FIELD_CONTRACT] = offsetof(uiContext_t, line2),
+    [TX_FIELD_ALLOWANCE] = offsetof(uiContext_t, line5),
+    [TX_FIELD_CODE_SIZE] = offsetof(uiContext_t, line5),
+    [TX_FIELD_CODE_HASH] = offsetof(uiContext_t, long_line),
+    [TX_FIELD_STAKE] = offsetof(uiContext_t, amount),
+    [TX_FIELD_BENEFICIARY] = offsetof(uiContext_t, line2),
+    [TX_FIELD_DANGER] = offsetof(uiContext_t, long_line),
+};
+
+int parse_transaction_span(tx_span_t tx, uiContext_t *summary) {
+    int flow = parse_transaction_flow(tx);
+    tx_field_t field;
+    char value[sizeof(summary->long_line)];
+
+    memset(summary, 0, sizeof(uiContext_t));
+    if (flow == SIGN_PARSING_ERROR) {
+        return SIGN_PARSING_ERROR;
+    }
+    // The details of each of several actions are left out
+    for (unsigned int i = 0; parse_transaction_field(tx, i, &field, value, sizeof(value)) == 0 && field.action == 0; i++) {
+        // Already cut to the size of its line
+        strcpy((char *) summary + summary_lines[field.kind], value);
+    }
+    return flow;
+}
 
-    return SIGN_FLOW_GENERIC;
-}
\ No newline at end of file
+#ifndef PARSE_TRANSACTION_NO_GLOBALS
+// Parse the transaction details for the user to approve
+int parse_transaction() {
+    tx_span_t tx = {tmp_ctx.signing_context.buffer, tmp_ctx.signing_context.buffer_used};
+    return parse_transaction_span(tx, &ui_context);
+}
+#endif
+#endif
@@ -1,7 +1,98 @@
-
 #ifndef __PARSE_TRANSACTION_H__
 #define __PARSE_TRANSACTION_H__
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "context.h"
+
+// A Borsh serialized transaction
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+} tx_span_t;
+
+// Whether 'tx' starts a transaction with a single DeployContract action and
+// holds everything up to its code. If so, sets 'code_offset' to where the
+// code starts and 'code_size' to its length and returns 0, otherwise
+// returns SIGN_PARSING_ERROR.
+int parse_deploy_contract_code(tx_span_t tx, uint32_t *code_offset, uint32_t *code_size);
+
+// Where the fields that change between otherwise identical transactions
+// are in 'tx': nonce, block hash and, if its only action is a Transfer,
+// deposit ('deposit_offset' is 0 otherwise). Returns 0 or
+// SIGN_PARSING_ERROR.
+int parse_transaction_template(tx_span_t tx, uint32_t *nonce_offset, uint32_t *block_hash_offset, uint32_t *deposit_offset);
+
+// Writes 'delta', as sent with INS_SIGN_DELTA, over the template 'tx' at
+// the offsets given by parse_transaction_template(): nonce (8 bytes),
+// block hash (32) and, if 'deposit_offset' is not 0, deposit (16). The
+// template then holds the transaction signed, which its review shows.
+void apply_template_delta(uint8_t *tx, uint32_t nonce_offset, uint32_t block_hash_offset, uint32_t deposit_offset, const uint8_t *delta);
+
+// The receiver account id of 'tx', as sent rather than as shown. Returns 0
+// or SIGN_PARSING_ERROR.
+int parse_transaction_receiver(tx_span_t tx, const uint8_t **receiver_id, uint32_t *receiver_id_len);
+
+// What a field of the review shows, see parse_transaction_field()
+typedef enum {
+    TX_FIELD_ACTION,
+    TX_FIELD_RECEIVER,
+    TX_FIELD_SIGNER,
+    TX_FIELD_AMOUNT,
+    TX_FIELD_DEPOSIT,
+    TX_FIELD_ARGS,
+    TX_FIELD_TO_ACCOUNT,
+    TX_FIELD_CONTRACT,
+    TX_FIELD_ALLOWANCE,
+    TX_FIELD_CODE_SIZE,
+    // Left empty: the code is hashed as it arrives, it is not in 'tx'
+    TX_FIELD_CODE_HASH,
+    TX_FIELD_STAKE,
+    TX_FIELD_BENEFICIARY,
+    // The warning about a full access key
+    TX_FIELD_DANGER,
+} tx_field_kind_t;
+
+typedef struct {
+    // TX_FIELD_*
+    uint8_t kind;
+    // The action described, from 1, when there are several; 0 for the
+    // transaction as a whole
+    uint32_t action;
+    // What the review calls it, on any device
+    const char *label;
+} tx_field_t;
+
+// The review of 'tx' one field at a time, so that it can be shown a page
+// at a time whatever the number of actions. Field 0 is the action, or
+// "multiple actions". With one action the fields are those of its
+// SIGN_FLOW_*; with several they are receiver and signer, then each action
+// and its details. All of them are listed in review_rows.
+// Formats field 'index' into 'value' and returns 0, or SIGN_PARSING_ERROR
+// if there is no such field. Values are cut to the size of their
+// parse_transaction_span() line, or to 'value_size' if smaller.
+int parse_transaction_field(tx_span_t tx, unsigned int index, tx_field_t *field, char *value, size_t value_size);
+
+// How many fields parse_transaction_field() has for 'tx', or
+// SIGN_PARSING_ERROR if any action cannot be shown
+int parse_transaction_field_count(tx_span_t tx);
+
+// The SIGN_FLOW_* whose review shows 'tx', SIGN_FLOW_GENERIC for several
+// actions, or SIGN_PARSING_ERROR if any action cannot be shown
+int parse_transaction_flow(tx_span_t tx);
+
+#ifndef OS_IO_SEPROXYHAL
+// For host tools: the fields of the transaction as a whole of 'tx', each
+// in the 'summary' line of its TX_FIELD_*, the details of several actions
+// left out. Only touches 'tx' and 'summary', so it can run concurrently.
+// Returns parse_transaction_flow().
+int parse_transaction_span(tx_span_t tx, uiContext_t *summary);
+
+#ifndef PARSE_TRANSACTION_NO_GLOBALS
+// parse_transaction_span() from tmp_ctx.signing_context into ui_context
 int parse_transaction();
+#endif
+#endif
 
-#endif
\ No newline at end of file
+#endif
@@ -4,30 +4,148 @@
 #include "ux.h"
 #include "utils.h"
 #include "main.h"
+#include "base58.h"
+#include "trusted_receivers.h"
+
+// One page summary of a transaction to a trusted receiver, in ui_arena
+#define trusted_summary (ui_arena.review.screen.trusted_summary)
+// In ui_arena, see display_code_hash()
+#define code_hash_text (ui_arena.review.code_hash)
+
+// Appends 'text' to the string in 'output', as far as it fits
+static void append_text(char *output, size_t output_size, const char *text)
+{
+    size_t length = strlen(output);
+
+    while (*text != 0 && length + 1 < output_size)
+    {
+        output[length++] = *text++;
+    }
+    output[length] = 0;
+}
+
+// The transaction under review, formatted one field at a time as it is
+// shown, see parse_transaction_field()
+static tx_span_t review_tx;
+static unsigned int review_fields;
+
+// Field 'index' of the review of 'tx' as every screen shows it: with the
+// code hash, which is not in 'tx', and with "Action 2" as the label of each
+// of several actions. That label is written to 'value' after the value
+// when there is room, the label stays "Action" otherwise.
+static int format_review_field(tx_span_t tx, unsigned int index, tx_field_t *field, char *value, size_t value_size)
+{
+    if (parse_transaction_field(tx, index, field, value, value_size) != 0)
+    {
+        return SIGN_PARSING_ERROR;
+    }
+    if (field->kind == TX_FIELD_CODE_HASH)
+    {
+        // Hashed as the code arrived, see display_code_hash()
+        value[0] = 0;
+        append_text(value, value_size, code_hash_text);
+    }
+    size_t used = strlen(value) + 1;
+    if (field->kind == TX_FIELD_ACTION && field->action != 0 && value_size - used >= sizeof("Action 4294967295"))
+    {
+        char *label = &value[used];
+        snprintf(label, value_size - used, "%s %u", field->label, (unsigned int) field->action);
+        field->label = label;
+    }
+    return 0;
+}
 
 //////////////////////////////////////////////////////////////////////
 
 #ifdef HAVE_BAGL
 
-#define INFO_STEP(name, info_title, info_text) \
-    UX_STEP_NOCB(                              \
-        name,                                  \
-        bnnn_paging,                           \
-        {                                      \
-            .title = info_title,               \
-            .text = info_text,                 \
-        })
-
-INFO_STEP(sign_flow_intro_step, "Confirm", ui_context.line1);
-INFO_STEP(sign_flow_receiver_step, "To", ui_context.line2);
-INFO_STEP(sign_flow_signer_step, "From", ui_context.line3);
-INFO_STEP(sign_flow_amount_step, "Amount (NEAR)", ui_context.amount);
-INFO_STEP(sign_flow_deposit_step, "Deposit", ui_context.line5);
-INFO_STEP(sign_flow_args_step, "Args", ui_context.long_line);
-INFO_STEP(sign_flow_to_account_step, "To Account", ui_context.line3);
-INFO_STEP(sign_flow_contract_step, "Contract", ui_context.line2);
-INFO_STEP(sign_flow_allowance_step, "Allowance", ui_context.line5);
-INFO_STEP(sign_flow_danger_step, "DANGER", "This gives full access to a device other than Ledger");
+// Fields are loaded as the review reaches them: one paging step shows
+// field after field between two delimiter steps, which load the previous
+// or next one as they are entered. The flow is the same for any number of
+// actions.
+// Field on screen, review_fields once past the last one
+static unsigned int review_field;
+// In ui_arena
+#define step_title (ui_arena.review.screen.step.title)
+#define step_text (ui_arena.review.screen.step.text)
+
+static void load_field(unsigned int index)
+{
+    tx_field_t field;
+
+    review_field = index;
+    step_title[0] = 0;
+    if (format_review_field(review_tx, index, &field, step_text, sizeof(step_text)) != 0)
+    {
+        // Checked by check_review()
+        step_text[0] = 0;
+        return;
+    }
+    append_text(step_title, sizeof(step_title), field.label);
+    PRINTF("%s: %s\n", step_title, step_text);
+}
+
+// Entered going back from the field step
+static void show_previous_field(void)
+{
+    if (review_field > 0)
+    {
+        load_field(review_field - 1);
+    }
+    ux_flow_next();
+}
+
+// Entered going on from the field step, or back from Approve
+static void show_next_field(void)
+{
+    if (review_field == review_fields)
+    {
+        load_field(review_fields - 1);
+        ux_flow_prev();
+    }
+    else if (review_field + 1 < review_fields)
+    {
+        load_field(review_field + 1);
+        ux_flow_prev();
+    }
+    else
+    {
+        review_field = review_fields;
+        ux_flow_next();
+    }
+}
+
+UX_STEP_INIT(
+    sign_flow_upper_delimiter_step,
+    NULL,
+    NULL,
+    {
+        show_previous_field();
+    });
+
+UX_STEP_NOCB(
+    sign_flow_field_step,
+    bnnn_paging,
+    {
+        .title = step_title,
+        .text = step_text,
+    });
+
+UX_STEP_INIT(
+    sign_flow_lower_delimiter_step,
+    NULL,
+    NULL,
+    {
+        show_next_field();
+    });
+
+UX_STEP_NOCB(
+    sign_flow_trusted_step,
+    bnnn_paging,
+    {
+        .title = "Trusted receiver",
+        .text = trusted_summary,
+    });
 
 UX_STEP_VALID(
     sign_flow_approve_step,
@@ -49,82 +167,33 @@ UX_STEP_VALID(
 
 UX_FLOW(
     ux_display_sign_flow,
-    &sign_flow_intro_step,
-    &sign_flow_receiver_step,
-    &sign_flow_signer_step,
+    &sign_flow_upper_delimiter_step,
+    &sign_flow_field_step,
+    &sign_flow_lower_delimiter_step,
     &sign_flow_approve_step,
     &sign_flow_reject_step);
 
 UX_FLOW(
-    ux_display_sign_transfer_flow,
-    &sign_flow_intro_step,
-    &sign_flow_amount_step,
-    &sign_flow_receiver_step,
-    &sign_flow_signer_step,
+    ux_display_sign_trusted_flow,
+    &sign_flow_trusted_step,
     &sign_flow_approve_step,
     &sign_flow_reject_step);
 
-UX_FLOW(
-    ux_display_sign_function_call_flow,
-    &sign_flow_intro_step,
-    &sign_flow_deposit_step,
-    &sign_flow_receiver_step,
-    &sign_flow_signer_step,
-    &sign_flow_args_step,
-    &sign_flow_approve_step,
-    &sign_flow_reject_step);
-
-UX_FLOW(
-    ux_display_sign_add_function_call_key_flow,
-    &sign_flow_intro_step,
-    &sign_flow_to_account_step,
-    &sign_flow_contract_step,
-    &sign_flow_allowance_step,
-    &sign_flow_approve_step,
-    &sign_flow_reject_step);
-
-UX_FLOW(
-    ux_display_sign_add_full_access_key_flow,
-    &sign_flow_intro_step,
-    &sign_flow_danger_step,
-    &sign_flow_contract_step,
-    &sign_flow_approve_step,
-    &sign_flow_reject_step);
-
-void print_ui_context()
+// Reviews 'tx', whichever its flow: its steps are loaded from it as they
+// are entered, so it must stay in place until the reply
+void sign_review_ux_flow_init(tx_span_t tx, unsigned int fields)
 {
-    for (int i = 0; i < 6; i++)
-    {
-        PRINTF("line %d: %s\n", i, &ui_context.line1[sizeof(ui_context.line1) * i]);
-    }
+    PRINTF("sign_review_ux_flow_init: %d fields\n", fields);
+    review_tx = tx;
+    review_fields = fields;
+    load_field(0);
+    ux_flow_init(0, ux_display_sign_flow, &sign_flow_field_step);
 }
 
-void sign_ux_flow_init()
+void sign_trusted_ux_flow_init()
 {
-    PRINTF("sign_ux_flow_init\n");
-    print_ui_context();
-    ux_flow_init(0, ux_display_sign_flow, NULL);
-}
-
-void sign_transfer_ux_flow_init()
-{
-    PRINTF("sign_transfer_ux_flow_init\n");
-    print_ui_context();
-    ux_flow_init(0, ux_display_sign_transfer_flow, NULL);
-}
-
-void sign_function_call_ux_flow_init()
-{
-    PRINTF("sign_function_call_ux_flow_init\n");
-    print_ui_context();
-    ux_flow_init(0, ux_display_sign_function_call_flow, NULL);
-}
-
-void sign_add_function_call_key_ux_flow_init()
-{
-    PRINTF("sign_add_function_call_key_ux_flow_init\n");
-    print_ui_context();
-    ux_flow_init(0, ux_display_sign_add_function_call_key_flow, NULL);
+    PRINTF("sign_trusted_ux_flow_init: %s\n", trusted_summary);
+    ux_flow_init(0, ux_display_sign_trusted_flow, NULL);
 }
 
 #endif
@@ -138,16 +207,14 @@ void sign_add_function_call_key_ux_flow_init()
 #include "nbgl_use_case.h"
 #include "menu.h"
 
-#define MAX_TAG_VALUE_PAIRS_DISPLAYED (5)
-static nbgl_layoutTagValueList_t list  = {0};
+// Pairs of a review page, formatted from the transaction when the page is
+// shown: nothing is rendered ahead, so any number of actions fits
+#define MAX_TAG_VALUE_PAIRS_DISPLAYED (4)
 static nbgl_layoutTagValue_t pairs[MAX_TAG_VALUE_PAIRS_DISPLAYED];
-static nbgl_pageInfoLongPress_t long_press_infos;
-
-static void approve_callback(void)
-{
-    send_response(set_result_sign(), true);
-    ui_idle();
-}
+// In ui_arena
+#define page_text (ui_arena.review.screen.page_text)
+// Pages of pairs, without the intro and sign pages
+static uint8_t review_pages;
 
 static void reject_callback(void)
 {
@@ -164,7 +231,10 @@ static void choice_callback(bool confirm)
 {
     if (confirm)
     {
-        nbgl_useCaseStatus("TRANSACTION\nSIGNED", true, approve_callback);
+        // Replied before the status screen, so a review timeout can no
+        // longer fire once the user has signed
+        send_response(set_result_sign(), true);
+        nbgl_useCaseStatus("TRANSACTION\nSIGNED", true, ui_idle);
     }
     else
     {
@@ -172,246 +242,617 @@ static void choice_callback(bool confirm)
     }
 }
 
+// Writes 'prefix', the action and 'suffix' to page_text
+static void format_action_text(const char *prefix, const char *suffix)
+{
+    tx_field_t field;
+    size_t length = strlen(prefix);
 
-// Available field to be displayed
-
-#define INTRO_ITEM "Review transaction to\n"
-#define INTRO_VALUE ui_context.line1
-#define RECEIVER_ITEM "To"
-#define RECEIVER_VALUE ui_context.line2
-#define SIGNER_ITEM "From"
-#define SIGNER_VALUE ui_context.line3
-#define AMOUNT_ITEM "Amount (NEAR)"
-#define AMOUNT_VALUE ui_context.amount
-#define DEPOSIT_ITEM "Deposit"
-#define DEPOSIT_VALUE ui_context.line5
-#define ARGS_ITEM "Args"
-#define ARGS_VALUE ui_context.long_line
-#define TO_ACCOUNT_ITEM "To account"
-#define TO_ACCOUNT_VALUE ui_context.line3
-#define CONTRACT_ITEM "Contract"
-#define CONTRACT_VALUE ui_context.line2
-#define ALLOWANCE_ITEM "Allowance"
-#define ALLOWANCE_VALUE ui_context.line5
-#define SIGN_ITEM "Sign transaction to\n"
-#define SIGN_VALUE INTRO_VALUE
-#define MAX_DISPLAYED_STRING_LENGTH 100
-
-static char review_displayed_string[MAX_DISPLAYED_STRING_LENGTH] = {0};
-static char sign_displayed_string[MAX_DISPLAYED_STRING_LENGTH] = {0};
-
-// Utility macros
+    memcpy(page_text, prefix, length + 1);
+    if (format_review_field(review_tx, 0, &field, &page_text[length], sizeof(page_text) - length) != 0)
+    {
+        page_text[length] = 0;
+    }
+    append_text(page_text, sizeof(page_text), suffix);
+}
 
-static uint8_t field_cnt = 0;
+// Formats the pairs of the page starting at field 'first' into pairs and
+// page_text, as many as fit. Returns how many.
+static uint8_t format_page(unsigned int first)
+{
+    size_t used = 0;
+    uint8_t count = 0;
 
-#define START_ADD_FIELD() \
-    field_cnt = 0;
+    while (count < MAX_TAG_VALUE_PAIRS_DISPLAYED && first + count < review_fields)
+    {
+        tx_field_t field;
+        char *value = &page_text[used];
+        size_t room = sizeof(page_text) - used;
 
-#define END_ADD_FIELD() \
-    list.nbPairs = field_cnt;
+        // Amounts need their whole size to be formatted at all
+        if (count > 0 && room < AMOUNT_DISPLAY_SIZE + 12)
+        {
+            break;
+        }
+        if (format_review_field(review_tx, first + count, &field, value, room) != 0)
+        {
+            break;
+        }
+        size_t length = strlen(value) + 1;
+        if (count > 0 && length == room)
+        {
+            // Possibly cut to the room left: show it on the next page
+            break;
+        }
+        used += length;
 
-#define ADD_FIELD(field)                  \
-    pairs[field_cnt].item = field##_ITEM; \
-    pairs[field_cnt++].value = field##_VALUE;
+        if (field.label == &page_text[used])
+        {
+            // "Action 2", after the value
+            used += strlen(field.label) + 1;
+        }
+        pairs[count].item = field.label;
+        pairs[count].value = value;
+        count++;
+    }
+    return count;
+}
 
-#define START_REVIEW() \
-    nbgl_useCaseStaticReview(&list, &long_press_infos, "Reject transaction", choice_callback);
+// Field shown first on 'page', formatting the pages before it
+static unsigned int page_first_field(uint8_t page)
+{
+    // Field 0 is the action, shown on the intro page
+    unsigned int first = 1;
 
-// Generics
+    while (page-- > 0)
+    {
+        first += format_page(first);
+    }
+    return first;
+}
 
-static void generic_init_list(void)
+static bool display_review_page(uint8_t page, nbgl_pageContent_t *content)
 {
-    list.nbMaxLinesForValue = 0;
-    list.pairs = pairs;
+    if (page < review_pages)
+    {
+        content->type = TAG_VALUE_LIST;
+        content->tagValueList.nbPairs = format_page(page_first_field(page));
+        content->tagValueList.pairs = pairs;
+        content->tagValueList.smallCaseForValue = false;
+        content->tagValueList.nbMaxLinesForValue = 0;
+    }
+    else if (page == review_pages)
+    {
+        format_action_text("Sign transaction to\n", "?");
+        content->type = INFO_LONG_PRESS;
+        content->infoLongPress.icon = &C_stax_app_near_64px;
+        content->infoLongPress.text = page_text;
+        content->infoLongPress.longPressText = "Hold to sign";
+    }
+    else
+    {
+        return false;
+    }
+    return true;
 }
 
-static void generic_init_hold_to_approve(void)
-{  
-    long_press_infos.icon = &C_stax_app_near_64px;
-    long_press_infos.longPressText = "Hold to sign";
-    memcpy(sign_displayed_string, SIGN_ITEM, sizeof(SIGN_ITEM));
-    strlcat(sign_displayed_string, SIGN_VALUE, MAX_DISPLAYED_STRING_LENGTH);
-    strlcat(sign_displayed_string, "?", MAX_DISPLAYED_STRING_LENGTH);
-    long_press_infos.text = sign_displayed_string;
+static void display_review(void)
+{
+    nbgl_useCaseRegularReview(0, review_pages + 1, "Reject transaction", NULL, display_review_page, choice_callback);
 }
 
-static void generic_intro_flow(nbgl_callback_t continue_callback)
+// Reviews 'tx', whichever its flow: its pages are formatted from it as they
+// are shown, so it must stay in place until the reply
+void sign_review_ux_flow_init(tx_span_t tx, unsigned int fields)
 {
-    memcpy(review_displayed_string, INTRO_ITEM, sizeof(INTRO_ITEM));
-    strlcat(review_displayed_string, INTRO_VALUE, MAX_DISPLAYED_STRING_LENGTH);
-
-    generic_init_list();
-    generic_init_hold_to_approve();
+    review_tx = tx;
+    review_fields = fields;
+    review_pages = 0;
+    for (unsigned int first = 1; first < review_fields && review_pages < UINT8_MAX - 1; review_pages++)
+    {
+        uint8_t count = format_page(first);
+        if (count == 0)
+        {
+            break;
+        }
+        first += count;
+    }
 
+    format_action_text("Review transaction to\n", "");
     nbgl_useCaseReviewStart(
         &C_stax_app_near_64px,
-        review_displayed_string,
+        page_text,
         NULL,
         "Reject transaction",
-        continue_callback,
+        display_review,
         reject_confirmation);
 }
 
-// Sign
-static void display_sign_flow(void)
+// ------------------ Trusted receiver -------------------
+void sign_trusted_ux_flow_init()
 {
-    // Fill fields
-    START_ADD_FIELD()
-    ADD_FIELD(RECEIVER)
-    ADD_FIELD(SIGNER)
-    END_ADD_FIELD()
-
-    // Start review
-    START_REVIEW()
+    nbgl_useCaseChoice(&C_stax_app_near_64px, trusted_summary, "Trusted receiver", "Sign transaction", "Reject", choice_callback);
 }
 
-void sign_ux_flow_init(void)
+#endif
+
+static bool add_code_data(const uint8_t *input_data, size_t input_length)
 {
-    generic_intro_flow(display_sign_flow);
+    signingContext_t *ctx = &tmp_ctx.signing_context;
+
+    if (input_length > ctx->code_size - ctx->code_received)
+    {
+        // Nothing may follow the code of a single DeployContract action
+        return false;
+    }
+    cx_hash(&ctx->code_hash.header, 0, input_data, input_length, NULL, 0);
+    ctx->code_received += input_length;
+    return true;
 }
 
-// ------------------ Transfer -------------------
+// Contract code is far larger than the buffer: as soon as everything before
+// it has been buffered, hash the code instead of keeping it
+static bool start_code_streaming(void)
+{
+    signingContext_t *ctx = &tmp_ctx.signing_context;
+    tx_span_t buffered = {ctx->buffer, ctx->buffer_used};
+    uint32_t code_offset;
+
+    if (parse_deploy_contract_code(buffered, &code_offset, &ctx->code_size))
+    {
+        return true;
+    }
+    PRINTF("code streaming: %d bytes at %d\n", ctx->code_size, code_offset);
+    ctx->code_streaming = true;
+    ctx->code_received = 0;
+    cx_sha256_init(&ctx->code_hash);
+    ctx->buffer_used = code_offset;
+    return add_code_data(&ctx->buffer[code_offset], buffered.size - code_offset);
+}
 
-static void display_transfer_flow(void)
+// Transaction bytes as signed, i.e. after the path and decompression.
+// Returns false if they do not fit.
+static bool add_transaction_data(const uint8_t *input_data, size_t input_length)
 {
-    // Fill pairs
-    START_ADD_FIELD()
-    ADD_FIELD(AMOUNT)
-    ADD_FIELD(RECEIVER)
-    ADD_FIELD(SIGNER)
-    END_ADD_FIELD()
+    signingContext_t *ctx = &tmp_ctx.signing_context;
+
+    cx_hash(&ctx->tx_hash.header, 0, input_data, input_length, NULL, 0);
+
+    if (!ctx->code_streaming)
+    {
+        size_t buffered = MAX_DATA_SIZE - ctx->buffer_used;
+        if (buffered > input_length)
+        {
+            buffered = input_length;
+        }
+        memcpy(&ctx->buffer[ctx->buffer_used], input_data, buffered);
+        PRINTF("buffer: %.*h\n", buffered, &ctx->buffer[ctx->buffer_used]);
+        ctx->buffer_used += buffered;
+        input_data += buffered;
+        input_length -= buffered;
 
-    // Start review
-    START_REVIEW()
+        if (!start_code_streaming() || (!ctx->code_streaming && input_length > 0))
+        {
+            return false;
+        }
+    }
+    return !ctx->code_streaming || add_code_data(input_data, input_length);
 }
 
-void sign_transfer_ux_flow_init(void)
+static uint16_t add_chunk_data(uint8_t p1, uint8_t p2, const uint8_t *input_data, size_t input_length, bool dry_run)
 {
-    generic_intro_flow(display_transfer_flow);
+    signingContext_t *ctx = &tmp_ctx.signing_context;
+    bool compressed = (p1 & P1_COMPRESSED) != 0;
+    bool sequenced = (p1 & P1_SEQUENCED) != 0;
+    bool first = !ctx->upload_started;
+
+    PRINTF("Buffer used: %d\n", ctx->buffer_used);
+    if (sequenced && p2 != (first ? 0 : ctx->next_sequence))
+    {
+        // Nothing is lost, INS_SIGN_RESUME tells which chunk comes next
+        return SW_WRONG_SEQUENCE;
+    }
+    if (!first && (compressed != ctx->compressed || sequenced != ctx->sequenced))
+    {
+        // All chunks of a transaction use the same encoding
+        return SW_INCORRECT_P1_P2;
+    }
+    if (!first && dry_run != ctx->dry_run)
+    {
+        // A transaction uploaded to be parsed cannot be signed, nor the reverse
+        return SW_CONDITIONS_NOT_SATISFIED;
+    }
+
+    // Until this chunk is in, the upload cannot be resumed
+    ctx->upload_started = false;
+    if (first)
+    {
+        // then there is the bip32 path in the first chunk - first 20 bytes of data
+        size_t path_size = sizeof(ctx->bip32);
+        if (input_length < path_size)
+        {
+            // TODO: Have specific error for underflow?
+            return SW_BUFFER_OVERFLOW;
+        }
+        memset(ctx, 0, sizeof(*ctx));
+        read_path_from_bytes(input_data, ctx->bip32);
+
+        input_data += path_size;
+        input_length -= path_size;
+        cx_sha256_init(&ctx->tx_hash);
+        ctx->compressed = compressed;
+        ctx->sequenced = sequenced;
+        ctx->dry_run = dry_run;
+        lz_stream_init(&ctx->lz_stream);
+    }
+
+    if (!ctx->compressed)
+    {
+        if (!add_transaction_data(input_data, input_length))
+        {
+            return SW_BUFFER_OVERFLOW;
+        }
+    }
+    else if (lz_stream_decode(&ctx->lz_stream, input_data, input_length, add_transaction_data) != 0)
+    {
+        return SW_BUFFER_OVERFLOW;
+    }
+    ctx->bytes_received += input_length;
+    ctx->next_sequence++;
+    ctx->upload_started = true;
+    return SW_OK;
 }
 
-// ------------------ Function call -------------------
+static signTemplate_t sign_template;
 
-static void display_function_call_flow(void)
+// After the last chunk: the next INS_SIGN starts another transaction
+static uint16_t end_upload(void)
 {
-    // Fill fields
-    START_ADD_FIELD()
-    ADD_FIELD(DEPOSIT)
-    ADD_FIELD(RECEIVER)
-    ADD_FIELD(SIGNER)
-    ADD_FIELD(ARGS)
-    END_ADD_FIELD()
+    signingContext_t *ctx = &tmp_ctx.signing_context;
 
-    // Start review
-    START_REVIEW()
+    ctx->upload_started = false;
+    if (ctx->compressed && lz_stream_end(&ctx->lz_stream) != 0)
+    {
+        return SW_BUFFER_OVERFLOW;
+    }
+    return SW_OK;
 }
 
-void sign_function_call_ux_flow_init()
+// Code hash, in base58 like NEAR tooling shows it
+static uint16_t display_code_hash(void)
 {
-    generic_intro_flow(display_function_call_flow);
+    signingContext_t *ctx = &tmp_ctx.signing_context;
+    uint8_t hash[32];
+
+    if (!ctx->code_streaming || ctx->code_received != ctx->code_size)
+    {
+        return SW_BUFFER_OVERFLOW;
+    }
+    cx_hash(&ctx->code_hash.header, CX_LAST, NULL, 0, hash, sizeof(hash));
+    memset(code_hash_text, 0, sizeof(code_hash_text));
+    if (base58_encode(hash, sizeof(hash), code_hash_text, sizeof(code_hash_text) - 1) < 0)
+    {
+        THROW(INVALID_PARAMETER);
+    }
+    PRINTF("code hash: %s\n", code_hash_text);
+    return SW_OK;
 }
 
+// Appends field 'kind' of the review of 'tx' to trusted_summary
+static void append_field(tx_span_t tx, uint8_t kind)
+{
+    size_t length = strlen(trusted_summary);
+    tx_field_t field;
+
+    // Formatted in place, cut to the room left
+    for (unsigned int i = 0; parse_transaction_field(tx, i, &field, trusted_summary + length, sizeof(trusted_summary) - length) == 0; i++)
+    {
+        if (field.kind == kind)
+        {
+            return;
+        }
+    }
+    trusted_summary[length] = 0;
+}
 
-// ------------------ Function call key -------------------
-static void display_call_key_flow(void)
+// Whether 'flow' of 'tx' gets the one page review, written to trusted_summary
+static bool summarize_trusted(int flow, tx_span_t tx)
 {
-    // Fill fields
-    START_ADD_FIELD()
-    ADD_FIELD(TO_ACCOUNT)
-    ADD_FIELD(CONTRACT)
-    ADD_FIELD(ALLOWANCE)
-    END_ADD_FIELD()
+    const uint8_t *receiver_id;
+    uint32_t receiver_id_len;
+
+    if ((flow != SIGN_FLOW_TRANSFER && flow != SIGN_FLOW_FUNCTION_CALL) ||
+        parse_transaction_receiver(tx, &receiver_id, &receiver_id_len) != 0 ||
+        !is_trusted_receiver(receiver_id, receiver_id_len))
+    {
+        return false;
+    }
 
-    // Start review
-    START_REVIEW()
+    // "1.5 NEAR to x.near" or "method to x.near with 1.5 NEAR"
+    trusted_summary[0] = 0;
+    if (flow == SIGN_FLOW_TRANSFER)
+    {
+        append_field(tx, TX_FIELD_AMOUNT);
+        append_text(trusted_summary, sizeof(trusted_summary), " NEAR to ");
+        append_field(tx, TX_FIELD_RECEIVER);
+    }
+    else
+    {
+        append_field(tx, TX_FIELD_ACTION);
+        append_text(trusted_summary, sizeof(trusted_summary), " to ");
+        append_field(tx, TX_FIELD_RECEIVER);
+        append_text(trusted_summary, sizeof(trusted_summary), " with ");
+        append_field(tx, TX_FIELD_DEPOSIT);
+        append_text(trusted_summary, sizeof(trusted_summary), " NEAR");
+    }
+    return true;
 }
 
-void sign_add_function_call_key_ux_flow_init()
+// Whether the review of 'flow' of 'tx' can be shown, and with how many
+// 'fields'. INS_SIGN and INS_PARSE_TRANSACTION both check it, so one fails
+// where the other would.
+static uint16_t check_review(int flow, tx_span_t tx, unsigned int *fields)
 {
-    generic_intro_flow(display_call_key_flow);
+    if (flow == SIGN_PARSING_ERROR)
+    {
+        return SW_BUFFER_OVERFLOW;
+    }
+    if (flow < SIGN_FLOW_GENERIC || flow > SIGN_FLOW_DEPLOY_CONTRACT)
+    {
+        return SW_CONDITIONS_NOT_SATISFIED;
+    }
+    // Every action must be shown, see parse_transaction_field()
+    int count = parse_transaction_field_count(tx);
+    if (count == SIGN_PARSING_ERROR)
+    {
+        return SW_BUFFER_OVERFLOW;
+    }
+    *fields = count;
+    if (flow == SIGN_FLOW_DEPLOY_CONTRACT)
+    {
+        return display_code_hash();
+    }
+    return SW_OK;
 }
 
-#endif
+// Shows the review of the parsed transaction 'tx', which replies once done
+static uint16_t start_review(int flow, tx_span_t tx, volatile unsigned int *flags)
+{
+    unsigned int fields;
+    uint16_t sw = check_review(flow, tx, &fields);
+    if (sw != SW_OK)
+    {
+        return sw;
+    }
 
-static void add_chunk_data(const uint8_t *input_data, size_t input_length)
+    // Until it is approved or rejected only side-effect-free APDUs are
+    // answered, see dispatch_apdu()
+    start_pending_review(REVIEW_SIGN);
+    *flags |= IO_ASYNCH_REPLY;
+    if (summarize_trusted(flow, tx))
+    {
+        sign_trusted_ux_flow_init();
+        return SW_DEFERRED;
+    }
+    sign_review_ux_flow_init(tx, fields);
+    return SW_DEFERRED;
+}
+
+uint16_t handle_sign_transaction(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx)
 {
-    // if this is a first chunk
-    PRINTF("Buffer used: %d\n", tmp_ctx.signing_context.buffer_used);
-    if (tmp_ctx.signing_context.buffer_used == 0)
+    UNUSED(tx);
+
+    uint8_t last = p1 & ~(P1_COMPRESSED | P1_SEQUENCED);
+    if (last != P1_MORE && last != P1_LAST)
     {
-        // then there is the bip32 path in the first chunk - first 20 bytes of data
-        size_t path_size = sizeof(tmp_ctx.signing_context.bip32);
-        if (input_length < path_size)
-        {
-            // TODO: Have specific error for underflow?
-            THROW(SW_BUFFER_OVERFLOW);
-        }
-        read_path_from_bytes(input_data, tmp_ctx.signing_context.bip32);
+        return SW_INCORRECT_P1_P2;
+    }
 
-        input_length -= path_size;
-        // PRINTF("data_size: %d\n", data_size);
+    // Most chunks end here: acknowledged without unwinding through CATCH
+    uint16_t sw = add_chunk_data(p1, p2, input_buffer, input_length, false);
+    if (sw != SW_OK || last == P1_MORE)
+    {
+        return sw;
+    }
 
-        memcpy(tmp_ctx.signing_context.buffer, &input_data[path_size], input_length);
-        PRINTF("buffer: %.*h\n", input_length, tmp_ctx.signing_context.buffer);
+    // TODO: Is network_byte used anywhere?
+    tmp_ctx.signing_context.network_byte = p2;
+    sw = end_upload();
+    if (sw != SW_OK)
+    {
+        return sw;
     }
-    else
+    tx_span_t span = {tmp_ctx.signing_context.buffer, tmp_ctx.signing_context.buffer_used};
+    return start_review(parse_transaction_flow(span), span, flags);
+}
+
+uint16_t handle_sign_resume(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx)
+{
+    UNUSED(p1);
+    UNUSED(p2);
+    UNUSED(input_buffer);
+    UNUSED(input_length);
+    UNUSED(flags);
+
+    signingContext_t *ctx = &tmp_ctx.signing_context;
+    bool started = ctx->upload_started;
+    uint32_t received = started ? ctx->bytes_received : 0;
+
+    // Whether an upload is in progress, the P2 of its next chunk and how
+    // many bytes after the path were taken: send the rest from there
+    G_io_apdu_buffer[0] = started;
+    G_io_apdu_buffer[1] = started ? ctx->next_sequence : 0;
+    G_io_apdu_buffer[2] = received >> 24;
+    G_io_apdu_buffer[3] = received >> 16;
+    G_io_apdu_buffer[4] = received >> 8;
+    G_io_apdu_buffer[5] = received;
+    *tx = 6;
+    return SW_OK;
+}
+
+uint16_t handle_sign_template(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx)
+{
+    UNUSED(p1);
+    UNUSED(p2);
+    UNUSED(flags);
+
+    signTemplate_t *template = &sign_template;
+    size_t path_size = sizeof(template->bip32);
+
+    if (input_length < path_size || input_length - path_size > sizeof(template->tx))
     {
-        // else update the data from entire segment.
-        // PRINTF("data_size: %d\n", input_length);
-        if (tmp_ctx.signing_context.buffer_used + input_length > MAX_DATA_SIZE)
-        {
-            THROW(SW_BUFFER_OVERFLOW);
-        }
-        memcpy(&tmp_ctx.signing_context.buffer[tmp_ctx.signing_context.buffer_used], input_data, input_length);
-        PRINTF("buffer: %.*h\n", input_length, &tmp_ctx.signing_context.buffer[tmp_ctx.signing_context.buffer_used]);
+        return SW_BUFFER_OVERFLOW;
+    }
+    memset(template, 0, sizeof(*template));
+    read_path_from_bytes(input_buffer, template->bip32);
+    template->size = input_length - path_size;
+    memcpy(template->tx, input_buffer + path_size, template->size);
+
+    tx_span_t span = {template->tx, template->size};
+    if (parse_transaction_template(span, &template->nonce_offset, &template->block_hash_offset, &template->deposit_offset))
+    {
+        template->size = 0;
+        return SW_BUFFER_OVERFLOW;
+    }
+    template->flow = parse_transaction_flow(span);
+    if (template->flow == SIGN_PARSING_ERROR || template->flow == SIGN_FLOW_DEPLOY_CONTRACT)
+    {
+        // Contract code does not fit a template, and would need hashing anyway
+        template->size = 0;
+        return template->flow == SIGN_PARSING_ERROR ? SW_BUFFER_OVERFLOW : SW_CONDITIONS_NOT_SATISFIED;
     }
-    tmp_ctx.signing_context.buffer_used += input_length;
+
+    // The size of the deltas to send
+    G_io_apdu_buffer[0] = 8 + 32 + (template->deposit_offset ? 16 : 0);
+    *tx = 1;
+    return SW_OK;
 }
 
-void handle_sign_transaction(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx)
+uint16_t handle_sign_delta(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx)
 {
+    UNUSED(p1);
     UNUSED(p2);
     UNUSED(tx);
 
-    if (p1 != P1_MORE && p1 != P1_LAST)
+    signTemplate_t *template = &sign_template;
+    signingContext_t *ctx = &tmp_ctx.signing_context;
+
+    if (template->size == 0)
     {
-        THROW(SW_INCORRECT_P1_P2);
+        return SW_CONDITIONS_NOT_SATISFIED;
     }
-
-    if (p1 == P1_LAST)
+    if (input_length != 8 + 32 + (template->deposit_offset ? 16 : 0))
     {
-        // TODO: Is network_byte used anywhere?
-        tmp_ctx.signing_context.network_byte = p2;
-        add_chunk_data(input_buffer, input_length);
+        return SW_BUFFER_OVERFLOW;
+    }
+
+    // The review is formatted from the template: it must hold what is signed
+    apply_template_delta(template->tx, template->nonce_offset, template->block_hash_offset, template->deposit_offset, input_buffer);
+    memset(ctx, 0, sizeof(*ctx));
+    memcpy(ctx->bip32, template->bip32, sizeof(ctx->bip32));
+    cx_sha256_init(&ctx->tx_hash);
+    cx_hash(&ctx->tx_hash.header, 0, template->tx, template->size, NULL, 0);
+
+    tx_span_t span = {template->tx, template->size};
+    return start_review(template->flow, span, flags);
+}
 
-        switch (parse_transaction())
+// PARSED_* tag of each TX_FIELD_*
+static const uint8_t parsed_tags[] = {
+    [TX_FIELD_ACTION] = PARSED_INTRO,
+    [TX_FIELD_RECEIVER] = PARSED_RECEIVER,
+    [TX_FIELD_SIGNER] = PARSED_SIGNER,
+    [TX_FIELD_AMOUNT] = PARSED_AMOUNT,
+    [TX_FIELD_DEPOSIT] = PARSED_DEPOSIT,
+    [TX_FIELD_ARGS] = PARSED_ARGS,
+    [TX_FIELD_TO_ACCOUNT] = PARSED_TO_ACCOUNT,
+    [TX_FIELD_CONTRACT] = PARSED_CONTRACT,
+    [TX_FIELD_ALLOWANCE] = PARSED_ALLOWANCE,
+    [TX_FIELD_CODE_SIZE] = PARSED_CODE_SIZE,
+    [TX_FIELD_CODE_HASH] = PARSED_CODE_HASH,
+    [TX_FIELD_STAKE] = PARSED_STAKE,
+    [TX_FIELD_BENEFICIARY] = PARSED_BENEFICIARY,
+    [TX_FIELD_DANGER] = PARSED_DANGER,
+};
+
+// Writes the flow and the fields the review of 'tx' shows as TLV. A field
+// longer than the room left is cut and tagged PARSED_TRUNCATED, the ones
+// after it are left out.
+static uint32_t add_parsed_fields(int flow, tx_span_t tx, unsigned int fields)
+{
+    // Room left for the status word
+    const uint32_t reply_size = IO_APDU_BUFFER_SIZE - 2;
+    uint32_t offset = 0;
+
+    G_io_apdu_buffer[offset++] = PARSED_FLOW;
+    G_io_apdu_buffer[offset++] = 1;
+    G_io_apdu_buffer[offset++] = flow;
+    for (unsigned int i = 0; i < fields && offset + 2 < reply_size; i++)
+    {
+        tx_field_t field;
+        uint32_t room = reply_size - offset - 2;
+        // Formatted in place, with one more byte than the room to tell a cut
+        // value and one for the terminating zero, over the status word
+        char *value = (char *) &G_io_apdu_buffer[offset + 2];
+        size_t value_size = room + 2;
+
+        if (format_review_field(tx, i, &field, value, value_size) != 0)
         {
-        case SIGN_FLOW_GENERIC:
-            sign_ux_flow_init();
-            break;
-        case SIGN_FLOW_TRANSFER:
-            sign_transfer_ux_flow_init();
-            break;
-        case SIGN_FLOW_FUNCTION_CALL:
-            sign_function_call_ux_flow_init();
             break;
-        case SIGN_FLOW_ADD_FUNCTION_CALL_KEY:
-            sign_add_function_call_key_ux_flow_init();
-            break;
-        case SIGN_FLOW_ADD_FULL_ACCESS_KEY:
-            sign_add_function_call_key_ux_flow_init();
+        }
+
+        size_t length = strlen(value);
+        uint8_t tag = parsed_tags[field.kind];
+        if (length > room || (length == 0 && value_size < AMOUNT_DISPLAY_SIZE))
+        {
+            // Too long, or an amount without the room to be formatted
+            length = room;
+            tag |= PARSED_TRUNCATED;
+        }
+        G_io_apdu_buffer[offset++] = tag;
+        G_io_apdu_buffer[offset++] = length;
+        offset += length;
+        if (tag & PARSED_TRUNCATED)
+        {
             break;
-        case SIGN_PARSING_ERROR:
-            THROW(SW_BUFFER_OVERFLOW);
-        default:
-            THROW(SW_CONDITIONS_NOT_SATISFIED);
         }
     }
-    else
+    return offset;
+}
+
+uint16_t handle_parse_transaction(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx)
+{
+    UNUSED(flags);
+
+    uint8_t last = p1 & ~(P1_COMPRESSED | P1_SEQUENCED);
+    if (last != P1_MORE && last != P1_LAST)
     {
-        add_chunk_data(input_buffer, input_length);
-        THROW(SW_OK);
+        return SW_INCORRECT_P1_P2;
     }
 
-    *flags |= IO_ASYNCH_REPLY;
+    // Same upload and check_review() as INS_SIGN, so it fails where INS_SIGN would
+    uint16_t sw = add_chunk_data(p1, p2, input_buffer, input_length, true);
+    if (sw != SW_OK || last == P1_MORE)
+    {
+        return sw;
+    }
+    sw = end_upload();
+    if (sw != SW_OK)
+    {
+        return sw;
+    }
+
+    tx_span_t span = {tmp_ctx.signing_context.buffer, tmp_ctx.signing_context.buffer_used};
+    int flow = parse_transaction_flow(span);
+    unsigned int fields;
+    sw = check_review(flow, span, &fields);
+    if (sw != SW_OK)
+    {
+        return sw;
+    }
+
+    *tx = add_parsed_fields(flow, span, fields);
+    // No review and nothing to sign: the transaction is dropped
+    memset(&tmp_ctx.signing_context, 0, sizeof(tmp_ctx.signing_context));
+    return SW_OK;
 }
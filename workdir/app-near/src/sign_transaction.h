@@ -5,6 +5,29 @@
 #ifndef _SIGN_TRANSACTION_H_
 #define _SIGN_TRANSACTION_H_
 
-void handle_sign_transaction(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx);
+// INS_PARSE_TRANSACTION reply tags, see doc/api.asc
+#define PARSED_FLOW 0x01
+#define PARSED_INTRO 0x02
+#define PARSED_RECEIVER 0x03
+#define PARSED_SIGNER 0x04
+#define PARSED_AMOUNT 0x05
+#define PARSED_DEPOSIT 0x06
+#define PARSED_ARGS 0x07
+#define PARSED_TO_ACCOUNT 0x08
+#define PARSED_CONTRACT 0x09
+#define PARSED_ALLOWANCE 0x0A
+#define PARSED_CODE_SIZE 0x0B
+#define PARSED_CODE_HASH 0x0C
+#define PARSED_STAKE 0x0D
+#define PARSED_BENEFICIARY 0x0E
+#define PARSED_DANGER 0x0F
+// Set on the tag of a field cut to fit the reply
+#define PARSED_TRUNCATED 0x80
+
+uint16_t handle_sign_transaction(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx);
+uint16_t handle_sign_resume(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx);
+uint16_t handle_sign_template(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx);
+uint16_t handle_sign_delta(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx);
+uint16_t handle_parse_transaction(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx);
 
 #endif
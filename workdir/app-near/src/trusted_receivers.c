@@ -0,0 +1,199 @@
+#include "trusted_receivers.h"
+#include "utils.h"
+#include "main.h"
+#include "os.h"
+#include "ux.h"
+#include "glyphs.h"
+
+// The change waiting for the user
+static uint8_t account_hash[32];
+static uint8_t slot;
+static bool adding;
+
+static void hash_account_id(const uint8_t *account_id, size_t length, uint8_t hash[32])
+{
+    cx_sha256_t sha256;
+
+    cx_sha256_init(&sha256);
+    cx_hash(&sha256.header, CX_LAST, account_id, length, hash, 32);
+}
+
+// The slot holding 'hash', or TRUSTED_RECEIVER_SLOTS
+static uint8_t find_slot(const uint8_t hash[32])
+{
+    uint8_t i;
+
+    for (i = 0; i < TRUSTED_RECEIVER_SLOTS; i++)
+    {
+        if (memcmp((const void *) N_trusted_receivers.hashes[i], hash, 32) == 0)
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+bool is_trusted_receiver(const uint8_t *account_id, size_t length)
+{
+    uint8_t hash[32];
+
+    hash_account_id(account_id, length, hash);
+    return find_slot(hash) < TRUSTED_RECEIVER_SLOTS;
+}
+
+// Only what a NEAR account id may hold, so that what is shown is what is hashed
+static bool is_account_id(const uint8_t *account_id, size_t length)
+{
+    if (length < 2 || length > MAX_ACCOUNT_ID_LENGTH)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++)
+    {
+        uint8_t c = account_id[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '.' || c == '_' || c == '-'))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void approve_change(void)
+{
+    uint8_t free_slot[32] = {0};
+
+    nvm_write((void *) N_trusted_receivers.hashes[slot], adding ? account_hash : free_slot, 32);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+#ifdef HAVE_BAGL
+
+UX_STEP_NOCB(
+    ux_trusted_receiver_flow_account_step,
+    bnnn_paging,
+    {
+        .title = "Trust receiver",
+        .text = ui_arena.trusted_receiver.account,
+    });
+UX_STEP_NOCB(
+    ux_untrusted_receiver_flow_account_step,
+    bnnn_paging,
+    {
+        .title = "Stop trusting",
+        .text = ui_arena.trusted_receiver.account,
+    });
+UX_STEP_VALID(
+    ux_trusted_receiver_flow_approve_step,
+    pb,
+    approve_change(); send_response(0, true),
+    {
+        &C_icon_validate_14,
+        "Approve",
+    });
+UX_STEP_VALID(
+    ux_trusted_receiver_flow_reject_step,
+    pb,
+    send_response(0, false),
+    {
+        &C_icon_crossmark,
+        "Reject",
+    });
+
+UX_FLOW(
+    ux_trusted_receiver_flow,
+    &ux_trusted_receiver_flow_account_step,
+    &ux_trusted_receiver_flow_approve_step,
+    &ux_trusted_receiver_flow_reject_step);
+
+UX_FLOW(
+    ux_untrusted_receiver_flow,
+    &ux_untrusted_receiver_flow_account_step,
+    &ux_trusted_receiver_flow_approve_step,
+    &ux_trusted_receiver_flow_reject_step);
+
+static void display_trusted_receiver(void)
+{
+    ux_flow_init(0, adding ? ux_trusted_receiver_flow : ux_untrusted_receiver_flow, NULL);
+}
+
+#endif
+
+#ifdef HAVE_NBGL
+
+#include "nbgl_use_case.h"
+#include "menu.h"
+
+static void trusted_receiver_callback(bool confirm)
+{
+    if (confirm)
+    {
+        approve_change();
+        send_response(0, true);
+        nbgl_useCaseStatus(adding ? "RECEIVER\nTRUSTED" : "RECEIVER\nNO LONGER TRUSTED", true, ui_idle);
+    }
+    else
+    {
+        send_response(0, false);
+        nbgl_useCaseStatus("Receiver change\ncancelled", false, ui_idle);
+    }
+}
+
+static void display_trusted_receiver(void)
+{
+    trustedReceiverDisplay_t *display = &ui_arena.trusted_receiver;
+
+    strlcpy(display->message, adding ? "Trust receiver\n" : "Stop trusting\n", sizeof(display->message));
+    strlcat(display->message, display->account, sizeof(display->message));
+    strlcat(display->message, "?", sizeof(display->message));
+    nbgl_useCaseChoice(
+        &C_stax_app_near_64px,
+        display->message,
+        adding ? "Its transfers and calls get a one page review" : NULL,
+        "Approve",
+        "Reject",
+        trusted_receiver_callback);
+}
+
+#endif
+
+uint16_t handle_trusted_receiver(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx)
+{
+    UNUSED(p2);
+    UNUSED(tx);
+
+    if (p1 != TRUSTED_RECEIVER_ADD && p1 != TRUSTED_RECEIVER_REMOVE)
+    {
+        return SW_INCORRECT_P1_P2;
+    }
+    if (!is_account_id(input_buffer, input_length))
+    {
+        return SW_INVALID_DATA;
+    }
+
+    adding = p1 == TRUSTED_RECEIVER_ADD;
+    hash_account_id(input_buffer, input_length, account_hash);
+    slot = find_slot(account_hash);
+    if ((slot < TRUSTED_RECEIVER_SLOTS) == adding)
+    {
+        // Already as asked
+        return SW_OK;
+    }
+    if (adding)
+    {
+        uint8_t free_slot[32] = {0};
+        slot = find_slot(free_slot);
+        if (slot == TRUSTED_RECEIVER_SLOTS)
+        {
+            return SW_NOT_ENOUGH_SPACE;
+        }
+    }
+
+    memcpy(ui_arena.trusted_receiver.account, input_buffer, input_length);
+    ui_arena.trusted_receiver.account[input_length] = 0;
+    start_pending_review(REVIEW_TRUSTED_RECEIVER);
+    *flags |= IO_ASYNCH_REPLY;
+    display_trusted_receiver();
+    return SW_DEFERRED;
+}
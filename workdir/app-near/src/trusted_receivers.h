@@ -0,0 +1,17 @@
+#include "os.h"
+#include "cx.h"
+#include "globals.h"
+
+#ifndef _TRUSTED_RECEIVERS_H_
+#define _TRUSTED_RECEIVERS_H_
+
+// INS_TRUSTED_RECEIVER P1
+#define TRUSTED_RECEIVER_ADD 0x00
+#define TRUSTED_RECEIVER_REMOVE 0x01
+
+// Whether transactions to 'account_id' get the one page review
+bool is_trusted_receiver(const uint8_t *account_id, size_t length);
+
+uint16_t handle_trusted_receiver(uint8_t p1, uint8_t p2, const uint8_t *input_buffer, uint16_t input_length, volatile unsigned int *flags, volatile unsigned int *tx);
+
+#endif
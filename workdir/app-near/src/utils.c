@@ -4,6 +4,14 @@
 #include <stdlib.h>
 #include "utils.h"
 #include "menu.h"
+#include "main.h"
+
+// Period of the SDK ticker events
+#define TICKER_INTERVAL_MS 100
+
+pendingReview pending_review = REVIEW_NONE;
+// Ticker events since the pending review was shown
+static uint32_t review_ticks;
 
 void bin_to_hex(char *out, const uint8_t *in, size_t len) {
     const unsigned char hex_digits[] = {'0', '1', '2', '3', '4', '5', '6', '7',
@@ -16,14 +24,48 @@ void bin_to_hex(char *out, const uint8_t *in, size_t len) {
     *out = 0;
 }
 
-void send_response(uint8_t tx, bool approve) {
-    G_io_apdu_buffer[tx++] = approve? 0x90 : 0x69;
-    G_io_apdu_buffer[tx++] = approve? 0x00 : 0x85;
+// Replies to the pending review
+static void send_review_reply(uint8_t tx, uint16_t sw) {
+    G_io_apdu_buffer[tx++] = sw >> 8;
+    G_io_apdu_buffer[tx++] = sw;
+    pending_review = REVIEW_NONE;
     // Send back the response, do not restart the event loop
     io_exchange(CHANNEL_APDU | IO_RETURN_AFTER_TX, tx);
+}
+
+void send_response(uint8_t tx, bool approve) {
+    send_review_reply(tx, approve ? 0x9000 : 0x6985);
 
     #ifdef HAVE_BAGL
     // Display back the original UX
     ui_idle();
     #endif
 }
+
+void start_pending_review(pendingReview review) {
+    pending_review = review;
+    review_ticks = 0;
+}
+
+void review_timeout_tick(void) {
+    uint16_t timeout = N_storage.review_timeout;
+
+    if (pending_review == REVIEW_NONE || timeout == 0) {
+        return;
+    }
+    if (++review_ticks < (uint32_t) timeout * (1000 / TICKER_INTERVAL_MS)) {
+        return;
+    }
+    PRINTF("review timed out\n");
+    // Nothing of the abandoned request is kept
+    init_context();
+    send_review_reply(0, SW_REVIEW_TIMEOUT);
+    ui_idle();
+}
+
+void set_review_timeout(uint16_t seconds) {
+    // Spare the flash when nothing changes, hosts may set it on every job
+    if (N_storage.review_timeout != seconds) {
+        nvm_write((void *) &N_storage.review_timeout, &seconds, sizeof(seconds));
+    }
+}
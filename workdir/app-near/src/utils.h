@@ -14,9 +14,26 @@ typedef enum rlpTxType {
     TX_FEE
 } rlpTxType;
 
+// The review on screen, whose INS reply waits for send_response()
+typedef enum pendingReview {
+    REVIEW_NONE = 0,
+    REVIEW_SIGN,
+    REVIEW_PUBLIC_KEY,
+    REVIEW_WALLET_ID,
+    REVIEW_TRUSTED_RECEIVER
+} pendingReview;
+
+extern pendingReview pending_review;
+
 void bin_to_hex(char *out, const uint8_t *in, size_t len);
 void send_response(uint8_t tx, bool approve);
 
+// Marks 'review' pending until send_response() or the review timeout
+void start_pending_review(pendingReview review);
+// On every ticker event: rejects the pending review once it is too old
+void review_timeout_tick(void);
+void set_review_timeout(uint16_t seconds);
+
     // type            userid    x    y   w    h  str rad fill      fg        bg      fid iid  txt   touchparams...       ]
 #define UI_BUTTONS \
     {{BAGL_RECTANGLE   , 0x00,   0,   0, 128,  32, 0, 0, BAGL_FILL, 0x000000, 0xFFFFFF, 0, 0}, NULL, 0, 0, 0, NULL, NULL, NULL},\
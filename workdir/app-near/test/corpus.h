@@ -0,0 +1,34 @@
+#ifndef __CORPUS_H__
+#define __CORPUS_H__
+
+// Packed parser corpus: transactions together with the flow id and UI fields
+// parse_transaction() produced for them, in one file the tests map and walk
+// sequentially. Written by pack_corpus, read by test_parse_corpus in main.c.
+//
+// All integers are little endian, nothing is aligned:
+//   header:  magic "NEARCRP1", u32 record count
+//   record:  u16 transaction size, i8 flow id, transaction bytes, then for
+//            each UI field in corpus_ui_fields() order: u8 length, chars
+
+#include <stdint.h>
+
+#include "context.h"
+
+#define CORPUS_MAGIC "NEARCRP1"
+#define CORPUS_MAGIC_SIZE 8
+#define CORPUS_HEADER_SIZE (CORPUS_MAGIC_SIZE + 4)
+#define CORPUS_FIELD_COUNT 6
+
+static const char *const corpus_field_names[CORPUS_FIELD_COUNT] = {"line1", "line2",  "line3",
+                                                                   "line5", "amount", "long_line"};
+
+static inline void corpus_ui_fields(uiContext_t *ui, char *fields[CORPUS_FIELD_COUNT]) {
+  fields[0] = ui->line1;
+  fields[1] = ui->line2;
+  fields[2] = ui->line3;
+  fields[3] = ui->line5;
+  fields[4] = ui->amount;
+  fields[5] = ui->long_line;
+}
+
+#endif
@@ -0,0 +1,586 @@
+// Differential test of parse_transaction(): generates random valid NEAR
+// transactions (every action type, account IDs at the display buffer
+// boundaries, zero / one / 10^24 / max u128 amounts), decodes each with the
+// parser and with an independent reference decoder written against the
+// Borsh schema, and reports every displayed field they disagree on.
+//
+// Workers are threads, each calling parse_transaction_span() with its own
+// buffers.
+//
+// Usage: difftest [-n transactions] [-j workers] [-s seed] [-v]
+
+#include "constants.h"
+#include "context.h"
+#include "parse_transaction.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_REPORTED_MISMATCHES 10
+
+__extension__ typedef unsigned __int128 u128;
+
+typedef enum {
+    at_create_account,
+    at_deploy_contract,
+    at_function_call,
+    at_transfer,
+    at_stake,
+    at_add_key,
+    at_delete_key,
+    at_delete_account,
+    at_count
+} action_type_t;
+
+typedef struct {
+    uint8_t data[MAX_DATA_SIZE];
+    size_t len;
+    bool overflow;
+} tx_buffer_t;
+
+typedef struct {
+    int flow;
+    uiContext_t ui;
+} expected_t;
+
+typedef struct {
+    unsigned long long count;
+    uint64_t seed;
+    bool verbose;
+    unsigned long long transactions;
+    unsigned long long mismatches;
+    unsigned long long per_flow[7];
+} worker_t;
+
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// ------------------------------------------------------------------------
+// Random numbers
+
+static _Thread_local uint64_t rng_state;
+
+static uint64_t rnd(void) {
+    // splitmix64
+    uint64_t z = (rng_state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static uint32_t rnd_below(uint32_t n) {
+    return rnd() % n;
+}
+
+// ------------------------------------------------------------------------
+// Generator
+
+static void put(tx_buffer_t *tx, const void *data, size_t len) {
+    if (tx->len + len > sizeof(tx->data)) {
+        tx->overflow = true;
+        return;
+    }
+    memcpy(tx->data + tx->len, data, len);
+    tx->len += len;
+}
+
+static void put_u8(tx_buffer_t *tx, uint8_t n) {
+    put(tx, &n, 1);
+}
+
+static void put_u32(tx_buffer_t *tx, uint32_t n) {
+    uint8_t bytes[4] = {n, n >> 8, n >> 16, n >> 24};
+    put(tx, bytes, sizeof(bytes));
+}
+
+static void put_u64(tx_buffer_t *tx, uint64_t n) {
+    for (int i = 0; i < 8; i++) {
+        put_u8(tx, n >> (8 * i));
+    }
+}
+
+static void put_u128(tx_buffer_t *tx, u128 n) {
+    for (int i = 0; i < 16; i++) {
+        put_u8(tx, n >> (8 * i));
+    }
+}
+
+static void put_random(tx_buffer_t *tx, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        put_u8(tx, rnd());
+    }
+}
+
+static void put_string(tx_buffer_t *tx, const char *s, size_t len) {
+    put_u32(tx, len);
+    put(tx, s, len);
+}
+
+static void put_public_key(tx_buffer_t *tx) {
+    put_u8(tx, 0); // ed25519
+    put_random(tx, 32);
+}
+
+// Lengths around the sizes of the ui_context lines (45, 65 and 250 bytes)
+static size_t boundary_length(size_t max) {
+    static const size_t lengths[] = {0, 1, 2, 3, 4, 43, 44, 45, 46, 63, 64, 65, 66, 248, 249, 250, 251};
+    size_t len;
+
+    do {
+        len = rnd_below(3) ? lengths[rnd_below(sizeof(lengths) / sizeof(lengths[0]))] : rnd_below(max + 1);
+    } while (len > max);
+    return len;
+}
+
+// Account IDs: 2 to 64 characters, implicit accounts are 64 hex digits
+static size_t random_account_id(char *out) {
+    static const char charset[] = "abcdefghijklmnopqrstuvwxyz0123456789_-.";
+    size_t len;
+
+    if (rnd_below(8) == 0) {
+        for (len = 0; len < 64; len++) {
+            out[len] = "0123456789abcdef"[rnd_below(16)];
+        }
+        return len;
+    }
+    do {
+        len = boundary_length(64);
+    } while (len < 2);
+    for (size_t i = 0; i < len; i++) {
+        out[i] = charset[rnd_below(i == 0 || i == len - 1 ? 36 : sizeof(charset) - 1)];
+    }
+    return len;
+}
+
+static u128 random_amount(void) {
+    static const u128 one_near = (u128) 1000000000000ULL * 1000000000000ULL;
+    u128 n;
+
+    switch (rnd_below(8)) {
+    case 0:
+        return 0;
+    case 1:
+        return 1;
+    case 2:
+        return ~(u128) 0;
+    case 3:
+        return one_near + (int) rnd_below(3) - 1;
+    case 4:
+        n = 1;
+        for (int i = rnd_below(39); i > 0; i--) {
+            n *= 10;
+        }
+        return rnd_below(2) ? n : n - 1;
+    case 5:
+        return (u128) 1 << rnd_below(128);
+    default:
+        return (u128) rnd() << 64 | rnd();
+    }
+}
+
+static void put_text(tx_buffer_t *tx, size_t len, bool json) {
+    put_u32(tx, len);
+    for (size_t i = 0; i < len; i++) {
+        put_u8(tx, i == 0 && json ? '{' : ' ' + rnd_below(95));
+    }
+}
+
+static void put_action(tx_buffer_t *tx, action_type_t type) {
+    char account[64];
+    size_t len;
+
+    put_u8(tx, type);
+    switch (type) {
+    case at_create_account:
+        break;
+    case at_deploy_contract:
+        len = rnd_below(256);
+        put_u32(tx, len);
+        put_random(tx, len);
+        break;
+    case at_function_call:
+        put_text(tx, boundary_length(64), false);
+        put_text(tx, boundary_length(300), rnd_below(2));
+        put_u64(tx, rnd());
+        put_u128(tx, random_amount());
+        break;
+    case at_transfer:
+        put_u128(tx, random_amount());
+        break;
+    case at_stake:
+        put_u128(tx, random_amount());
+        put_public_key(tx);
+        break;
+    case at_add_key:
+        put_public_key(tx);
+        put_u64(tx, rnd());
+        if (rnd_below(2)) {
+            put_u8(tx, 1); // full access
+            break;
+        }
+        put_u8(tx, 0); // function call
+        if (rnd_below(2)) {
+            put_u8(tx, 1);
+            put_u128(tx, random_amount());
+        } else {
+            put_u8(tx, 0);
+        }
+        len = random_account_id(account);
+        put_string(tx, account, len);
+        len = rnd_below(3);
+        put_u32(tx, len);
+        while (len-- > 0) {
+            put_text(tx, boundary_length(32), false);
+        }
+        break;
+    case at_delete_key:
+        put_public_key(tx);
+        break;
+    case at_delete_account:
+        len = random_account_id(account);
+        put_string(tx, account, len);
+        break;
+    default:
+        break;
+    }
+}
+
+static void generate(tx_buffer_t *tx) {
+    char account[64];
+    size_t len;
+    uint32_t actions;
+
+    do {
+        memset(tx, 0, sizeof(*tx));
+        len = random_account_id(account);
+        put_string(tx, account, len);
+        put_public_key(tx);
+        put_u64(tx, rnd());
+        len = random_account_id(account);
+        put_string(tx, account, len);
+        put_random(tx, 32);
+        actions = rnd_below(8) ? 1 : rnd_below(4);
+        put_u32(tx, actions);
+        for (uint32_t i = 0; i < actions; i++) {
+            put_action(tx, rnd_below(at_count));
+        }
+    } while (tx->overflow);
+}
+
+// ------------------------------------------------------------------------
+// Reference decoder
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+} reader_t;
+
+static bool take(reader_t *r, size_t len, const uint8_t **out) {
+    if (r->len - r->pos < len) {
+        return false;
+    }
+    *out = r->data + r->pos;
+    r->pos += len;
+    return true;
+}
+
+static bool read_u32(reader_t *r, uint32_t *n) {
+    const uint8_t *p;
+    if (!take(r, 4, &p)) {
+        return false;
+    }
+    *n = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+    return true;
+}
+
+// Strings that don't fit are cut and end with "..."
+static bool read_display_string(reader_t *r, char *out, size_t out_size) {
+    const uint8_t *p;
+    uint32_t len;
+
+    if (!read_u32(r, &len) || !take(r, len, &p)) {
+        return false;
+    }
+    if (len < out_size) {
+        memcpy(out, p, len);
+        out[len] = 0;
+    } else {
+        memcpy(out, p, out_size - 4);
+        strcpy(out + out_size - 4, "...");
+    }
+    return true;
+}
+
+// yoctoNEAR as NEAR: 24 decimals, without trailing zeros
+static bool read_display_amount(reader_t *r, char *out) {
+    const uint8_t *p;
+    char digits[48];
+    int len = 0, int_len;
+    u128 n = 0;
+
+    if (!take(r, 16, &p)) {
+        return false;
+    }
+    for (int i = 15; i >= 0; i--) {
+        n = n << 8 | p[i];
+    }
+    do {
+        digits[len++] = '0' + (int) (n % 10);
+        n /= 10;
+    } while (n > 0);
+    while (len <= 24) {
+        digits[len++] = '0';
+    }
+
+    int_len = len - 24;
+    for (int i = 0; i < int_len; i++) {
+        *out++ = digits[len - 1 - i];
+    }
+    int frac_len = 24;
+    while (frac_len > 0 && digits[24 - frac_len] == '0') {
+        frac_len--;
+    }
+    if (frac_len > 0) {
+        *out++ = '.';
+        for (int i = 0; i < frac_len; i++) {
+            *out++ = digits[23 - i];
+        }
+    }
+    *out = 0;
+    return true;
+}
+
+static bool reference_decode(const uint8_t *data, size_t len, expected_t *expected) {
+    reader_t r = {data, len, 0};
+    uiContext_t *ui = &expected->ui;
+    const uint8_t *p;
+    uint32_t actions, args_len, code_len;
+
+    memset(expected, 0, sizeof(*expected));
+    expected->flow = SIGN_PARSING_ERROR;
+
+    if (!read_display_string(&r, ui->line3, sizeof(ui->line3)) || !take(&r, 33 + 8, &p) ||
+        !read_display_string(&r, ui->line2, sizeof(ui->line2)) || !take(&r, 32, &p) || !read_u32(&r, &actions)) {
+        return false;
+    }
+    if (actions != 1) {
+        strcpy(ui->line1, "multiple actions");
+        expected->flow = SIGN_FLOW_GENERIC;
+        return true;
+    }
+    if (!take(&r, 1, &p)) {
+        return false;
+    }
+
+    switch (*p) {
+    case at_transfer:
+        strcpy(ui->line1, "transfer");
+        if (!read_display_amount(&r, ui->amount)) {
+            return false;
+        }
+        expected->flow = SIGN_FLOW_TRANSFER;
+        return true;
+    case at_function_call:
+        if (!read_display_string(&r, ui->line1, sizeof(ui->line1)) || !read_u32(&r, &args_len) ||
+            !take(&r, args_len, &p)) {
+            return false;
+        }
+        if (args_len > 0 && p[0] == '{') {
+            r.pos -= args_len + 4;
+            read_display_string(&r, ui->long_line, sizeof(ui->long_line));
+        }
+        if (!take(&r, 8, &p) || !read_display_amount(&r, ui->line5)) {
+            return false;
+        }
+        expected->flow = SIGN_FLOW_FUNCTION_CALL;
+        return true;
+    case at_add_key:
+        strcpy(ui->line1, "add key");
+        if (!take(&r, 33 + 8 + 1, &p)) {
+            return false;
+        }
+        if (p[41] != 0) {
+            // The review shows the warning and the receiver, not the signer
+            ui->line3[0] = 0;
+            strcpy(ui->long_line, "This gives full access to a device other than Ledger");
+            expected->flow = SIGN_FLOW_ADD_FULL_ACCESS_KEY;
+            return true;
+        }
+        if (!take(&r, 1, &p)) {
+            return false;
+        }
+        if (*p) {
+            if (!read_display_amount(&r, ui->line5)) {
+                return false;
+            }
+        } else {
+            strcpy(ui->line5, "Unlimited");
+        }
+        if (!read_display_string(&r, ui->line2, sizeof(ui->line2))) {
+            return false;
+        }
+        expected->flow = SIGN_FLOW_ADD_FUNCTION_CALL_KEY;
+        return true;
+    case at_create_account:
+        strcpy(ui->line1, "create account");
+        break;
+    case at_deploy_contract:
+        strcpy(ui->line1, "deploy contract");
+        if (!read_u32(&r, &code_len)) {
+            return false;
+        }
+        sprintf(ui->line5, "%u bytes", code_len);
+        expected->flow = SIGN_FLOW_DEPLOY_CONTRACT;
+        return true;
+    case at_stake:
+        strcpy(ui->line1, "stake");
+        break;
+    case at_delete_key:
+        strcpy(ui->line1, "delete key");
+        break;
+    case at_delete_account:
+        strcpy(ui->line1, "delete account");
+        break;
+    default:
+        return false;
+    }
+    expected->flow = SIGN_FLOW_GENERIC;
+    return true;
+}
+
+// ------------------------------------------------------------------------
+// Workers
+
+static bool compare_field(const char *name, const char *actual, const char *expected, bool report) {
+    if (strcmp(actual, expected) == 0) {
+        return true;
+    }
+    if (report) {
+        fprintf(stderr, "  %s: \"%s\", expected \"%s\"\n", name, actual, expected);
+    }
+    return false;
+}
+
+static bool check(const tx_buffer_t *tx, bool report, int *flow, uiContext_t *summary) {
+    tx_span_t span = {tx->data, tx->len};
+    expected_t expected;
+    bool same;
+
+    reference_decode(tx->data, tx->len, &expected);
+    *flow = parse_transaction_span(span, summary);
+
+    same = *flow == expected.flow;
+    if (!same && report) {
+        fprintf(stderr, "  flow: %d, expected %d\n", *flow, expected.flow);
+    }
+    same &= compare_field("line1", summary->line1, expected.ui.line1, report);
+    same &= compare_field("line2", summary->line2, expected.ui.line2, report);
+    same &= compare_field("line3", summary->line3, expected.ui.line3, report);
+    same &= compare_field("line5", summary->line5, expected.ui.line5, report);
+    same &= compare_field("amount", summary->amount, expected.ui.amount, report);
+    same &= compare_field("long_line", summary->long_line, expected.ui.long_line, report);
+    return same;
+}
+
+static void *run_worker(void *arg) {
+    worker_t *worker = arg;
+    tx_buffer_t tx;
+    uiContext_t summary;
+    int flow;
+
+    rng_state = worker->seed;
+    for (unsigned long long i = 0; i < worker->count; i++) {
+        generate(&tx);
+        if (!check(&tx, false, &flow, &summary)) {
+            if (worker->mismatches++ < MAX_REPORTED_MISMATCHES) {
+                pthread_mutex_lock(&output_lock);
+                fprintf(stderr, "mismatch, seed %llu transaction %llu: ", (unsigned long long) worker->seed, i);
+                for (size_t j = 0; j < tx.len; j++) {
+                    fprintf(stderr, "%02x", tx.data[j]);
+                }
+                fprintf(stderr, "\n");
+                check(&tx, true, &flow, &summary);
+                pthread_mutex_unlock(&output_lock);
+            }
+        } else if (worker->verbose) {
+            pthread_mutex_lock(&output_lock);
+            printf("%d|%s|%s|%s|%s|%s|%s\n", flow, summary.line1, summary.line2, summary.line3, summary.line5,
+                   summary.amount, summary.long_line);
+            pthread_mutex_unlock(&output_lock);
+        }
+        worker->per_flow[flow + 1]++;
+        worker->transactions++;
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    unsigned long long count = 1000000;
+    int thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t seed = 1;
+    bool verbose = false;
+    worker_t *workers, total;
+    pthread_t *threads;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:j:s:v")) != -1) {
+        switch (opt) {
+        case 'n':
+            count = strtoull(optarg, NULL, 0);
+            break;
+        case 'j':
+            thread_count = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n transactions] [-j workers] [-s seed] [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+
+    workers = calloc(thread_count, sizeof(*workers));
+    threads = calloc(thread_count, sizeof(*threads));
+    if (workers == NULL || threads == NULL) {
+        perror("calloc");
+        return 2;
+    }
+    for (int i = 0; i < thread_count; i++) {
+        workers[i].count = count / thread_count + ((unsigned long long) i < count % thread_count);
+        workers[i].seed = seed * 1000003 + i;
+        workers[i].verbose = verbose;
+        if (pthread_create(&threads[i], NULL, run_worker, &workers[i]) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            return 2;
+        }
+    }
+
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+        total.transactions += workers[i].transactions;
+        total.mismatches += workers[i].mismatches;
+        for (int flow = 0; flow < 7; flow++) {
+            total.per_flow[flow] += workers[i].per_flow[flow];
+        }
+    }
+    printf("%llu transactions, %llu mismatches, %d workers\n", total.transactions, total.mismatches, thread_count);
+    printf("flows: error %llu, generic %llu, transfer %llu, function call %llu, function call key %llu, "
+           "full access key %llu, deploy contract %llu\n",
+           total.per_flow[0], total.per_flow[1], total.per_flow[2], total.per_flow[3], total.per_flow[4],
+           total.per_flow[5], total.per_flow[6]);
+    free(workers);
+    free(threads);
+    return total.mismatches > 0;
+}
@@ -0,0 +1,433 @@
+#include "fuzz_borsh.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "constants.h"
+
+// Action tags, see action_type_t in parse_transaction.c
+#define AT_FUNCTION_CALL 2
+#define AT_TRANSFER 3
+#define AT_ADD_KEY 5
+#define AT_LAST_VALUE 7
+
+// Display buffer sizes of uiContext_t, where strcpy_ellipsis() switches
+// between copying and truncating
+static const uint32_t interesting_lengths[] = {0, 1, 3, 4, 5, 44, 45, 46, 64, 65, 66, 249, 250, 251};
+
+static const uint32_t interesting_u32[] = {0, 1, 2, 0x7f, 0xff, 0x100, 0xffff, 0x7fffffff, 0x80000000, 0xfffffffc, 0xffffffff};
+
+typedef struct {
+    uint8_t data[MAX_DATA_SIZE];
+    uint32_t len;
+} borsh_bytes_t;
+
+// The fields parse_transaction() looks at, anything after them is kept
+// verbatim in 'tail'.
+typedef struct {
+    borsh_bytes_t signer;
+    uint8_t public_key[33];
+    uint8_t nonce[8];
+    borsh_bytes_t receiver;
+    uint8_t block_hash[32];
+    uint32_t actions_len;
+    bool has_action;
+    uint8_t action_type;
+    borsh_bytes_t method_name;
+    borsh_bytes_t args;
+    uint8_t gas[8];
+    uint8_t amount[16];
+    uint8_t key[33];
+    uint8_t key_nonce[8];
+    uint8_t permission;
+    uint8_t has_allowance;
+    borsh_bytes_t permission_receiver;
+    borsh_bytes_t tail;
+} borsh_tx_t;
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+} reader_t;
+
+typedef struct {
+    uint8_t *data;
+    size_t max_size;
+    size_t pos;
+    size_t length_offsets[8]; // where the u32 prefixes of strings went
+    int length_count;
+} writer_t;
+
+static borsh_tx_t tx;
+
+// ------------------------------------------------------------------------
+// Random numbers, deterministic for a given libFuzzer seed
+
+static uint32_t rng_state;
+
+static uint32_t rnd(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static uint32_t rnd_below(uint32_t n) {
+    return n ? rnd() % n : 0;
+}
+
+// ------------------------------------------------------------------------
+// Decoding
+
+static bool read_fixed(reader_t *r, uint8_t *out, size_t len) {
+    if (r->size - r->pos < len) {
+        return false;
+    }
+    memcpy(out, r->data + r->pos, len);
+    r->pos += len;
+    return true;
+}
+
+static bool read_u32(reader_t *r, uint32_t *n) {
+    uint8_t bytes[4];
+    if (!read_fixed(r, bytes, sizeof(bytes))) {
+        return false;
+    }
+    *n = bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+    return true;
+}
+
+static bool read_string(reader_t *r, borsh_bytes_t *s) {
+    uint32_t len;
+    if (!read_u32(r, &len) || len > sizeof(s->data)) {
+        return false;
+    }
+    s->len = len;
+    return read_fixed(r, s->data, len);
+}
+
+static bool decode_action(reader_t *r) {
+    if (!read_fixed(r, &tx.action_type, 1)) {
+        return false;
+    }
+    switch (tx.action_type) {
+    case AT_TRANSFER:
+        return read_fixed(r, tx.amount, sizeof(tx.amount));
+    case AT_FUNCTION_CALL:
+        return read_string(r, &tx.method_name) && read_string(r, &tx.args) &&
+               read_fixed(r, tx.gas, sizeof(tx.gas)) && read_fixed(r, tx.amount, sizeof(tx.amount));
+    case AT_ADD_KEY:
+        if (!read_fixed(r, tx.key, sizeof(tx.key)) || !read_fixed(r, tx.key_nonce, sizeof(tx.key_nonce)) ||
+            !read_fixed(r, &tx.permission, 1)) {
+            return false;
+        }
+        if (tx.permission != 0) {
+            return true;
+        }
+        if (!read_fixed(r, &tx.has_allowance, 1)) {
+            return false;
+        }
+        if (tx.has_allowance && !read_fixed(r, tx.amount, sizeof(tx.amount))) {
+            return false;
+        }
+        return read_string(r, &tx.permission_receiver);
+    default:
+        return tx.action_type <= AT_LAST_VALUE;
+    }
+}
+
+static bool decode(const uint8_t *data, size_t size) {
+    reader_t r = {data, size, 0};
+
+    memset(&tx, 0, sizeof(tx));
+    if (!read_string(&r, &tx.signer) || !read_fixed(&r, tx.public_key, sizeof(tx.public_key)) ||
+        !read_fixed(&r, tx.nonce, sizeof(tx.nonce)) || !read_string(&r, &tx.receiver) ||
+        !read_fixed(&r, tx.block_hash, sizeof(tx.block_hash)) || !read_u32(&r, &tx.actions_len)) {
+        return false;
+    }
+
+    size_t actions_start = r.pos;
+    tx.has_action = decode_action(&r);
+    if (!tx.has_action) {
+        r.pos = actions_start;
+    }
+    tx.tail.len = r.size - r.pos;
+    memcpy(tx.tail.data, data + r.pos, tx.tail.len);
+    return true;
+}
+
+// ------------------------------------------------------------------------
+// Encoding
+
+static void write_fixed(writer_t *w, const uint8_t *in, size_t len) {
+    if (w->pos <= w->max_size && w->max_size - w->pos >= len) {
+        memcpy(w->data + w->pos, in, len);
+    }
+    w->pos += len;
+}
+
+static void write_u32(writer_t *w, uint32_t n) {
+    uint8_t bytes[4] = {n, n >> 8, n >> 16, n >> 24};
+    write_fixed(w, bytes, sizeof(bytes));
+}
+
+static void write_string(writer_t *w, const borsh_bytes_t *s) {
+    if (w->length_count < (int) (sizeof(w->length_offsets) / sizeof(w->length_offsets[0]))) {
+        w->length_offsets[w->length_count++] = w->pos;
+    }
+    write_u32(w, s->len);
+    write_fixed(w, s->data, s->len);
+}
+
+static void encode_action(writer_t *w) {
+    write_fixed(w, &tx.action_type, 1);
+    switch (tx.action_type) {
+    case AT_TRANSFER:
+        write_fixed(w, tx.amount, sizeof(tx.amount));
+        break;
+    case AT_FUNCTION_CALL:
+        write_string(w, &tx.method_name);
+        write_string(w, &tx.args);
+        write_fixed(w, tx.gas, sizeof(tx.gas));
+        write_fixed(w, tx.amount, sizeof(tx.amount));
+        break;
+    case AT_ADD_KEY:
+        write_fixed(w, tx.key, sizeof(tx.key));
+        write_fixed(w, tx.key_nonce, sizeof(tx.key_nonce));
+        write_fixed(w, &tx.permission, 1);
+        if (tx.permission == 0) {
+            write_fixed(w, &tx.has_allowance, 1);
+            if (tx.has_allowance) {
+                write_fixed(w, tx.amount, sizeof(tx.amount));
+            }
+            write_string(w, &tx.permission_receiver);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Returns the encoded size, which exceeds 'w->max_size' if it didn't fit
+static size_t encode(writer_t *w) {
+    write_string(w, &tx.signer);
+    write_fixed(w, tx.public_key, sizeof(tx.public_key));
+    write_fixed(w, tx.nonce, sizeof(tx.nonce));
+    write_string(w, &tx.receiver);
+    write_fixed(w, tx.block_hash, sizeof(tx.block_hash));
+    write_u32(w, tx.actions_len);
+    if (tx.has_action) {
+        encode_action(w);
+    }
+    write_fixed(w, tx.tail.data, tx.tail.len);
+    return w->pos;
+}
+
+// ------------------------------------------------------------------------
+// Mutations
+
+static borsh_bytes_t *pick_string(void) {
+    borsh_bytes_t *strings[4] = {&tx.signer, &tx.receiver};
+    int count = 2;
+
+    if (tx.has_action && tx.action_type == AT_FUNCTION_CALL) {
+        strings[count++] = &tx.method_name;
+        strings[count++] = &tx.args;
+    } else if (tx.has_action && tx.action_type == AT_ADD_KEY && tx.permission == 0) {
+        strings[count++] = &tx.permission_receiver;
+    }
+    return strings[rnd_below(count)];
+}
+
+static void fill_printable(uint8_t *out, size_t len) {
+    uint8_t c = 'a' + rnd_below(26);
+    bool repeat = rnd_below(2);
+
+    for (size_t i = 0; i < len; i++) {
+        out[i] = repeat ? c : (uint8_t) (' ' + rnd_below(95));
+    }
+}
+
+// New length at a display buffer boundary, keeping the old content
+static void mutate_string_length(void) {
+    borsh_bytes_t *s = pick_string();
+    uint32_t len = rnd_below(4) ? interesting_lengths[rnd_below(sizeof(interesting_lengths) / sizeof(interesting_lengths[0]))]
+                                : rnd_below(sizeof(s->data));
+
+    if (len > s->len) {
+        fill_printable(s->data + s->len, len - s->len);
+    }
+    s->len = len;
+}
+
+static void mutate_string_content(void) {
+    borsh_bytes_t *s = pick_string();
+
+    if (s->len == 0) {
+        return;
+    }
+    if (s == &tx.args && rnd_below(2)) {
+        // JSON-looking args are displayed, everything else is skipped
+        s->data[0] = '{';
+        return;
+    }
+    s->data[rnd_below(s->len)] = rnd();
+}
+
+static void set_amount_pow10(uint8_t amount[16], int exponent) {
+    memset(amount, 0, 16);
+    amount[0] = 1;
+    while (exponent-- > 0) {
+        unsigned int carry = 0;
+        for (int i = 0; i < 16; i++) {
+            carry += amount[i] * 10;
+            amount[i] = carry;
+            carry >>= 8;
+        }
+    }
+}
+
+// Amounts are u128 formatted with 24 decimals: probe the edges of the
+// decimal point, trailing zero removal and the largest value
+static void mutate_amount(void) {
+    uint8_t *amount = tx.amount;
+
+    switch (rnd_below(5)) {
+    case 0:
+        memset(amount, 0, 16);
+        amount[0] = rnd_below(2);
+        break;
+    case 1:
+        memset(amount, 0xff, 16);
+        if (rnd_below(2)) {
+            amount[15] = 0x7f;
+        }
+        break;
+    case 2:
+        set_amount_pow10(amount, rnd_below(39));
+        if (rnd_below(2)) {
+            // 10^n - 1: all nines
+            for (int i = 0; i < 16 && amount[i]-- == 0; i++) {
+            }
+        }
+        break;
+    case 3:
+        set_amount_pow10(amount, 24);
+        amount[rnd_below(16)] ^= 1 << rnd_below(8);
+        break;
+    default:
+        for (int i = 0; i < 16; i++) {
+            amount[i] = rnd();
+        }
+        break;
+    }
+}
+
+static void mutate_action_type(void) {
+    tx.has_action = true;
+    tx.action_type = rnd_below(16) ? rnd_below(AT_LAST_VALUE + 1) : rnd();
+    if (tx.action_type == AT_ADD_KEY) {
+        tx.permission = rnd_below(2);
+        tx.has_allowance = rnd_below(2);
+    }
+}
+
+static void mutate_actions_len(void) {
+    tx.actions_len = rnd_below(2) ? rnd_below(3) : interesting_u32[rnd_below(sizeof(interesting_u32) / sizeof(interesting_u32[0]))];
+}
+
+static void mutate_permission(void) {
+    if (!tx.has_action || tx.action_type != AT_ADD_KEY) {
+        tx.has_action = true;
+        tx.action_type = AT_ADD_KEY;
+    }
+    if (rnd_below(2)) {
+        tx.permission = tx.permission == 0 ? rnd() | 1 : 0;
+    } else {
+        tx.has_allowance = !tx.has_allowance;
+    }
+}
+
+static void mutate_tail(void) {
+    if (rnd_below(2) || tx.tail.len == 0) {
+        uint32_t extra = rnd_below(64);
+        if (tx.tail.len + extra > sizeof(tx.tail.data)) {
+            extra = sizeof(tx.tail.data) - tx.tail.len;
+        }
+        for (uint32_t i = 0; i < extra; i++) {
+            tx.tail.data[tx.tail.len++] = rnd();
+        }
+    } else {
+        tx.tail.len = rnd_below(tx.tail.len);
+    }
+}
+
+size_t borsh_mutate(uint8_t *data, size_t size, size_t max_size, int mutation, unsigned int seed) {
+    static uint8_t out[MAX_DATA_SIZE];
+    writer_t w = {out, sizeof(out) < max_size ? sizeof(out) : max_size, 0, {0}, 0};
+    bool lie_about_length = false;
+    size_t out_size;
+
+    if (!decode(data, size)) {
+        return 0;
+    }
+    rng_state = seed ? seed : 1;
+    if (mutation < 0) {
+        mutation = rnd_below(BORSH_MUTATION_COUNT);
+    }
+
+    switch (mutation) {
+    case 0:
+        mutate_string_length();
+        break;
+    case 1:
+        mutate_string_content();
+        break;
+    case 2:
+        mutate_amount();
+        break;
+    case 3:
+        mutate_action_type();
+        break;
+    case 4:
+        mutate_actions_len();
+        break;
+    case 5:
+        mutate_permission();
+        break;
+    case 6:
+        mutate_tail();
+        break;
+    default:
+        // A length prefix which disagrees with the data, for the overflow checks
+        lie_about_length = true;
+        break;
+    }
+
+    out_size = encode(&w);
+    if (out_size > w.max_size) {
+        // Grew too much: give the bytes back from the tail, then truncate
+        size_t excess = out_size - w.max_size;
+        tx.tail.len = excess < tx.tail.len ? tx.tail.len - excess : 0;
+        memset(&w, 0, sizeof(w));
+        w.data = out;
+        w.max_size = sizeof(out) < max_size ? sizeof(out) : max_size;
+        out_size = encode(&w);
+        if (out_size > w.max_size) {
+            out_size = w.max_size;
+        }
+    }
+    if (lie_about_length && w.length_count > 0) {
+        size_t offset = w.length_offsets[rnd_below(w.length_count)];
+        uint32_t len = interesting_u32[rnd_below(sizeof(interesting_u32) / sizeof(interesting_u32[0]))];
+        if (offset + 4 <= out_size) {
+            out[offset] = len;
+            out[offset + 1] = len >> 8;
+            out[offset + 2] = len >> 16;
+            out[offset + 3] = len >> 24;
+        }
+    }
+    memcpy(data, out, out_size);
+    return out_size;
+}
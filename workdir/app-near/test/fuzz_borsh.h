@@ -0,0 +1,22 @@
+#ifndef __FUZZ_BORSH_H__
+#define __FUZZ_BORSH_H__
+
+// Structure-aware mutations of Borsh encoded NEAR transactions, shared by
+// the fuzz harnesses and the seed corpus builder.
+//
+// Inputs are decoded into the fields parse_transaction() reads, one field is
+// mutated and the transaction is encoded again, so mutations land past the
+// signer string instead of being rejected by the first length check.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BORSH_MUTATION_COUNT 8
+
+// Applies mutation number 'mutation' (0 .. BORSH_MUTATION_COUNT - 1), or a
+// random one if 'mutation' is negative, to the 'size' bytes in 'data'.
+// Returns the new size, at most 'max_size', or 0 if 'data' does not decode
+// as far as the action list, in which case 'data' is left untouched.
+size_t borsh_mutate(uint8_t *data, size_t size, size_t max_size, int mutation, unsigned int seed);
+
+#endif /* __FUZZ_BORSH_H__ */
@@ -0,0 +1,86 @@
+// Builds the seed corpus for fuzz_tx: copies the given test cases into the
+// output directory together with a fixed set of Borsh-aware mutations of
+// each, so fuzzing starts from inputs that already reach every action type
+// and display buffer boundary.
+//
+// Usage: fuzz_corpus [-n <variants per mutation>] <output dir> <testcase.raw>...
+
+#include "constants.h"
+#include "fuzz_borsh.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_VARIANTS_PER_MUTATION 16
+
+static size_t read_file(const char *path, uint8_t *data, size_t max_size) {
+    FILE *f = fopen(path, "rb");
+    size_t size;
+
+    if (f == NULL) {
+        perror(path);
+        exit(1);
+    }
+    size = fread(data, 1, max_size, f);
+    fclose(f);
+    return size;
+}
+
+static void write_file(const char *dir, const char *name, int mutation, int variant, const uint8_t *data,
+                       size_t size) {
+    char path[1024];
+    FILE *f;
+
+    if (mutation < 0) {
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+    } else {
+        snprintf(path, sizeof(path), "%s/%s.m%d.%d", dir, name, mutation, variant);
+    }
+    f = fopen(path, "wb");
+    if (f == NULL || fwrite(data, 1, size, f) != size) {
+        perror(path);
+        exit(1);
+    }
+    fclose(f);
+}
+
+int main(int argc, char **argv) {
+    static uint8_t original[MAX_DATA_SIZE];
+    static uint8_t data[MAX_DATA_SIZE];
+    int variants = DEFAULT_VARIANTS_PER_MUTATION;
+    int written = 0;
+
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        variants = atoi(argv[2]);
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc < 3) {
+        fprintf(stderr, "usage: fuzz_corpus [-n <variants per mutation>] <output dir> <testcase.raw>...\n");
+        return 1;
+    }
+
+    for (int i = 2; i < argc; i++) {
+        const char *name = strrchr(argv[i], '/') ? strrchr(argv[i], '/') + 1 : argv[i];
+        size_t size = read_file(argv[i], original, sizeof(original));
+
+        write_file(argv[1], name, -1, 0, original, size);
+        written++;
+        for (int mutation = 0; mutation < BORSH_MUTATION_COUNT; mutation++) {
+            for (int variant = 0; variant < variants; variant++) {
+                size_t new_size;
+
+                memcpy(data, original, size);
+                new_size = borsh_mutate(data, size, sizeof(data), mutation, variant * BORSH_MUTATION_COUNT + mutation + 1);
+                if (new_size == 0) {
+                    break;
+                }
+                write_file(argv[1], name, mutation, variant, data, new_size);
+                written++;
+            }
+        }
+    }
+    printf("%d inputs written to %s\n", written, argv[1]);
+    return 0;
+}
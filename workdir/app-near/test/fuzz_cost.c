@@ -0,0 +1,218 @@
+// Performance fuzzer: uses the cost of parse_transaction() as feedback
+// instead of coverage alone, to find the inputs that keep the device busiest
+// and push the stack deepest before the review is shown.
+//
+// Cost is the number of user space instructions retired (perf_event_open),
+// or nanoseconds where the kernel doesn't allow counting them. Stack depth is
+// sampled on every function entry, so this target is built with
+// -finstrument-functions. Both are reported to libFuzzer as extra counters,
+// one per cost bucket, so that an input reaching a new bucket is kept.
+//
+// Set FUZZ_SLOWEST_DIR to keep the FUZZ_SLOWEST_COUNT most expensive inputs
+// in that directory, named by cost and stack depth. Numbers are for the host
+// build: compare them between inputs and revisions, not with the device.
+
+#include "parse_transaction.h"
+#include "context.h"
+#include "fuzz_borsh.h"
+
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NO_INSTRUMENT __attribute__((no_instrument_function))
+
+#define FUZZ_SLOWEST_COUNT 16
+
+// Log-linear buckets: 32 per power of two
+#define BUCKET_BITS 5
+#define COST_BUCKETS (32 << BUCKET_BITS)
+#define DEPTH_GRANULARITY 16
+#define DEPTH_BUCKETS 256
+
+uiContext_t ui_context;
+tmpContext_t tmp_ctx;
+
+size_t LLVMFuzzerMutate(uint8_t *Data, size_t Size, size_t MaxSize);
+
+__attribute__((used, section("__libfuzzer_extra_counters"))) static uint8_t extra_counters[COST_BUCKETS + DEPTH_BUCKETS];
+
+typedef struct {
+    uint64_t cost;
+    unsigned int depth;
+    char path[1024];
+} slow_input_t;
+
+static int perf_fd = -2;
+static const char *cost_unit = "instructions";
+static uintptr_t stack_base;
+static uintptr_t stack_lowest;
+static int measuring;
+
+static slow_input_t slowest[FUZZ_SLOWEST_COUNT];
+static int slowest_count;
+static uint64_t max_cost;
+static unsigned int max_depth;
+
+NO_INSTRUMENT void __cyg_profile_func_enter(void *this_fn, void *call_site) {
+    uintptr_t sp = (uintptr_t) __builtin_frame_address(0);
+
+    (void) this_fn;
+    (void) call_site;
+    if (measuring && sp < stack_lowest) {
+        stack_lowest = sp;
+    }
+}
+
+NO_INSTRUMENT void __cyg_profile_func_exit(void *this_fn, void *call_site) {
+    (void) this_fn;
+    (void) call_site;
+}
+
+NO_INSTRUMENT static void open_counter(void) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    perf_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (perf_fd < 0) {
+        cost_unit = "ns";
+        fprintf(stderr, "fuzz_cost: no instruction counter, using wall clock time\n");
+    }
+}
+
+NO_INSTRUMENT static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+NO_INSTRUMENT static unsigned int cost_bucket(uint64_t cost) {
+    unsigned int octave = 0;
+
+    while ((cost >> octave) >= (2u << BUCKET_BITS)) {
+        octave++;
+    }
+    if (octave == 0) {
+        return cost;
+    }
+    return (octave << BUCKET_BITS) + ((cost >> octave) & ((1u << BUCKET_BITS) - 1)) + (1u << BUCKET_BITS);
+}
+
+NO_INSTRUMENT static uint64_t fnv1a(const uint8_t *data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Keeps 'data' if it is among the most expensive inputs seen so far,
+// replacing the cheapest one kept
+NO_INSTRUMENT static void keep_if_slow(const char *dir, const uint8_t *data, size_t size, uint64_t cost,
+                                       unsigned int depth) {
+    int slot = slowest_count;
+    FILE *f;
+
+    if (slowest_count == FUZZ_SLOWEST_COUNT) {
+        slot = 0;
+        for (int i = 1; i < slowest_count; i++) {
+            if (slowest[i].cost < slowest[slot].cost) {
+                slot = i;
+            }
+        }
+        if (slowest[slot].cost >= cost) {
+            return;
+        }
+        unlink(slowest[slot].path);
+    } else {
+        slowest_count++;
+    }
+
+    slowest[slot].cost = cost;
+    slowest[slot].depth = depth;
+    snprintf(slowest[slot].path, sizeof(slowest[slot].path), "%s/cost-%010llu-depth-%05u-%016llx", dir,
+             (unsigned long long) cost, depth, (unsigned long long) fnv1a(data, size));
+    f = fopen(slowest[slot].path, "wb");
+    if (f == NULL) {
+        perror(slowest[slot].path);
+        return;
+    }
+    fwrite(data, 1, size, f);
+    fclose(f);
+}
+
+NO_INSTRUMENT int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
+    const char *dir = getenv("FUZZ_SLOWEST_DIR");
+    uint64_t cost, start_ns = 0;
+    unsigned int depth;
+
+    if (Size > MAX_DATA_SIZE) {
+        return 0;
+    }
+    if (perf_fd == -2) {
+        open_counter();
+    }
+    memset(&ui_context, 0, sizeof(uiContext_t));
+    memcpy(tmp_ctx.signing_context.buffer, Data, Size);
+    tmp_ctx.signing_context.buffer_used = Size;
+
+    stack_base = stack_lowest = (uintptr_t) __builtin_frame_address(0);
+    measuring = 1;
+    if (perf_fd >= 0) {
+        ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+    } else {
+        start_ns = now_ns();
+    }
+
+    parse_transaction();
+
+    if (perf_fd >= 0) {
+        ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(perf_fd, &cost, sizeof(cost)) != sizeof(cost)) {
+            cost = 0;
+        }
+    } else {
+        cost = now_ns() - start_ns;
+    }
+    measuring = 0;
+    depth = stack_base - stack_lowest;
+
+    extra_counters[cost_bucket(cost) % COST_BUCKETS] = 1;
+    extra_counters[COST_BUCKETS + (depth / DEPTH_GRANULARITY < DEPTH_BUCKETS ? depth / DEPTH_GRANULARITY
+                                                                               : DEPTH_BUCKETS - 1)] = 1;
+
+    if (cost > max_cost || depth > max_depth) {
+        max_cost = cost > max_cost ? cost : max_cost;
+        max_depth = depth > max_depth ? depth : max_depth;
+        fprintf(stderr, "fuzz_cost: max %llu %s, max stack depth %u bytes\n", (unsigned long long) max_cost,
+                cost_unit, max_depth);
+    }
+    if (dir != NULL) {
+        keep_if_slow(dir, Data, Size, cost, depth);
+    }
+    return 0;
+}
+
+NO_INSTRUMENT size_t LLVMFuzzerCustomMutator(uint8_t *Data, size_t Size, size_t MaxSize, unsigned int Seed) {
+    if (Seed % 8 != 0) {
+        size_t new_size = borsh_mutate(Data, Size, MaxSize, -1, Seed);
+        if (new_size > 0) {
+            return new_size;
+        }
+    }
+    return LLVMFuzzerMutate(Data, Size, MaxSize);
+}
@@ -1,5 +1,6 @@
 #include "parse_transaction.h"
 #include "context.h"
+#include "fuzz_borsh.h"
 
 #include <stdio.h>
 #include <stddef.h>
@@ -8,6 +9,11 @@
 uiContext_t ui_context;
 tmpContext_t tmp_ctx;
 
+size_t LLVMFuzzerMutate(uint8_t *Data, size_t Size, size_t MaxSize);
+
+#ifdef FUZZ_PRINT_UI
+// Only for looking at what a crashing input displays: printing on every
+// iteration costs more than parsing does.
 static void print_ui() {
     printf("---\n");
     printf("%s\n", ui_context.line1);
@@ -17,6 +23,7 @@ static void print_ui() {
     printf("%s\n", ui_context.line5);
     printf("%s\n", ui_context.amount);
 }
+#endif
 
 int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
     memset(&ui_context, 0, sizeof(uiContext_t));
@@ -27,6 +34,29 @@ int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
     memcpy(tmp_ctx.signing_context.buffer, Data, Size);
     tmp_ctx.signing_context.buffer_used = Size;
     parse_transaction();
+
+    // The review as shown page by page
+    tx_span_t tx = {tmp_ctx.signing_context.buffer, Size};
+    int fields = parse_transaction_field_count(tx);
+    for (int i = 0; i < fields; i++) {
+        tx_field_t field;
+        char value[sizeof(ui_context.long_line)];
+        parse_transaction_field(tx, i, &field, value, sizeof(value));
+    }
+#ifdef FUZZ_PRINT_UI
     print_ui();
+#endif
     return 0;
 }
+
+size_t LLVMFuzzerCustomMutator(uint8_t *Data, size_t Size, size_t MaxSize, unsigned int Seed) {
+    // Mostly Borsh-aware mutations, with some plain byte-level ones mixed in
+    // for whatever the transaction model doesn't cover
+    if (Seed % 8 != 0) {
+        size_t new_size = borsh_mutate(Data, Size, MaxSize, -1, Seed);
+        if (new_size > 0) {
+            return new_size;
+        }
+    }
+    return LLVMFuzzerMutate(Data, Size, MaxSize);
+}
@@ -5,9 +5,16 @@
 #include <cmocka.h>
 // clang-format on
 
+#include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "constants.h"
 #include "context.h"
+#include "corpus.h"
+#include "lz_stream.h"
 #include "parse_transaction.h"
 
 // Temporary area to store stuff and reuse the same memory
@@ -125,9 +132,20 @@ static void test_parse_deploy_contract(void **state) {
   assert_string_equal(ui_context.line2, "random_acc2.near");  // receiver
   assert_string_equal(ui_context.line3, "random_acc1.near");  // signer
   assert_string_equal(ui_context.amount, "");
-  assert_string_equal(ui_context.long_line, "");
-  assert_string_equal(ui_context.line5, "");
-  assert_int_equal(active_flow, SIGN_FLOW_GENERIC);
+  assert_string_equal(ui_context.long_line, "");              // code hash, set by the device
+  assert_string_equal(ui_context.line5, "8 bytes");           // code size
+  assert_int_equal(active_flow, SIGN_FLOW_DEPLOY_CONTRACT);
+
+  // where the device starts hashing the code instead of buffering it
+  uint32_t code_offset, code_size;
+  tx_span_t tx = {tmp_ctx.signing_context.buffer,
+                  tmp_ctx.signing_context.buffer_used};
+  assert_int_equal(parse_deploy_contract_code(tx, &code_offset, &code_size), 0);
+  assert_int_equal(code_offset, tx.size - 8);
+  assert_int_equal(code_size, 8);
+  tx.size = code_offset - 1;
+  assert_int_equal(parse_deploy_contract_code(tx, &code_offset, &code_size),
+                   SIGN_PARSING_ERROR);
 }
 
 static void test_parse_stake(void **state) {
@@ -233,6 +251,334 @@ static void test_parse_multiple_actions(void **state) {
   assert_int_equal(active_flow, SIGN_FLOW_GENERIC);
 }
 
+// parse_transaction_span() works on any buffer, at any alignment, and
+// leaves the globals alone
+static void test_parse_span(void **state) {
+  (void)state;
+
+  static uint8_t buffer[MAX_DATA_SIZE + 1];
+  size_t size = load_testcase("../testcases/function_call_transaction.raw",
+                              buffer + 1);
+  uiContext_t summary;
+  memset(&ui_context, 0, sizeof(ui_context));
+  tx_span_t tx = {buffer + 1, size};
+  int active_flow = parse_transaction_span(tx, &summary);
+
+  assert_string_equal(summary.line1, "method_name");
+  assert_string_equal(summary.line2, "receiver.here");
+  assert_string_equal(summary.line3, "vg");
+  assert_string_equal(summary.long_line, "{\"args\":\"here\"}");
+  assert_string_equal(summary.line5, "10");
+  assert_int_equal(active_flow, SIGN_FLOW_FUNCTION_CALL);
+  assert_string_equal(ui_context.line1, "");
+
+  tx.size = 40;  // ends inside the signer public key
+  assert_int_equal(parse_transaction_span(tx, &summary), SIGN_PARSING_ERROR);
+}
+
+// Every transaction in the packed corpus must still produce the flow and UI
+// fields recorded for it, see corpus.h and pack_corpus.c
+static void test_parse_corpus(void **state) {
+  (void)state;
+
+  int fd = open("../testcases/corpus.bin", O_RDONLY);
+  assert_true(fd >= 0);
+  struct stat st;
+  assert_int_equal(fstat(fd, &st), 0);
+  size_t size = st.st_size;
+  assert_true(size >= CORPUS_HEADER_SIZE);
+
+  const uint8_t *corpus = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  assert_true(corpus != MAP_FAILED);
+  madvise((void *)corpus, size, MADV_SEQUENTIAL);
+  close(fd);
+
+  assert_memory_equal(corpus, CORPUS_MAGIC, CORPUS_MAGIC_SIZE);
+  uint32_t records = corpus[8] | corpus[9] << 8 | corpus[10] << 16 |
+                     (uint32_t)corpus[11] << 24;
+  size_t pos = CORPUS_HEADER_SIZE;
+
+  for (uint32_t i = 0; i < records; i++) {
+    assert_true(size - pos >= 3);
+    uint16_t tx_size = corpus[pos] | corpus[pos + 1] << 8;
+    int8_t expected_flow = corpus[pos + 2];
+    pos += 3;
+    assert_true(tx_size <= MAX_DATA_SIZE && size - pos >= tx_size);
+
+    memset(&ui_context, 0, sizeof(ui_context));
+    memcpy(tmp_ctx.signing_context.buffer, corpus + pos, tx_size);
+    tmp_ctx.signing_context.buffer_used = tx_size;
+    pos += tx_size;
+    int active_flow = parse_transaction();
+    if (active_flow != expected_flow) {
+      fail_msg("corpus record %u: flow %d, expected %d", i, active_flow,
+               expected_flow);
+    }
+
+    char *fields[CORPUS_FIELD_COUNT];
+    corpus_ui_fields(&ui_context, fields);
+    for (int field = 0; field < CORPUS_FIELD_COUNT; field++) {
+      assert_true(size - pos >= 1 && size - pos - 1 >= corpus[pos]);
+      uint8_t len = corpus[pos++];
+      if (strlen(fields[field]) != len ||
+          memcmp(fields[field], corpus + pos, len) != 0) {
+        fail_msg("corpus record %u: %s is \"%s\", expected \"%.*s\"", i,
+                 corpus_field_names[field], fields[field], len,
+                 (const char *)corpus + pos);
+      }
+      pos += len;
+    }
+  }
+  assert_int_equal(pos, size);
+  munmap((void *)corpus, size);
+}
+
+static void test_parse_template(void **state) {
+  (void)state;
+  uint32_t nonce_offset, block_hash_offset, deposit_offset;
+
+  tmp_ctx.signing_context.buffer_used =
+      load_testcase("../testcases/transfer_1_transaction.raw",
+                    tmp_ctx.signing_context.buffer);
+  tx_span_t tx = {tmp_ctx.signing_context.buffer,
+                  tmp_ctx.signing_context.buffer_used};
+  assert_int_equal(parse_transaction_template(tx, &nonce_offset,
+                                              &block_hash_offset,
+                                              &deposit_offset),
+                   0);
+  // signer "test-connect-ledger.test", receiver "vg"
+  assert_int_equal(nonce_offset, 4 + 24 + 33);
+  assert_int_equal(block_hash_offset, nonce_offset + 8 + 4 + 2);
+  assert_int_equal(deposit_offset, block_hash_offset + 32 + 4 + 1);
+
+  // Nothing but nonce and block hash changes in other transactions
+  tmp_ctx.signing_context.buffer_used =
+      load_testcase("../testcases/function_call_transaction.raw",
+                    tmp_ctx.signing_context.buffer);
+  tx.size = tmp_ctx.signing_context.buffer_used;
+  assert_int_equal(parse_transaction_template(tx, &nonce_offset,
+                                              &block_hash_offset,
+                                              &deposit_offset),
+                   0);
+  assert_int_equal(deposit_offset, 0);
+
+  tx.size = block_hash_offset + 31;
+  assert_int_equal(parse_transaction_template(tx, &nonce_offset,
+                                              &block_hash_offset,
+                                              &deposit_offset),
+                   SIGN_PARSING_ERROR);
+}
+
+static void test_parse_receiver(void **state) {
+  (void)state;
+  const uint8_t *receiver_id;
+  uint32_t receiver_id_len;
+
+  tmp_ctx.signing_context.buffer_used =
+      load_testcase("../testcases/transfer_1_transaction.raw",
+                    tmp_ctx.signing_context.buffer);
+  tx_span_t tx = {tmp_ctx.signing_context.buffer,
+                  tmp_ctx.signing_context.buffer_used};
+  assert_int_equal(parse_transaction_receiver(tx, &receiver_id,
+                                              &receiver_id_len),
+                   0);
+  assert_int_equal(receiver_id_len, 2);
+  assert_memory_equal(receiver_id, "vg", 2);
+
+  // Cut in the receiver id
+  tx.size = 4 + 24 + 33 + 8 + 4 + 1;
+  assert_int_equal(parse_transaction_receiver(tx, &receiver_id,
+                                              &receiver_id_len),
+                   SIGN_PARSING_ERROR);
+}
+
+static void assert_field(tx_span_t tx, unsigned int index, uint8_t kind,
+                         uint32_t action, const char *value) {
+  tx_field_t field;
+  char buffer[250];
+
+  assert_int_equal(
+      parse_transaction_field(tx, index, &field, buffer, sizeof(buffer)), 0);
+  assert_int_equal(field.kind, kind);
+  assert_int_equal(field.action, action);
+  assert_string_equal(buffer, value);
+}
+
+static const char *field_label(tx_span_t tx, unsigned int index) {
+  tx_field_t field;
+  char value;
+
+  assert_int_equal(parse_transaction_field(tx, index, &field, &value, 1), 0);
+  return field.label;
+}
+
+static void test_parse_fields(void **state) {
+  (void)state;
+  tx_field_t field;
+  char buffer[6];
+
+  tmp_ctx.signing_context.buffer_used =
+      load_testcase("../testcases/multiple_actions_transaction.raw",
+                    tmp_ctx.signing_context.buffer);
+  tx_span_t tx = {tmp_ctx.signing_context.buffer,
+                  tmp_ctx.signing_context.buffer_used};
+
+  // Every action is shown, not only "multiple actions"
+  assert_int_equal(parse_transaction_field_count(tx), 8);
+  assert_int_equal(parse_transaction_flow(tx), SIGN_FLOW_GENERIC);
+  assert_field(tx, 0, TX_FIELD_ACTION, 0, "multiple actions");
+  assert_string_equal(field_label(tx, 0), "Confirm");
+  assert_field(tx, 1, TX_FIELD_RECEIVER, 0, "receiver.here");
+  assert_field(tx, 2, TX_FIELD_SIGNER, 0, "vg");
+  assert_field(tx, 3, TX_FIELD_ACTION, 1, "method_name");
+  assert_string_equal(field_label(tx, 3), "Action");
+  assert_field(tx, 4, TX_FIELD_DEPOSIT, 1, "10");
+  assert_field(tx, 5, TX_FIELD_ARGS, 1, "{\"args\":\"here\"}");
+  assert_field(tx, 6, TX_FIELD_ACTION, 2, "transfer");
+  assert_field(tx, 7, TX_FIELD_AMOUNT, 2, "0.000000000000000000000001");
+  assert_int_equal(parse_transaction_field(tx, 8, &field, buffer, 1),
+                   SIGN_PARSING_ERROR);
+
+  // Cut to the buffer given
+  assert_int_equal(
+      parse_transaction_field(tx, 1, &field, buffer, sizeof(buffer)), 0);
+  assert_string_equal(buffer, "re...");
+
+  // Cut in the transfer: the fields before it can still be shown, but not
+  // the whole review
+  tx.size = 0xa8;
+  assert_int_equal(parse_transaction_field_count(tx), SIGN_PARSING_ERROR);
+  assert_int_equal(parse_transaction_flow(tx), SIGN_PARSING_ERROR);
+  assert_field(tx, 5, TX_FIELD_ARGS, 1, "{\"args\":\"here\"}");
+
+  // One action: the fields of its flow, in order
+  tmp_ctx.signing_context.buffer_used =
+      load_testcase("../testcases/function_call_transaction.raw",
+                    tmp_ctx.signing_context.buffer);
+  tx.size = tmp_ctx.signing_context.buffer_used;
+  assert_int_equal(parse_transaction_field_count(tx), 5);
+  assert_int_equal(parse_transaction_flow(tx), SIGN_FLOW_FUNCTION_CALL);
+  assert_field(tx, 0, TX_FIELD_ACTION, 0, "method_name");
+  assert_field(tx, 1, TX_FIELD_DEPOSIT, 0, "10");
+  assert_field(tx, 2, TX_FIELD_RECEIVER, 0, "receiver.here");
+  assert_field(tx, 3, TX_FIELD_SIGNER, 0, "vg");
+  assert_field(tx, 4, TX_FIELD_ARGS, 0, "{\"args\":\"here\"}");
+  assert_string_equal(field_label(tx, 1), "Deposit");
+}
+
+static void test_template_delta(void **state) {
+  (void)state;
+  uint32_t nonce_offset, block_hash_offset, deposit_offset;
+  uint8_t delta[8 + 32 + 16];
+  // 0.1234 NEAR in yoctoNEAR
+  const uint8_t deposit[16] = {0x00, 0x00, 0x20, 0x83, 0xc7, 0xf6,
+                               0x03, 0x87, 0x21, 0x1a};
+
+  tmp_ctx.signing_context.buffer_used =
+      load_testcase("../testcases/transfer_1_transaction.raw",
+                    tmp_ctx.signing_context.buffer);
+  tx_span_t tx = {tmp_ctx.signing_context.buffer,
+                  tmp_ctx.signing_context.buffer_used};
+  assert_int_equal(parse_transaction_template(tx, &nonce_offset,
+                                              &block_hash_offset,
+                                              &deposit_offset),
+                   0);
+  assert_field(tx, 1, TX_FIELD_AMOUNT, 0, "0.002");
+
+  // The review shows the deposit signed, not that of the template
+  memset(delta, 0x11, 8);
+  memset(delta + 8, 0x22, 32);
+  memcpy(delta + 8 + 32, deposit, sizeof(deposit));
+  apply_template_delta(tmp_ctx.signing_context.buffer, nonce_offset,
+                       block_hash_offset, deposit_offset, delta);
+  assert_memory_equal(tx.data + nonce_offset, delta, 8);
+  assert_memory_equal(tx.data + block_hash_offset, delta + 8, 32);
+  assert_field(tx, 1, TX_FIELD_AMOUNT, 0, "0.1234");
+  assert_field(tx, 2, TX_FIELD_RECEIVER, 0, "vg");
+}
+
+static uint8_t lz_output[2048];
+static size_t lz_output_size;
+
+static bool lz_sink(const uint8_t *data, size_t length) {
+  assert_true(length <= sizeof(lz_output) - lz_output_size);
+  memcpy(lz_output + lz_output_size, data, length);
+  lz_output_size += length;
+  return true;
+}
+
+static bool lz_refusing_sink(const uint8_t *data, size_t length) {
+  (void)data;
+  (void)length;
+  return false;
+}
+
+static int lz_decode(const uint8_t *input, size_t size, size_t chunk) {
+  lz_stream_t stream;
+
+  lz_stream_init(&stream);
+  lz_output_size = 0;
+  for (size_t pos = 0; pos < size; pos += chunk) {
+    size_t length = size - pos < chunk ? size - pos : chunk;
+    if (lz_stream_decode(&stream, input + pos, length, lz_sink) != 0) {
+      return -1;
+    }
+  }
+  return lz_stream_end(&stream);
+}
+
+static void test_lz_stream(void **state) {
+  (void)state;
+  static const size_t chunks[] = {1, 2, 3, 5, 7, 255, 2048};
+  uint8_t input[512], expected[2048];
+  size_t size = 0, expected_size = 0;
+
+  // 300 literals, then a 1000 byte match reaching the whole window back
+  input[size++] = 0xf0 | 15;
+  input[size++] = 255;
+  input[size++] = 300 - 15 - 255;
+  for (int i = 0; i < 300; i++) {
+    input[size++] = expected[expected_size++] = (uint8_t)(i * 7);
+  }
+  input[size++] = LZ_WINDOW_SIZE & 0xff;
+  input[size++] = LZ_WINDOW_SIZE >> 8;
+  for (int length = 1000 - 4 - 15; length >= 0; length -= 255) {
+    input[size++] = length >= 255 ? 255 : length;
+  }
+  for (int i = 0; i < 1000; i++, expected_size++) {
+    expected[expected_size] = expected[expected_size - LZ_WINDOW_SIZE];
+  }
+  // A match overlapping its own output, then the last literals
+  memcpy(input + size, "\x13x\x01\x00\x20yz", 7);
+  size += 7;
+  memcpy(expected + expected_size, "xxxxxxxxyz", 10);
+  expected_size += 10;
+
+  for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+    assert_int_equal(lz_decode(input, size, chunks[i]), 0);
+    assert_int_equal(lz_output_size, expected_size);
+    assert_memory_equal(lz_output, expected, expected_size);
+  }
+
+  // Truncated in the last literals, and in a match length
+  assert_int_equal(lz_decode(input, size - 1, 3), -1);
+  assert_int_equal(lz_decode(input, 306, 3), -1);
+
+  // Offsets of zero, past the start of the output and past the window
+  assert_int_equal(lz_decode((const uint8_t *)"\x10" "a\x00\x00", 4, 1), -1);
+  assert_int_equal(lz_decode((const uint8_t *)"\x10" "a\x02\x00", 4, 1), -1);
+  input[303] = (LZ_WINDOW_SIZE + 1) & 0xff;
+  input[304] = (LZ_WINDOW_SIZE + 1) >> 8;
+  assert_int_equal(lz_decode(input, size, 255), -1);
+
+  // A sink refusing the output stops decoding
+  lz_stream_t stream;
+  lz_stream_init(&stream);
+  assert_int_equal(lz_stream_decode(&stream, (const uint8_t *)"\x10" "a", 2,
+                                    lz_refusing_sink),
+                   -1);
+}
+
 int main() {
   const struct CMUnitTest tests[] = {
       cmocka_unit_test(test_parse_transfer_1),
@@ -247,6 +593,13 @@ int main() {
       cmocka_unit_test(test_parse_delete_key),
       cmocka_unit_test(test_parse_delete_account),
       cmocka_unit_test(test_parse_multiple_actions),
+      cmocka_unit_test(test_parse_span),
+      cmocka_unit_test(test_parse_template),
+      cmocka_unit_test(test_parse_receiver),
+      cmocka_unit_test(test_parse_fields),
+      cmocka_unit_test(test_template_delta),
+      cmocka_unit_test(test_parse_corpus),
+      cmocka_unit_test(test_lz_stream),
   };
   return cmocka_run_group_tests(tests, NULL, NULL);
 }
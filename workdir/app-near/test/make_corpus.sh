@@ -0,0 +1,16 @@
+#!/usr/bin/env bash
+
+# Regenerates testcases/corpus.bin from testcases/*.raw and their Borsh
+# mutations, recording what the current parser outputs for each of them.
+# Review the change with `pack_corpus -d` on the old and new file before
+# committing it. Usage: ./make_corpus.sh <build dir>
+
+SCRIPTDIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" >/dev/null 2>&1 && pwd )"
+BUILDDIR="$( cd "${1:-$SCRIPTDIR/build}" && pwd )" || exit
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+
+"$BUILDDIR"/fuzz_corpus -n 64 "$WORKDIR" "$SCRIPTDIR"/testcases/*.raw || exit
+cd "$WORKDIR" || exit
+# shellcheck disable=SC2046
+"$BUILDDIR"/pack_corpus "$SCRIPTDIR"/testcases/corpus.bin $(LC_ALL=C ls)
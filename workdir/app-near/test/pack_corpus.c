@@ -0,0 +1,157 @@
+// Packs transactions into a corpus file (see corpus.h), recording what the
+// current parser makes of each of them, or dumps a corpus file as text so
+// that changes to the expected outputs can be reviewed with diff.
+//
+// Usage: pack_corpus <corpus.bin> <transaction>...
+//        pack_corpus -d <corpus.bin>
+
+#include "constants.h"
+#include "context.h"
+#include "corpus.h"
+#include "parse_transaction.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+tmpContext_t tmp_ctx;
+uiContext_t ui_context;
+
+static void write_u32(FILE *f, uint32_t n) {
+  uint8_t bytes[4] = {n, n >> 8, n >> 16, n >> 24};
+  fwrite(bytes, 1, sizeof(bytes), f);
+}
+
+static uint64_t fnv1a(const uint8_t *data, size_t size) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ data[i]) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static int pack(const char *corpus, int count, char **paths) {
+  static uint8_t transaction[MAX_DATA_SIZE];
+  uint64_t *hashes = calloc(count, sizeof(uint64_t));
+  uint32_t records = 0;
+  FILE *out = fopen(corpus, "wb");
+
+  if (out == NULL || hashes == NULL) {
+    perror(corpus);
+    return 1;
+  }
+  fwrite(CORPUS_MAGIC, 1, CORPUS_MAGIC_SIZE, out);
+  write_u32(out, 0);
+
+  for (int i = 0; i < count; i++) {
+    FILE *in = fopen(paths[i], "rb");
+    char *fields[CORPUS_FIELD_COUNT];
+    size_t size;
+    int duplicate = 0;
+
+    if (in == NULL) {
+      perror(paths[i]);
+      return 1;
+    }
+    size = fread(transaction, 1, sizeof(transaction), in);
+    fclose(in);
+
+    hashes[records] = fnv1a(transaction, size);
+    for (uint32_t j = 0; j < records && !duplicate; j++) {
+      duplicate = hashes[j] == hashes[records];
+    }
+    if (duplicate) {
+      continue;
+    }
+
+    memset(&ui_context, 0, sizeof(ui_context));
+    memcpy(tmp_ctx.signing_context.buffer, transaction, size);
+    tmp_ctx.signing_context.buffer_used = size;
+    int8_t flow = parse_transaction();
+
+    uint8_t record_header[3] = {size, size >> 8, flow};
+    fwrite(record_header, 1, sizeof(record_header), out);
+    fwrite(transaction, 1, size, out);
+    corpus_ui_fields(&ui_context, fields);
+    for (int field = 0; field < CORPUS_FIELD_COUNT; field++) {
+      uint8_t len = strlen(fields[field]);
+      fwrite(&len, 1, 1, out);
+      fwrite(fields[field], 1, len, out);
+    }
+    records++;
+  }
+
+  fseek(out, CORPUS_MAGIC_SIZE, SEEK_SET);
+  write_u32(out, records);
+  if (fclose(out) != 0) {
+    perror(corpus);
+    return 1;
+  }
+  free(hashes);
+  printf("%u transactions packed into %s\n", records, corpus);
+  return 0;
+}
+
+static int dump(const char *corpus) {
+  FILE *in = fopen(corpus, "rb");
+  uint8_t header[CORPUS_HEADER_SIZE];
+  uint8_t buffer[MAX_DATA_SIZE];
+  uint32_t records;
+
+  if (in == NULL) {
+    perror(corpus);
+    return 1;
+  }
+  if (fread(header, 1, sizeof(header), in) != sizeof(header) ||
+      memcmp(header, CORPUS_MAGIC, CORPUS_MAGIC_SIZE) != 0) {
+    fprintf(stderr, "%s: not a corpus file\n", corpus);
+    return 1;
+  }
+  records = header[8] | header[9] << 8 | header[10] << 16 | (uint32_t)header[11] << 24;
+
+  for (uint32_t i = 0; i < records; i++) {
+    uint8_t record_header[3];
+    uint16_t size;
+
+    if (fread(record_header, 1, sizeof(record_header), in) != sizeof(record_header)) {
+      fprintf(stderr, "%s: truncated at record %u\n", corpus, i);
+      return 1;
+    }
+    size = record_header[0] | record_header[1] << 8;
+    if (size > sizeof(buffer) || fread(buffer, 1, size, in) != size) {
+      fprintf(stderr, "%s: truncated at record %u\n", corpus, i);
+      return 1;
+    }
+    printf("%u: flow %d, %u bytes ", i, (int8_t)record_header[2], size);
+    for (uint16_t j = 0; j < size; j++) {
+      printf("%02x", buffer[j]);
+    }
+    printf("\n");
+    for (int field = 0; field < CORPUS_FIELD_COUNT; field++) {
+      int len = fgetc(in);
+      if (len == EOF || fread(buffer, 1, len, in) != (size_t)len) {
+        fprintf(stderr, "%s: truncated at record %u\n", corpus, i);
+        return 1;
+      }
+      printf("  %s: ", corpus_field_names[field]);
+      for (int j = 0; j < len; j++) {
+        printf(buffer[j] >= ' ' && buffer[j] < 0x7f && buffer[j] != '\\' ? "%c" : "\\x%02x", buffer[j]);
+      }
+      printf("\n");
+    }
+  }
+  fclose(in);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc == 3 && strcmp(argv[1], "-d") == 0) {
+    return dump(argv[2]);
+  }
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s <corpus.bin> <transaction>...\n       %s -d <corpus.bin>\n", argv[0], argv[0]);
+    return 1;
+  }
+  return pack(argv[1], argc - 2, argv + 2);
+}
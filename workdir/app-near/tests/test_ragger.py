@@ -1,11 +1,12 @@
 from pathlib import Path
-from typing import Optional, Generator
+from typing import Optional, Generator, List, Tuple
 from dataclasses import dataclass
 from contextlib import contextmanager
 from ragger.backend import RaisePolicy
 from ragger.backend.interface import RAPDU, BackendInterface
 from ragger.navigator import NavInsID, NavIns
 from utils import get_version_from_makefile
+from utils.lz4_block import compress
 
 ROOT_SCREENSHOT_PATH = Path(__file__).parent.resolve()
 
@@ -17,6 +18,15 @@ INS_SIGN = 0x02
 INS_GET_PUBKEY = 0x04
 INS_GET_WALLET_ID = 0x05
 INS_GET_APP_CONFIGURATION = 0x06
+INS_SIGN_TEMPLATE = 0x07
+INS_SIGN_DELTA = 0x08
+INS_SIGN_RESUME = 0x09
+INS_GET_CAPABILITIES = 0x0A
+INS_RESET = 0x0B
+INS_PARSE_TRANSACTION = 0x0C
+INS_GET_PENDING_STATUS = 0x0D
+INS_SET_REVIEW_TIMEOUT = 0x0E
+INS_TRUSTED_RECEIVER = 0x0F
 
 
 # Parameter 1 for first APDU number.
@@ -27,12 +37,21 @@ P1_CONFIRM = 0x00
 P1_NO_CONFIRM = 0x01
 # Parameter 1 for more APDU to receive.
 P1_MORE = 0x80
+# Parameter 1 for the last APDU of a transaction.
+P1_LAST = 0x80
+# Parameter 1 flag for a transaction sent compressed.
+P1_COMPRESSED = 0x01
+# Parameter 1 flag for chunks numbered in parameter 2.
+P1_SEQUENCED = 0x02
 # Parameter not used for this APDU
 P1_P2_NOT_USED = 0x57
 
 # Return codes
 SW_OK                       = 0x9000
 SW_CONDITIONS_NOT_SATISFIED = 0x6985
+SW_INVALID_DATA             = 0x6A80
+SW_WRONG_SEQUENCE           = 0x6A88
+SW_BUFFER_OVERFLOW          = 0x6990
 
 # m/44'/397'/0'/0'/1
 DERIV_PATH_DATA = bytes.fromhex('8000002c8000018d800000008000000080000001')
@@ -45,6 +64,33 @@ class Nearbackend():
     def get_version(self) -> RAPDU:
         return self.backend.exchange(CLA, INS_GET_APP_CONFIGURATION, P1_P2_NOT_USED, P1_P2_NOT_USED, bytes())
 
+    def get_capabilities(self) -> dict:
+        """Capability block, as a dict of tag to value"""
+        data = self.backend.exchange(CLA, INS_GET_CAPABILITIES, P1_P2_NOT_USED, P1_P2_NOT_USED, bytes()).data
+        capabilities = {}
+        while data:
+            tag, length = data[0], data[1]
+            capabilities[tag] = data[2:2 + length]
+            data = data[2 + length:]
+        return capabilities
+
+    def get_pending_status(self) -> int:
+        """Review waiting for the user: 0 none, 1 signature, 2 public key, 3 wallet id"""
+        return self.backend.exchange(CLA, INS_GET_PENDING_STATUS, P1_P2_NOT_USED, P1_P2_NOT_USED, bytes()).data[0]
+
+    def set_review_timeout(self, seconds: int) -> RAPDU:
+        return self.backend.exchange(CLA, INS_SET_REVIEW_TIMEOUT, P1_P2_NOT_USED, P1_P2_NOT_USED,
+                                     seconds.to_bytes(2, "big"))
+
+    @contextmanager
+    def set_trusted_receiver(self, account_id: str, trusted: bool) -> Generator[None, None, None]:
+        with self.backend.exchange_async(CLA, INS_TRUSTED_RECEIVER, 0x00 if trusted else 0x01, P1_P2_NOT_USED,
+                                         account_id.encode()) as response:
+            yield response
+
+    def reset(self) -> RAPDU:
+        return self.backend.exchange(CLA, INS_RESET, P1_P2_NOT_USED, P1_P2_NOT_USED, bytes())
+
     @contextmanager
     def sign_message(self, path: bytes, near_transaction: bytes) -> Generator[None, None, None]:
         cnt = 0
@@ -69,6 +115,51 @@ class Nearbackend():
             cnt += to_send
 
 
+    @contextmanager
+    def sign_message_compressed(self, path: bytes, near_transaction: bytes) -> Generator[None, None, None]:
+        data = path + compress(near_transaction)
+        chunks = [data[i:i + 255] for i in range(0, len(data), 255)]
+        for chunk in chunks[:-1]:
+            rapdu = self.backend.exchange(CLA, INS_SIGN, P1_START | P1_COMPRESSED, P1_P2_NOT_USED, chunk)
+            assert rapdu.status == SW_OK
+        with self.backend.exchange_async(CLA,
+                                         INS_SIGN,
+                                         P1_LAST | P1_COMPRESSED,
+                                         P1_P2_NOT_USED,
+                                         chunks[-1]) as response:
+            yield response
+
+    def sign_resume(self) -> Tuple[bool, int, int]:
+        """Whether an upload is in progress, the number of its next chunk and the bytes taken after the path"""
+        rapdu = self.backend.exchange(CLA, INS_SIGN_RESUME, P1_P2_NOT_USED, P1_P2_NOT_USED, bytes())
+        return bool(rapdu.data[0]), rapdu.data[1], int.from_bytes(rapdu.data[2:6], "big")
+
+    def parse_transaction(self, path: bytes, near_transaction: bytes) -> List[Tuple[int, bytes]]:
+        """Review fields of the transaction, as a list of tag and value, without signing it"""
+        data = path + near_transaction
+        chunks = [data[i:i + 255] for i in range(0, len(data), 255)]
+        for chunk in chunks[:-1]:
+            rapdu = self.backend.exchange(CLA, INS_PARSE_TRANSACTION, P1_START, P1_P2_NOT_USED, chunk)
+            assert rapdu.status == SW_OK
+        data = self.backend.exchange(CLA, INS_PARSE_TRANSACTION, P1_LAST, P1_P2_NOT_USED, chunks[-1]).data
+        fields = []
+        while data:
+            tag, length = data[0], data[1]
+            fields.append((tag, data[2:2 + length]))
+            data = data[2 + length:]
+        return fields
+
+    def set_sign_template(self, path: bytes, near_transaction: bytes) -> RAPDU:
+        return self.backend.exchange(CLA, INS_SIGN_TEMPLATE, P1_P2_NOT_USED, P1_P2_NOT_USED, path + near_transaction)
+
+    @contextmanager
+    def sign_delta(self, nonce: int, block_hash: bytes, deposit: Optional[int] = None) -> Generator[None, None, None]:
+        data = nonce.to_bytes(8, "little") + block_hash
+        if deposit is not None:
+            data += deposit.to_bytes(16, "little")
+        with self.backend.exchange_async(CLA, INS_SIGN_DELTA, P1_P2_NOT_USED, P1_P2_NOT_USED, data) as response:
+            yield response
+
     @contextmanager
     def get_public_key_with_confirmation(self, path: bytes) -> Generator[None, None, None]:
         with self.backend.exchange_async(CLA,
@@ -115,6 +206,45 @@ def test_app_configuration(backend):
     assert (version[0], version[1], version[2]) == get_version_from_makefile()
 
 
+# In this test we check the capability block, and that INS_RESET drops an upload
+def test_app_capabilities(firmware, backend):
+    client = Nearbackend(backend)
+    capabilities = client.get_capabilities()
+    assert tuple(capabilities[0x01]) == get_version_from_makefile()
+    assert capabilities[0x02] == bytes([255])
+    assert int.from_bytes(capabilities[0x03], "big") == 650
+    # compressed, sequenced, template, code streaming, parse
+    assert int.from_bytes(capabilities[0x04], "big") == 0x002F
+    assert int.from_bytes(capabilities[0x05], "big") == (256 if firmware.device == "nanos" else 1024)
+    assert capabilities[0x09] == bytes([16])
+
+    rapdu = client.backend.exchange(CLA, INS_SIGN, P1_START | P1_SEQUENCED, 0, DERIV_PATH_DATA + bytes(10))
+    assert rapdu.status == SW_OK
+    # Capabilities leave the upload alone, INS_RESET drops it
+    client.get_capabilities()
+    assert client.sign_resume() == (True, 1, 10)
+    assert client.reset().status == SW_OK
+    assert client.sign_resume() == (False, 0, 0)
+    assert client.get_pending_status() == 0
+
+
+# In this test we check that the review timeout is kept and reported
+def test_review_timeout_setting(backend):
+    client = Nearbackend(backend)
+    assert int.from_bytes(client.get_capabilities()[0x08], "big") == 0
+    assert client.set_review_timeout(90).status == SW_OK
+    assert int.from_bytes(client.get_capabilities()[0x08], "big") == 90
+    # Too short to read a review: refused, the setting is kept
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+    assert client.set_review_timeout(9).status == SW_INVALID_DATA
+    backend.raise_policy = RaisePolicy.RAISE_ALL_BUT_0x9000
+    assert int.from_bytes(client.get_capabilities()[0x08], "big") == 90
+    assert client.set_review_timeout(10).status == SW_OK
+    assert int.from_bytes(client.get_capabilities()[0x08], "big") == 10
+    assert client.set_review_timeout(0).status == SW_OK
+    assert int.from_bytes(client.get_capabilities()[0x08], "big") == 0
+
+
 ####################### INFO MENU TEST ##########################
 # In this test we check the behavior of the device info menu
 def test_app_info_menu(firmware, navigator, test_name):
@@ -394,6 +524,198 @@ def test_sign_transfer(firmware, backend, navigator, test_name):
     generic_test_sign(backend, firmware, navigator, test_name, near_payload, expected_signature)
 
 
+def test_sign_transfer_compressed(firmware, backend, navigator):
+    """
+    test_sign_transfer uploaded with P1_COMPRESSED: same screens, same signature
+    """
+    near_payload = bytes.fromhex(
+        "12000000626c61626c61746573742e746573746e657400c4f5941e81e071c2fd1dae2e71fd3d859d462484391d9a90bf219211dcbb320f0f7ac5e5c85700001000000073706563756c6f732e746573746e6574a3f5d1167a5c605fed71fc78d4381bef47a5acb3aba6fc9c07d7b8b912fc1e2a010000000300002083c7f60387211a000000000000")
+    expected_signature = bytes.fromhex(
+        "e22eea0ee27a2d8e0bdfc72fb6337492d10a78aec15ff3cb6126b2944af920863e0907d5462bf2822a6bb0a62f1bb594e899ac96db7e95386895e91f325c460c")
+    client = Nearbackend(backend)
+
+    # Reset cx context
+    client.get_version()
+
+    with client.sign_message_compressed(DERIV_PATH_DATA, near_payload):
+        if firmware.device.startswith("nano"):
+            navigator.navigate_until_text(NavInsID.RIGHT_CLICK,
+                                          [NavInsID.BOTH_CLICK],
+                                          "Approve",
+                                          screen_change_after_last_instruction = False)
+        else:
+            navigator.navigate_until_text(NavInsID.USE_CASE_REVIEW_TAP,
+                                          [NavInsID.USE_CASE_REVIEW_CONFIRM,
+                                          NavInsID.USE_CASE_STATUS_DISMISS,
+                                          NavInsID.WAIT_FOR_HOME_SCREEN],
+                                          "Hold to sign",
+                                          screen_change_after_last_instruction = False)
+    response = client.get_async_response()
+    assert response.status == SW_OK
+    assert response.data == expected_signature
+
+
+def test_sign_transfer_template(firmware, backend, navigator):
+    """
+    test_sign_transfer as a template with a zero nonce, block hash and deposit,
+    then signed by sending only these
+    """
+    template = bytes.fromhex(
+        "12000000626c61626c61746573742e746573746e657400c4f5941e81e071c2fd1dae2e71fd3d859d462484391d9a90bf219211dcbb320f0000000000000000"
+        "1000000073706563756c6f732e746573746e65740000000000000000000000000000000000000000000000000000000000000000"
+        "010000000300000000000000000000000000000000")
+    expected_signature = bytes.fromhex(
+        "e22eea0ee27a2d8e0bdfc72fb6337492d10a78aec15ff3cb6126b2944af920863e0907d5462bf2822a6bb0a62f1bb594e899ac96db7e95386895e91f325c460c")
+    client = Nearbackend(backend)
+
+    rapdu = client.set_sign_template(DERIV_PATH_DATA, template)
+    assert rapdu.status == SW_OK
+    # nonce, block hash and deposit
+    assert rapdu.data == bytes([8 + 32 + 16])
+
+    with client.sign_delta(96520360000015,
+                           bytes.fromhex("a3f5d1167a5c605fed71fc78d4381bef47a5acb3aba6fc9c07d7b8b912fc1e2a"),
+                           123400000000000000000000):
+        if firmware.device.startswith("nano"):
+            navigator.navigate_until_text(NavInsID.RIGHT_CLICK,
+                                          [NavInsID.BOTH_CLICK],
+                                          "Approve",
+                                          screen_change_after_last_instruction = False)
+        else:
+            navigator.navigate_until_text(NavInsID.USE_CASE_REVIEW_TAP,
+                                          [NavInsID.USE_CASE_REVIEW_CONFIRM,
+                                          NavInsID.USE_CASE_STATUS_DISMISS,
+                                          NavInsID.WAIT_FOR_HOME_SCREEN],
+                                          "Hold to sign",
+                                          screen_change_after_last_instruction = False)
+    response = client.get_async_response()
+    assert response.status == SW_OK
+    assert response.data == expected_signature
+
+
+def test_sign_transfer_resume(firmware, backend, navigator):
+    """
+    test_sign_transfer in numbered chunks, continued from what the device reports
+    """
+    near_payload = bytes.fromhex(
+        "12000000626c61626c61746573742e746573746e657400c4f5941e81e071c2fd1dae2e71fd3d859d462484391d9a90bf219211dcbb320f0f7ac5e5c85700001000000073706563756c6f732e746573746e6574a3f5d1167a5c605fed71fc78d4381bef47a5acb3aba6fc9c07d7b8b912fc1e2a010000000300002083c7f60387211a000000000000")
+    expected_signature = bytes.fromhex(
+        "e22eea0ee27a2d8e0bdfc72fb6337492d10a78aec15ff3cb6126b2944af920863e0907d5462bf2822a6bb0a62f1bb594e899ac96db7e95386895e91f325c460c")
+    client = Nearbackend(backend)
+
+    # Reset cx context
+    client.get_version()
+    assert client.sign_resume() == (False, 0, 0)
+
+    rapdu = client.backend.exchange(CLA, INS_SIGN, P1_START | P1_SEQUENCED, 0, DERIV_PATH_DATA + near_payload[:80])
+    assert rapdu.status == SW_OK
+
+    # Out of sequence chunks are refused without losing the upload
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+    rapdu = client.backend.exchange(CLA, INS_SIGN, P1_START | P1_SEQUENCED, 2, near_payload[80:100])
+    assert rapdu.status == SW_WRONG_SEQUENCE
+    backend.raise_policy = RaisePolicy.RAISE_ALL_BUT_0x9000
+
+    uploading, sequence, received = client.sign_resume()
+    assert (uploading, sequence, received) == (True, 1, 80)
+
+    with client.backend.exchange_async(CLA, INS_SIGN, P1_LAST | P1_SEQUENCED, sequence,
+                                       near_payload[received:]):
+        if firmware.device.startswith("nano"):
+            navigator.navigate_until_text(NavInsID.RIGHT_CLICK,
+                                          [NavInsID.BOTH_CLICK],
+                                          "Approve",
+                                          screen_change_after_last_instruction = False)
+        else:
+            navigator.navigate_until_text(NavInsID.USE_CASE_REVIEW_TAP,
+                                          [NavInsID.USE_CASE_REVIEW_CONFIRM,
+                                          NavInsID.USE_CASE_STATUS_DISMISS,
+                                          NavInsID.WAIT_FOR_HOME_SCREEN],
+                                          "Hold to sign",
+                                          screen_change_after_last_instruction = False)
+    response = client.get_async_response()
+    assert response.status == SW_OK
+    assert response.data == expected_signature
+    assert client.sign_resume() == (False, 0, 0)
+
+
+def test_parse_transfer(backend):
+    """
+    test_sign_transfer parsed without review or signature
+    """
+    near_payload = bytes.fromhex(
+        "12000000626c61626c61746573742e746573746e657400c4f5941e81e071c2fd1dae2e71fd3d859d462484391d9a90bf219211dcbb320f0f7ac5e5c85700001000000073706563756c6f732e746573746e6574a3f5d1167a5c605fed71fc78d4381bef47a5acb3aba6fc9c07d7b8b912fc1e2a010000000300002083c7f60387211a000000000000")
+    client = Nearbackend(backend)
+
+    assert client.parse_transaction(DERIV_PATH_DATA, near_payload) == [
+        (0x01, bytes([1])),
+        (0x02, b"transfer"),
+        (0x05, b"0.1234"),
+        (0x03, b"speculos.testnet"),
+        (0x04, b"blablatest.testnet"),
+    ]
+
+    # Malformed transactions fail as INS_SIGN would, without a review
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+    rapdu = client.backend.exchange(CLA, INS_PARSE_TRANSACTION, P1_LAST, P1_P2_NOT_USED,
+                                    DERIV_PATH_DATA + near_payload[:-3])
+    assert rapdu.status == SW_BUFFER_OVERFLOW
+
+    # An upload to parse cannot be finished as one to sign
+    rapdu = client.backend.exchange(CLA, INS_PARSE_TRANSACTION, P1_START, P1_P2_NOT_USED,
+                                    DERIV_PATH_DATA + near_payload[:50])
+    assert rapdu.status == SW_OK
+    rapdu = client.backend.exchange(CLA, INS_SIGN, P1_LAST, P1_P2_NOT_USED, near_payload[50:])
+    assert rapdu.status == SW_CONDITIONS_NOT_SATISFIED
+    backend.raise_policy = RaisePolicy.RAISE_ALL_BUT_0x9000
+    client.reset()
+
+
+def approve_trusted_receiver(firmware, navigator):
+    if firmware.device.startswith("nano"):
+        navigator.navigate_until_text(NavInsID.RIGHT_CLICK,
+                                      [NavInsID.BOTH_CLICK],
+                                      "Approve",
+                                      screen_change_after_last_instruction = False)
+    else:
+        navigator.navigate([NavInsID.USE_CASE_CHOICE_CONFIRM,
+                            NavInsID.USE_CASE_STATUS_DISMISS],
+                           screen_change_after_last_instruction = False)
+
+
+def test_sign_transfer_trusted_receiver(firmware, backend, navigator):
+    """
+    test_sign_transfer once its receiver is trusted: one page, same signature
+    """
+    near_payload = bytes.fromhex(
+        "12000000626c61626c61746573742e746573746e657400c4f5941e81e071c2fd1dae2e71fd3d859d462484391d9a90bf219211dcbb320f0f7ac5e5c85700001000000073706563756c6f732e746573746e6574a3f5d1167a5c605fed71fc78d4381bef47a5acb3aba6fc9c07d7b8b912fc1e2a010000000300002083c7f60387211a000000000000")
+    expected_signature = bytes.fromhex(
+        "e22eea0ee27a2d8e0bdfc72fb6337492d10a78aec15ff3cb6126b2944af920863e0907d5462bf2822a6bb0a62f1bb594e899ac96db7e95386895e91f325c460c")
+    client = Nearbackend(backend)
+
+    with client.set_trusted_receiver("speculos.testnet", True):
+        approve_trusted_receiver(firmware, navigator)
+    assert client.get_async_response().status == SW_OK
+
+    with client.sign_message(DERIV_PATH_DATA, near_payload):
+        if firmware.device.startswith("nano"):
+            navigator.navigate_until_text(NavInsID.RIGHT_CLICK,
+                                          [NavInsID.BOTH_CLICK],
+                                          "Approve",
+                                          screen_change_after_last_instruction = False)
+        else:
+            navigator.navigate([NavInsID.USE_CASE_CHOICE_CONFIRM,
+                                NavInsID.USE_CASE_STATUS_DISMISS],
+                               screen_change_after_last_instruction = False)
+    response = client.get_async_response()
+    assert response.status == SW_OK
+    assert response.data == expected_signature
+
+    with client.set_trusted_receiver("speculos.testnet", False):
+        approve_trusted_receiver(firmware, navigator)
+    assert client.get_async_response().status == SW_OK
+
+
 def test_sign_function_call(firmware, backend, navigator, test_name):
     """
     Transaction {
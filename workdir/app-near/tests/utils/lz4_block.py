@@ -0,0 +1,65 @@
+"""Compressor for signing uploads with P1_COMPRESSED (see src/lz_stream.h).
+
+Produces the LZ4 block format with matches limited to `window` bytes back,
+which the device must be able to hold: 256 bytes on Nano S, 1024 on other
+devices. The default suits all of them.
+"""
+
+MIN_MATCH = 4
+NANOS_WINDOW = 256
+
+
+def _length(value: int) -> bytes:
+    out = bytearray()
+    while value >= 255:
+        out.append(255)
+        value -= 255
+    out.append(value)
+    return bytes(out)
+
+
+def _sequence(literals: bytes, offset: int = 0, match_length: int = 0) -> bytes:
+    lit_nibble = min(len(literals), 15)
+    match_nibble = min(match_length - MIN_MATCH, 15) if offset else 0
+    out = bytearray([lit_nibble << 4 | match_nibble])
+    if lit_nibble == 15:
+        out += _length(len(literals) - 15)
+    out += literals
+    if offset:
+        out += offset.to_bytes(2, "little")
+        if match_nibble == 15:
+            out += _length(match_length - MIN_MATCH - 15)
+    return bytes(out)
+
+
+def compress(data: bytes, window: int = NANOS_WINDOW, max_candidates: int = 64) -> bytes:
+    """Greedy compression, keeping the last `max_candidates` positions per 4 bytes."""
+    out = bytearray()
+    candidates = {}
+    anchor = 0
+    pos = 0
+    while pos + MIN_MATCH <= len(data):
+        key = data[pos:pos + MIN_MATCH]
+        best_length, best_offset = 0, 0
+        for start in reversed(candidates.get(key, [])):
+            if pos - start > window:
+                break
+            length = MIN_MATCH
+            while pos + length < len(data) and data[start + length] == data[pos + length]:
+                length += 1
+            if length > best_length:
+                best_length, best_offset = length, pos - start
+        candidates.setdefault(key, []).append(pos)
+        del candidates[key][:-max_candidates]
+        if best_length == 0:
+            pos += 1
+            continue
+        out += _sequence(data[anchor:pos], best_offset, best_length)
+        for skipped in range(pos + 1, min(pos + best_length, len(data) - MIN_MATCH + 1)):
+            chain = candidates.setdefault(data[skipped:skipped + MIN_MATCH], [])
+            chain.append(skipped)
+            del chain[:-max_candidates]
+        pos += best_length
+        anchor = pos
+    out += _sequence(data[anchor:])
+    return bytes(out)
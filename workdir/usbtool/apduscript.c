@@ -0,0 +1,122 @@
+/* Name: apduscript.c
+ * Project: usbtool
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt), GNU GPL v3 or proprietary (CommercialLicense.txt)
+ */
+
+/*
+General Description:
+Scripted APDU batches over one open device handle, see apduscript.h.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "ledgerhid.h"
+#include "apdutcp.h"
+#include "apduscript.h"
+#include "trace.h"
+
+#define LINE_SIZE   1024
+
+/* ------------------------------------------------------------------------- */
+
+double apduTime(void)
+{
+struct timeval  tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int apduParseHex(const char *text, unsigned char *out, int outMax)
+{
+unsigned int    byte;
+int             len = 0;
+
+    while(text[0] != 0){
+        if(len >= outMax || text[1] == 0 || sscanf(text, "%2x", &byte) != 1)
+            return -1;
+        out[len++] = byte;
+        text += 2;
+    }
+    return len;
+}
+
+int apduExchange(apduEndpoint_t *endpoint, const unsigned char *apdu, int apduLen, unsigned char *response, int responseMax, int timeout)
+{
+    if(endpoint->handle != NULL)
+        return ledgerHidExchange(endpoint->handle, apdu, apduLen, response, responseMax, timeout);
+    return apduTcpExchange(endpoint->fd, apdu, apduLen, response, responseMax, timeout);
+}
+
+/* ------------------------------------------------------------------------- */
+
+int apduScriptRun(apduEndpoint_t *endpoint, FILE *script, int timeout, FILE *out, FILE *traceFp)
+{
+char            line[LINE_SIZE], *hex, *expected;
+unsigned char   apdu[LEDGER_APDU_MAX], response[LEDGER_RESPONSE_MAX], swBytes[2];
+int             lineNo = 0, count = 0, failures = 0, apduLen, len, sw, expectedSw, i;
+int             newSession = 1;
+double          start, elapsed, total = 0, min = 0, max = 0, traceStart = apduTime();
+
+    if(traceFp != NULL)
+        traceWriteHeader(traceFp);
+    while(fgets(line, sizeof(line), script) != NULL){
+        lineNo++;
+        if((hex = strtok(line, " \t\r\n")) == NULL){
+            newSession = 1;
+            continue;
+        }
+        if(hex[0] == '#')
+            continue;
+        expected = strtok(NULL, " \t\r\n");
+        if((apduLen = apduParseHex(hex, apdu, sizeof(apdu))) < 5){
+            fprintf(stderr, "line %d: invalid APDU\n", lineNo);
+            return -1;
+        }
+        expectedSw = -1;
+        if(expected != NULL){
+            if(apduParseHex(expected, swBytes, sizeof(swBytes)) != 2){
+                fprintf(stderr, "line %d: invalid status word\n", lineNo);
+                return -1;
+            }
+            expectedSw = (swBytes[0] << 8) | swBytes[1];
+        }
+
+        start = apduTime();
+        len = apduExchange(endpoint, apdu, apduLen, response, sizeof(response), timeout);
+        elapsed = apduTime() - start;
+        if(traceFp != NULL)
+            traceWriteRecord(traceFp, newSession ? TRACE_FLAG_SESSION : 0, start - traceStart, elapsed, apdu, apduLen, response, len < 0 ? 0 : len);
+        newSession = 0;
+        total += elapsed;
+        if(count == 0 || elapsed < min)
+            min = elapsed;
+        if(elapsed > max)
+            max = elapsed;
+        count++;
+        if(len < 0){
+            fprintf(out, "%d error=%d time=%.2fms\n", lineNo, len, elapsed * 1000);
+            failures++;
+            continue;
+        }
+        sw = LEDGER_SW(response, len);
+
+        fprintf(out, "%d sw=0x%04x time=%.2fms data=", lineNo, sw, elapsed * 1000);
+        for(i = 0; i < len - 2; i++)
+            fprintf(out, "%02x", response[i]);
+        if(expectedSw >= 0 && sw != expectedSw){
+            fprintf(out, " FAILED expected=0x%04x", expectedSw);
+            failures++;
+        }
+        fprintf(out, "\n");
+        fflush(out);
+    }
+    if(count > 0)
+        fprintf(out, "apdus=%d failed=%d total=%.2fms avg=%.2fms min=%.2fms max=%.2fms\n", count, failures, total * 1000, total * 1000 / count, min * 1000, max * 1000);
+    return failures;
+}
+
+/* ------------------------------------------------------------------------- */
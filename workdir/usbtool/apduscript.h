@@ -0,0 +1,54 @@
+/* Name: apduscript.h
+ * Project: usbtool
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt), GNU GPL v3 or proprietary (CommercialLicense.txt)
+ */
+
+/*
+General Description:
+Runs scripted APDU batches against one device. Each script line holds one
+APDU in hex, optionally followed by the expected status word in hex:
+    8006000000 9000
+    e001000000
+Lines starting with '#' are ignored. Empty lines separate sessions, i.e.
+APDU sequences which depend on each other like the chunks of one signing
+request; they only matter when the run is recorded to a trace (see
+trace.h). Without an expected status word every reply is accepted.
+*/
+
+#ifndef __APDUSCRIPT_H_INCLUDED__
+#define __APDUSCRIPT_H_INCLUDED__
+
+#include <usb.h>    /* this is libusb, see http://libusb.sourceforge.net/ */
+#include <stdio.h>
+
+typedef struct apduEndpoint {
+    usb_dev_handle  *handle;    /* claimed Ledger HID device, see ledgerHidClaim() */
+    int             fd;         /* TCP connection if 'handle' is NULL, see apduTcpConnect() */
+} apduEndpoint_t;
+
+int apduExchange(apduEndpoint_t *endpoint, const unsigned char *apdu, int apduLen, unsigned char *response, int responseMax, int timeout);
+/* This function exchanges one APDU with 'endpoint', using ledgerHidExchange()
+ * or apduTcpExchange() depending on the transport.
+ * Returns: The length of the reply or a negative LEDGERHID_ERR_* code.
+ */
+
+int apduScriptRun(apduEndpoint_t *endpoint, FILE *script, int timeout, FILE *out, FILE *traceFp);
+/* This function sends every APDU of 'script' to 'endpoint' and prints one
+ * line per APDU to 'out' with the status word, the round trip time and the
+ * reply data, followed by a latency summary. 'timeout' is the USB timeout
+ * per report in milliseconds. If 'traceFp' is not NULL, every exchange is
+ * recorded to it in the format of trace.h.
+ * Returns: The number of APDUs which failed or did not get the expected
+ * status word, or -1 if the script is malformed.
+ */
+
+int apduParseHex(const char *text, unsigned char *out, int outMax);
+/* This function decodes the hex string 'text' into at most 'outMax' bytes.
+ * Returns: The number of bytes decoded or -1 on malformed or overlong input.
+ */
+
+double apduTime(void);
+/* Returns: Wall clock time in seconds, for latency measurements. */
+
+#endif /* __APDUSCRIPT_H_INCLUDED__ */
@@ -0,0 +1,125 @@
+/* Name: apdutcp.c
+ * Project: usbtool
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt), GNU GPL v3 or proprietary (CommercialLicense.txt)
+ */
+
+/*
+General Description:
+APDU transport over TCP, see apdutcp.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "ledgerhid.h"
+#include "apdutcp.h"
+
+/* ------------------------------------------------------------------------- */
+
+static int  readAll(int fd, unsigned char *buffer, int len)
+{
+int     n;
+
+    while(len > 0){
+        if((n = read(fd, buffer, len)) < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return -1;
+        buffer += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int  writeAll(int fd, const unsigned char *buffer, int len)
+{
+int     n;
+
+    while(len > 0){
+        if((n = write(fd, buffer, len)) < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return -1;
+        buffer += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int apduTcpConnect(const char *hostPort, FILE *warningsFp)
+{
+struct addrinfo hints, *result, *ai;
+char            host[256], *port;
+int             fd = -1, one = 1, rval;
+
+    if(strlen(hostPort) >= sizeof(host) || (port = strrchr(strcpy(host, hostPort), ':')) == NULL){
+        if(warningsFp != NULL)
+            fprintf(warningsFp, "invalid endpoint %s, expected host:port\n", hostPort);
+        return -1;
+    }
+    *port++ = 0;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if((rval = getaddrinfo(host, port, &hints, &result)) != 0){
+        if(warningsFp != NULL)
+            fprintf(warningsFp, "%s: %s\n", hostPort, gai_strerror(rval));
+        return -1;
+    }
+    for(ai = result; ai != NULL; ai = ai->ai_next){
+        if((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0)
+            continue;
+        if(connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    if(fd < 0){
+        if(warningsFp != NULL)
+            fprintf(warningsFp, "can't connect to %s: %s\n", hostPort, strerror(errno));
+        return -1;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));   /* one small frame per APDU */
+    return fd;
+}
+
+int apduTcpExchange(int fd, const unsigned char *apdu, int apduLen, unsigned char *response, int responseMax, int timeout)
+{
+unsigned char   frame[4 + LEDGER_APDU_MAX];
+struct timeval  tv;
+int             len;
+
+    if(apduLen > LEDGER_APDU_MAX)
+        return LEDGERHID_ERR_OVERFLOW;
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    frame[0] = apduLen >> 24;
+    frame[1] = apduLen >> 16;
+    frame[2] = apduLen >> 8;
+    frame[3] = apduLen;
+    memcpy(frame + 4, apdu, apduLen);
+    if(writeAll(fd, frame, 4 + apduLen) != 0 || readAll(fd, frame, 4) != 0)
+        return LEDGERHID_ERR_IO;
+    len = (frame[0] << 24 | frame[1] << 16 | frame[2] << 8 | frame[3]) + 2;
+    if(len < 2 || len > responseMax)
+        return LEDGERHID_ERR_OVERFLOW;
+    if(readAll(fd, response, len) != 0)
+        return LEDGERHID_ERR_IO;
+    return len;
+}
+
+/* ------------------------------------------------------------------------- */
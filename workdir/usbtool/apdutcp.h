@@ -0,0 +1,32 @@
+/* Name: apdutcp.h
+ * Project: usbtool
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt), GNU GPL v3 or proprietary (CommercialLicense.txt)
+ */
+
+/*
+General Description:
+APDU transport over TCP as spoken by the APDU port of the Speculos emulator
+and by the app's host emulator (emulator/ in the app). Each APDU is sent with
+a 4 byte big endian length prefix; the reply is the 4 byte big endian length
+of the reply data, the data and the 2 byte status word.
+*/
+
+#ifndef __APDUTCP_H_INCLUDED__
+#define __APDUTCP_H_INCLUDED__
+
+#include <stdio.h>
+
+int apduTcpConnect(const char *hostPort, FILE *warningsFp);
+/* This function connects to 'hostPort' ("host:port"). Errors are printed to
+ * 'warningsFp' if it is not NULL.
+ * Returns: The connected socket or -1 on error.
+ */
+
+int apduTcpExchange(int fd, const unsigned char *apdu, int apduLen, unsigned char *response, int responseMax, int timeout);
+/* This function is the TCP counterpart of ledgerHidExchange() and returns the
+ * same error codes. 'timeout' is the time in milliseconds to wait for the
+ * reply, 0 waits forever.
+ */
+
+#endif /* __APDUTCP_H_INCLUDED__ */
@@ -0,0 +1,328 @@
+/* Name: daemon.c
+ * Project: usbtool
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt), GNU GPL v3 or proprietary (CommercialLicense.txt)
+ */
+
+/*
+General Description:
+Persistent device daemon, see daemon.h. One thread polls the bus, one thread
+serves each client. The device table is guarded by 'tableLock', every device
+by its own mutex which is held for the duration of an exchange.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "opendevice.h"
+#include "ledgerhid.h"
+#include "apduscript.h"
+#include "daemon.h"
+
+#define LINE_SIZE           1024
+#define HOTPLUG_POLL_US     500000
+
+typedef struct daemonDevice {
+    usb_dev_handle  *handle;
+    int             present;
+    char            serial[USBOPEN_SERIAL_MAX];
+    char            path[32];   /* bus/device, unique while plugged in */
+    pthread_mutex_t lock;
+    unsigned long   apdus, errors;
+} daemonDevice_t;
+
+static daemonDevice_t   devices[DAEMON_MAX_DEVICES];
+static pthread_mutex_t  tableLock = PTHREAD_MUTEX_INITIALIZER;
+static int              busID, vendorID, productID, usbInterface, usbTimeout;
+static char             *vendorNamePattern, *productNamePattern, *serialNamePattern;
+static FILE             *warningsFp;
+static volatile int     rescanNeeded;   /* set when a device was dropped after an error */
+
+/* ------------------------------------------------------------------------- */
+
+static void devicePath(struct usb_device *dev, char *path, int pathSize)
+{
+    snprintf(path, pathSize, "%.15s/%.15s", dev->bus->dirname, dev->filename);
+}
+
+static int  onBus(const char *path)
+{
+struct usb_bus      *bus;
+struct usb_device   *dev;
+char                busPath[sizeof(devices[0].path)];
+
+    for(bus = usb_get_busses(); bus; bus = bus->next){
+        for(dev = bus->devices; dev; dev = dev->next){
+            devicePath(dev, busPath, sizeof(busPath));
+            if(strcmp(busPath, path) == 0)
+                return 1;
+        }
+    }
+    return 0;
+}
+
+/* usbOpenAllDevices() filter: devices already in the table are not opened
+ * again, they may be in the middle of an exchange.
+ */
+static int  isHeld(struct usb_device *dev)
+{
+char    path[sizeof(devices[0].path)];
+int     i, held = 0;
+
+    devicePath(dev, path, sizeof(path));
+    pthread_mutex_lock(&tableLock);
+    for(i = 0; i < DAEMON_MAX_DEVICES && !held; i++)
+        held = devices[i].present && strcmp(devices[i].path, path) == 0;
+    pthread_mutex_unlock(&tableLock);
+    return held;
+}
+
+/* must be called with the device lock held */
+static void dropDevice(daemonDevice_t *dev)
+{
+    if(warningsFp != NULL)
+        fprintf(warningsFp, "device %s at %s removed\n", dev->serial, dev->path);
+    usb_release_interface(dev->handle, usbInterface);
+    usb_close(dev->handle);
+    dev->handle = NULL;
+    dev->present = 0;
+}
+
+/* Enumeration is only repeated when libusb reports a change on the bus, so
+ * idle polling costs no USB traffic. Only this thread walks the bus list, so
+ * enumerating and opening new devices happen outside 'tableLock': clients
+ * only wait for the table while it is updated.
+ */
+static void rescan(int force)
+{
+usb_dev_handle  *handles[DAEMON_MAX_DEVICES];
+char            serials[DAEMON_MAX_DEVICES][USBOPEN_SERIAL_MAX], path[sizeof(devices[0].path)];
+int             i, j, found, changes;
+
+    changes = usb_find_busses();
+    changes += usb_find_devices();
+    if(changes == 0 && !force)
+        return;
+    pthread_mutex_lock(&tableLock);
+    for(i = 0; i < DAEMON_MAX_DEVICES; i++){
+        if(devices[i].present && !onBus(devices[i].path) && pthread_mutex_trylock(&devices[i].lock) == 0){
+            dropDevice(&devices[i]);
+            pthread_mutex_unlock(&devices[i].lock);
+        }
+    }
+    pthread_mutex_unlock(&tableLock);
+    found = usbOpenAllDevices(handles, serials, DAEMON_MAX_DEVICES, busID, vendorID, vendorNamePattern, productID, productNamePattern, serialNamePattern, isHeld, warningsFp);
+    for(i = 0; i < found; i++){
+        if(ledgerHidClaim(handles[i], usbInterface, warningsFp) != 0){
+            usb_close(handles[i]);
+            continue;
+        }
+        devicePath(usb_device(handles[i]), path, sizeof(path));
+        pthread_mutex_lock(&tableLock);
+        for(j = 0; j < DAEMON_MAX_DEVICES && devices[j].present; j++)
+            ;
+        if(j == DAEMON_MAX_DEVICES){
+            pthread_mutex_unlock(&tableLock);
+            usb_release_interface(handles[i], usbInterface);
+            usb_close(handles[i]);
+            continue;
+        }
+        pthread_mutex_lock(&devices[j].lock);
+        devices[j].handle = handles[i];
+        strcpy(devices[j].serial, serials[i][0] != 0 ? serials[i] : "-");
+        strcpy(devices[j].path, path);
+        devices[j].apdus = devices[j].errors = 0;
+        devices[j].present = 1;
+        pthread_mutex_unlock(&devices[j].lock);
+        pthread_mutex_unlock(&tableLock);
+        if(warningsFp != NULL)
+            fprintf(warningsFp, "device %s at %s added\n", devices[j].serial, devices[j].path);
+    }
+}
+
+static void *hotplugThread(void *arg)
+{
+    for(;;){
+        usleep(HOTPLUG_POLL_US);
+        if(rescanNeeded){
+            rescanNeeded = 0;
+            rescan(1);
+        }else{
+            rescan(0);
+        }
+    }
+    return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* Locks and returns the device addressed by 'name', waiting while it (or,
+ * for "*", every device) is busy. Returns NULL if no device matches.
+ */
+static daemonDevice_t *acquireDevice(const char *name)
+{
+daemonDevice_t  *dev;
+int             i, matches;
+
+    for(;;){
+        matches = 0;
+        pthread_mutex_lock(&tableLock);
+        for(i = 0; i < DAEMON_MAX_DEVICES; i++){
+            dev = &devices[i];
+            if(!dev->present || (strcmp(name, "*") != 0 && strcmp(name, dev->serial) != 0 && strcmp(name, dev->path) != 0))
+                continue;
+            matches++;
+            if(pthread_mutex_trylock(&dev->lock) == 0){
+                if(!dev->present){  /* dropped by a failed exchange meanwhile */
+                    pthread_mutex_unlock(&dev->lock);
+                    continue;
+                }
+                pthread_mutex_unlock(&tableLock);
+                return dev;
+            }
+        }
+        pthread_mutex_unlock(&tableLock);
+        if(matches == 0)
+            return NULL;
+        usleep(1000);
+    }
+}
+
+static void serveRequest(char *line, FILE *out)
+{
+daemonDevice_t  *dev;
+char            *name, *hex;
+unsigned char   apdu[LEDGER_APDU_MAX], response[LEDGER_RESPONSE_MAX];
+int             i, len;
+
+    if((name = strtok(line, " \t\r\n")) == NULL)
+        return;
+    if(strcmp(name, "list") == 0){
+        pthread_mutex_lock(&tableLock);
+        for(i = 0; i < DAEMON_MAX_DEVICES; i++){
+            if(devices[i].present)
+                fprintf(out, "%s %s apdus=%lu errors=%lu\n", devices[i].serial, devices[i].path, devices[i].apdus, devices[i].errors);
+        }
+        pthread_mutex_unlock(&tableLock);
+        fprintf(out, "OK\n");
+        return;
+    }
+    if((hex = strtok(NULL, " \t\r\n")) == NULL || (len = apduParseHex(hex, apdu, sizeof(apdu))) < 5){
+        fprintf(out, "ERR invalid request\n");
+        return;
+    }
+    if((dev = acquireDevice(name)) == NULL){
+        fprintf(out, "ERR no such device\n");
+        return;
+    }
+    len = ledgerHidExchange(dev->handle, apdu, len, response, sizeof(response), usbTimeout);
+    dev->apdus++;
+    if(len < 0){
+        dev->errors++;
+        dropDevice(dev);
+        rescanNeeded = 1;
+        pthread_mutex_unlock(&dev->lock);
+        fprintf(out, "ERR transport error %d\n", len);
+        return;
+    }
+    pthread_mutex_unlock(&dev->lock);
+    fprintf(out, "OK ");
+    for(i = 0; i < len; i++)
+        fprintf(out, "%02x", response[i]);
+    fprintf(out, "\n");
+}
+
+static void *clientThread(void *arg)
+{
+int     fd = (int)(long)arg, outFd = dup(fd);
+FILE    *in = fdopen(fd, "r"), *out = outFd >= 0 ? fdopen(outFd, "w") : NULL;
+char    line[LINE_SIZE];
+
+    while(in != NULL && out != NULL && fgets(line, sizeof(line), in) != NULL){
+        serveRequest(line, out);
+        fflush(out);
+    }
+    /* fclose() closes the descriptor, which stays open if fdopen() failed */
+    if(in != NULL)
+        fclose(in);
+    else
+        close(fd);
+    if(out != NULL)
+        fclose(out);
+    else if(outFd >= 0)
+        close(outFd);
+    return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int daemonRun(char *socketPath, int bus, int vendor, char *vendorPattern, int product, char *productPattern, char *serialPattern, int interface, int timeout, FILE *warnings)
+{
+struct sockaddr_un  addr;
+struct stat         st;
+pthread_t           thread;
+int                 i, listenFd, fd;
+
+    busID = bus;
+    vendorID = vendor != 0 ? vendor : LEDGER_HID_VID;
+    productID = product;
+    vendorNamePattern = vendorPattern;
+    productNamePattern = productPattern;
+    serialNamePattern = serialPattern;
+    usbInterface = interface;
+    usbTimeout = timeout;
+    warningsFp = warnings;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strlen(socketPath) >= sizeof(addr.sun_path)){
+        fprintf(stderr, "socket path too long: %s\n", socketPath);
+        return 1;
+    }
+    strcpy(addr.sun_path, socketPath);
+    /* a stale socket of an earlier run is replaced, anything else is kept */
+    if(lstat(socketPath, &st) == 0){
+        if(!S_ISSOCK(st.st_mode)){
+            fprintf(stderr, "%s exists and is not a socket\n", socketPath);
+            return 1;
+        }
+        unlink(socketPath);
+    }
+    if((listenFd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+                || bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+                || listen(listenFd, 16) != 0){
+        fprintf(stderr, "error listening on %s: %s\n", socketPath, strerror(errno));
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);   /* clients may go away mid reply */
+
+    for(i = 0; i < DAEMON_MAX_DEVICES; i++)
+        pthread_mutex_init(&devices[i].lock, NULL);
+    rescan(1);
+    pthread_create(&thread, NULL, hotplugThread, NULL);
+    pthread_detach(thread);
+
+    for(;;){
+        if((fd = accept(listenFd, NULL, NULL)) < 0){
+            if(errno != EINTR)
+                fprintf(stderr, "accept: %s\n", strerror(errno));
+            continue;
+        }
+        if(pthread_create(&thread, NULL, clientThread, (void *)(long)fd) != 0){
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
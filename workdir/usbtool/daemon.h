@@ -0,0 +1,34 @@
+/* Name: daemon.h
+ * Project: usbtool
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt), GNU GPL v3 or proprietary (CommercialLicense.txt)
+ */
+
+/*
+General Description:
+Daemon mode keeps Ledger devices open across requests. Clients connect to a
+Unix domain socket and send one request per line:
+    list                    lists the devices, one per line, then "OK"
+    <device> <hex apdu>     sends an APDU, replies "OK <hex reply>" or
+                            "ERR <reason>"
+<device> is a serial number, a bus path as printed by "list", or "*" for
+the first idle device. The bus is polled for hotplug events: new matching
+devices are opened and claimed, unplugged ones are dropped.
+*/
+
+#ifndef __DAEMON_H_INCLUDED__
+#define __DAEMON_H_INCLUDED__
+
+#include <stdio.h>
+
+#define DAEMON_MAX_DEVICES  64
+
+int daemonRun(char *socketPath, int busID, int vendorID, char *vendorNamePattern, int productID, char *productNamePattern, char *serialNamePattern, int interface, int timeout, FILE *warningsFp);
+/* This function serves APDU requests on the Unix socket 'socketPath' until
+ * the process is killed. Devices are matched as in usbOpenAllDevices();
+ * 'vendorID' 0 defaults to the Ledger vendor ID. 'interface' is the HID
+ * interface to claim and 'timeout' the USB timeout in milliseconds.
+ * Returns: 1 if the socket can't be set up, it does not return otherwise.
+ */
+
+#endif /* __DAEMON_H_INCLUDED__ */
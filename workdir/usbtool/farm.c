@@ -0,0 +1,480 @@
+/* Name: farm.c
+ * Project: usbtool
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt), GNU GPL v3 or proprietary (CommercialLicense.txt)
+ */
+
+/*
+General Description:
+Multi-device job scheduler for the NEAR app, see farm.h. One thread per
+device; queues are guarded by a mutex per device.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "opendevice.h"
+#include "ledgerhid.h"
+#include "apduscript.h"
+#include "farm.h"
+
+/* NEAR app protocol, see src/constants.h in the app */
+#define CLA                         0x80
+#define INS_SIGN                    0x02
+#define INS_GET_PUBLIC_KEY          0x04
+#define INS_GET_APP_CONFIGURATION   0x06
+#define INS_RESET                   0x0B
+#define P1_LAST                     0x80
+#define P1_MORE                     0x00
+#define P1_RETURN_ONLY              0x01
+#define SW_OK                       0x9000
+#define SW_CONDITIONS_NOT_SATISFIED 0x6985
+
+#define PATH_SIZE       20      /* 5 big endian uint32 */
+#define CHUNK_SIZE      255     /* max data bytes in a short APDU */
+#define LINE_SIZE       16384
+
+#define JOB_PUBKEY      0
+#define JOB_SIGN        1
+
+typedef struct farmJob {
+    int             type;
+    unsigned char   *data;      /* path followed by the transaction, if any */
+    int             dataLen;
+    int             status;     /* status word once run, 0 while pending */
+} farmJob_t;
+
+typedef struct farmDevice {
+    usb_dev_handle  *handle;    /* NULL for a simulated device */
+    char            serial[USBOPEN_SERIAL_MAX];
+    int             index;
+    volatile int    alive;
+    int             *queue;     /* ring buffer of job indices, numJobs entries */
+    int             head, count;
+    pthread_mutex_t lock;
+    int             jobsDone, jobsFailed, jobsStolen;
+    double          busySeconds;
+} farmDevice_t;
+
+static farmJob_t        *jobs;
+static int              numJobs;
+static farmDevice_t     devices[FARM_MAX_DEVICES];
+static int              numDevices;
+static int              remaining;  /* jobs without a result yet */
+static int              usbTimeout;
+static pthread_mutex_t  stateLock = PTHREAD_MUTEX_INITIALIZER;  /* guards 'remaining' and stdout */
+
+/* ------------------------------------------------------------------------- */
+
+/* Parses a BIP32 path like "44'/397'/0'/0'/1" into 20 big endian bytes. */
+static int  parsePath(char *text, unsigned char *path)
+{
+unsigned long   value;
+char            *end;
+int             i;
+
+    if(strncmp(text, "m/", 2) == 0)
+        text += 2;
+    for(i = 0; i < PATH_SIZE / 4; i++){
+        value = strtoul(text, &end, 10);
+        if(end == text)
+            return -1;
+        if(*end == '\'' || *end == 'h'){
+            value |= 0x80000000ul;
+            end++;
+        }
+        path[4 * i] = value >> 24;
+        path[4 * i + 1] = value >> 16;
+        path[4 * i + 2] = value >> 8;
+        path[4 * i + 3] = value;
+        if(i < PATH_SIZE / 4 - 1 && *end++ != '/')
+            return -1;
+        text = end;
+    }
+    return *text == 0 ? 0 : -1;
+}
+
+static int  loadJobs(char *fileName)
+{
+FILE            *fp;
+char            *line, *type, *path, *hex;
+int             lineNo = 0, capacity = 0;
+unsigned char   *data;
+int             len;
+
+    if((fp = fopen(fileName, "r")) == NULL){
+        fprintf(stderr, "error opening %s: %s\n", fileName, strerror(errno));
+        return -1;
+    }
+    line = malloc(LINE_SIZE);
+    while(fgets(line, LINE_SIZE, fp) != NULL){
+        lineNo++;
+        if((type = strtok(line, " \t\r\n")) == NULL || type[0] == '#')
+            continue;
+        path = strtok(NULL, " \t\r\n");
+        hex = strtok(NULL, " \t\r\n");
+        data = malloc(PATH_SIZE + (hex != NULL ? strlen(hex) / 2 : 0));
+        if(path == NULL || parsePath(path, data) != 0){
+            fprintf(stderr, "%s:%d: invalid path\n", fileName, lineNo);
+            goto fail;
+        }
+        len = PATH_SIZE;
+        if(strcmp(type, "sign") == 0){
+            if(hex == NULL || (len = apduParseHex(hex, data + PATH_SIZE, strlen(hex) / 2)) < 0){
+                fprintf(stderr, "%s:%d: invalid transaction\n", fileName, lineNo);
+                goto fail;
+            }
+            len += PATH_SIZE;
+        }else if(strcmp(type, "pubkey") != 0){
+            fprintf(stderr, "%s:%d: unknown job type \"%s\"\n", fileName, lineNo, type);
+            goto fail;
+        }
+        if(numJobs == capacity){
+            capacity = capacity ? 2 * capacity : 64;
+            jobs = realloc(jobs, capacity * sizeof(farmJob_t));
+        }
+        jobs[numJobs].type = strcmp(type, "sign") == 0 ? JOB_SIGN : JOB_PUBKEY;
+        jobs[numJobs].data = data;
+        jobs[numJobs].dataLen = len;
+        jobs[numJobs].status = 0;
+        numJobs++;
+    }
+    free(line);
+    fclose(fp);
+    return 0;
+
+fail:
+    free(data);
+    free(line);
+    fclose(fp);
+    while(numJobs > 0)
+        free(jobs[--numJobs].data);
+    free(jobs);
+    jobs = NULL;
+    return -1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void queuePush(farmDevice_t *dev, int job)
+{
+    pthread_mutex_lock(&dev->lock);
+    dev->queue[(dev->head + dev->count) % numJobs] = job;
+    dev->count++;
+    pthread_mutex_unlock(&dev->lock);
+}
+
+static int  queueCount(farmDevice_t *dev)
+{
+int     count;
+
+    pthread_mutex_lock(&dev->lock);
+    count = dev->count;
+    pthread_mutex_unlock(&dev->lock);
+    return count;
+}
+
+/* The owner takes jobs from the head, thieves from the tail. */
+static int  queuePop(farmDevice_t *dev, int fromTail)
+{
+int     job = -1;
+
+    pthread_mutex_lock(&dev->lock);
+    if(dev->count > 0){
+        if(fromTail){
+            job = dev->queue[(dev->head + dev->count - 1) % numJobs];
+        }else{
+            job = dev->queue[dev->head];
+            dev->head = (dev->head + 1) % numJobs;
+        }
+        dev->count--;
+    }
+    pthread_mutex_unlock(&dev->lock);
+    return job;
+}
+
+static int  stealJob(farmDevice_t *self)
+{
+farmDevice_t    *victim;
+int             i, job, count, victimCount;
+
+    for(;;){
+        victim = NULL;
+        victimCount = 0;
+        for(i = 0; i < numDevices; i++){   /* only a hint, may change before queuePop() */
+            if(&devices[i] != self && (count = queueCount(&devices[i])) > victimCount){
+                victim = &devices[i];
+                victimCount = count;
+            }
+        }
+        if(victim == NULL)
+            return -1;
+        if((job = queuePop(victim, 1)) >= 0){
+            self->jobsStolen++;
+            return job;
+        }
+    }
+}
+
+/* Gives a job back after its device failed: to the least loaded device
+ * still alive, or to the failed device itself if there is none left.
+ */
+static void handOver(farmDevice_t *failed, int job)
+{
+farmDevice_t    *target = failed;
+int             i, count, targetCount = 0;
+
+    for(i = 0; i < numDevices; i++){
+        if(devices[i].alive && ((count = queueCount(&devices[i])) < targetCount || target == failed)){
+            target = &devices[i];
+            targetCount = count;
+        }
+    }
+    queuePush(target, job);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* Simulated device: answers like the NEAR app with auto-approval. Latency
+ * differs per device so that work stealing can be observed.
+ */
+static int  mockExchange(farmDevice_t *dev, const unsigned char *apdu, int apduLen, unsigned char *response)
+{
+int     len = 0, i;
+
+    usleep(1000 * (1 + dev->index % 4));
+    if(apduLen < 5 || apdu[0] != CLA || apdu[4] != apduLen - 5){
+        response[len++] = SW_CONDITIONS_NOT_SATISFIED >> 8;
+        response[len++] = SW_CONDITIONS_NOT_SATISFIED & 0xff;
+        return len;
+    }
+    switch(apdu[1]){
+    case INS_GET_APP_CONFIGURATION:
+        response[len++] = 1;
+        response[len++] = 2;
+        response[len++] = 4;
+        break;
+    case INS_GET_PUBLIC_KEY:
+        for(i = 0; i < 32; i++)
+            response[len++] = apdu[5 + i % PATH_SIZE] ^ (i * 31);
+        break;
+    case INS_SIGN:
+        if(apdu[2] == P1_LAST && apdu[4] > 0){
+            for(i = 0; i < 64; i++)
+                response[len++] = apdu[5 + i % apdu[4]] ^ (i * 17);
+        }
+        break;
+    }
+    response[len++] = SW_OK >> 8;
+    response[len++] = SW_OK & 0xff;
+    return len;
+}
+
+static int  deviceExchange(farmDevice_t *dev, unsigned char *apdu, int apduLen, unsigned char *response)
+{
+    if(dev->handle == NULL)
+        return mockExchange(dev, apdu, apduLen, response);
+    return ledgerHidExchange(dev->handle, apdu, apduLen, response, LEDGER_RESPONSE_MAX, usbTimeout);
+}
+
+static int  buildApdu(unsigned char *apdu, int ins, int p1, const unsigned char *data, int dataLen)
+{
+    apdu[0] = CLA;
+    apdu[1] = ins;
+    apdu[2] = p1;
+    apdu[3] = 0;
+    apdu[4] = dataLen;
+    if(dataLen > 0)
+        memcpy(apdu + 5, data, dataLen);
+    return 5 + dataLen;
+}
+
+/* Runs one job. Returns the final status word or a negative transport error,
+ * the reply length is stored in '*responseLen'.
+ */
+static int  runJob(farmDevice_t *dev, farmJob_t *job, unsigned char *response, int *responseLen)
+{
+unsigned char   apdu[LEDGER_APDU_MAX];
+int             len, offset, chunk, sw;
+
+    if(job->type == JOB_PUBKEY){
+        len = buildApdu(apdu, INS_GET_PUBLIC_KEY, P1_RETURN_ONLY, job->data, PATH_SIZE);
+        if((len = deviceExchange(dev, apdu, len, response)) < 0)
+            return len;
+        *responseLen = len;
+        return LEDGER_SW(response, len);
+    }
+    /* The app keeps appending chunks to an upload until it is reset, so
+     * drop whatever an earlier client left. GET_APP_CONFIGURATION used to
+     * do this, but only does so now when no review is pending.
+     */
+    len = buildApdu(apdu, INS_RESET, 0, NULL, 0);
+    if((len = deviceExchange(dev, apdu, len, response)) < 0)
+        return len;
+    *responseLen = len;
+    if((sw = LEDGER_SW(response, len)) != SW_OK)   /* a review is pending */
+        return sw;
+    for(offset = 0; offset < job->dataLen && sw == SW_OK; offset += chunk){
+        chunk = job->dataLen - offset;
+        if(chunk > CHUNK_SIZE)
+            chunk = CHUNK_SIZE;
+        len = buildApdu(apdu, INS_SIGN, offset + chunk == job->dataLen ? P1_LAST : P1_MORE, job->data + offset, chunk);
+        if((len = deviceExchange(dev, apdu, len, response)) < 0)
+            return len;
+        sw = LEDGER_SW(response, len);
+    }
+    *responseLen = len;
+    return sw;
+}
+
+static void *deviceWorker(void *arg)
+{
+farmDevice_t    *dev = arg;
+unsigned char   response[LEDGER_RESPONSE_MAX];
+int             job, len, sw, i;
+double          start, elapsed;
+
+    for(;;){
+        if((job = queuePop(dev, 0)) < 0 && (job = stealJob(dev)) < 0){
+            pthread_mutex_lock(&stateLock);
+            len = remaining;
+            pthread_mutex_unlock(&stateLock);
+            if(len == 0)
+                break;
+            usleep(1000);   /* a job is in flight elsewhere and may be handed over */
+            continue;
+        }
+        start = apduTime();
+        sw = runJob(dev, &jobs[job], response, &len);
+        elapsed = apduTime() - start;
+        dev->busySeconds += elapsed;
+        if(sw < 0){
+            fprintf(stderr, "device %s: transport error %d, retiring device\n", dev->serial, sw);
+            dev->alive = 0;
+            handOver(dev, job);
+            break;
+        }
+        jobs[job].status = sw;
+        dev->jobsDone++;
+        if(sw != SW_OK)
+            dev->jobsFailed++;
+        pthread_mutex_lock(&stateLock);
+        printf("job=%d device=%s sw=0x%04x time=%.1fms data=", job, dev->serial, sw, elapsed * 1000);
+        for(i = 0; i < len - 2; i++)
+            printf("%02x", response[i]);
+        printf("\n");
+        remaining--;
+        pthread_mutex_unlock(&stateLock);
+    }
+    return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int  openDevices(int busID, int vendorID, char *vendorNamePattern, int productID, char *productNamePattern, char *serialNamePattern, int interface, FILE *warningsFp)
+{
+usb_dev_handle  *handles[FARM_MAX_DEVICES];
+char            serials[FARM_MAX_DEVICES][USBOPEN_SERIAL_MAX];
+unsigned char   apdu[5], response[LEDGER_RESPONSE_MAX];
+int             i, found, len;
+
+    if(vendorID == 0)
+        vendorID = LEDGER_HID_VID;
+    usb_find_busses();
+    usb_find_devices();
+    found = usbOpenAllDevices(handles, serials, FARM_MAX_DEVICES, busID, vendorID, vendorNamePattern, productID, productNamePattern, serialNamePattern, NULL, warningsFp);
+    for(i = 0; i < found; i++){
+        if(ledgerHidClaim(handles[i], interface, warningsFp) != 0){
+            usb_close(handles[i]);
+            continue;
+        }
+        /* only keep devices with the NEAR app open */
+        len = buildApdu(apdu, INS_GET_APP_CONFIGURATION, 0, NULL, 0);
+        len = ledgerHidExchange(handles[i], apdu, len, response, sizeof(response), usbTimeout);
+        if(len != 5 || LEDGER_SW(response, len) != SW_OK){
+            if(warningsFp != NULL)
+                fprintf(warningsFp, "Warning: device %s is not running the NEAR app, skipped\n", serials[i]);
+            usb_release_interface(handles[i], interface);
+            usb_close(handles[i]);
+            continue;
+        }
+        devices[numDevices].handle = handles[i];
+        if(serials[i][0] != 0){
+            strcpy(devices[numDevices].serial, serials[i]);
+        }else{
+            sprintf(devices[numDevices].serial, "#%d", numDevices);
+        }
+        numDevices++;
+    }
+    return numDevices;
+}
+
+int farmRun(char *jobFile, int busID, int vendorID, char *vendorNamePattern, int productID, char *productNamePattern, char *serialNamePattern, int interface, int timeout, int mockDevices, FILE *warningsFp)
+{
+pthread_t       threads[FARM_MAX_DEVICES];
+farmDevice_t    *dev;
+int             i, ok = 0, failed = 0;
+double          start, wall;
+
+    usbTimeout = timeout;
+    if(loadJobs(jobFile) != 0)
+        return 1;
+    if(numJobs == 0){
+        fprintf(stderr, "no jobs in %s\n", jobFile);
+        return 1;
+    }
+    if(mockDevices > 0){
+        numDevices = mockDevices > FARM_MAX_DEVICES ? FARM_MAX_DEVICES : mockDevices;
+        for(i = 0; i < numDevices; i++)
+            sprintf(devices[i].serial, "mock%d", i);
+    }else if(openDevices(busID, vendorID, vendorNamePattern, productID, productNamePattern, serialNamePattern, interface, warningsFp) == 0){
+        fprintf(stderr, "Could not find any device running the NEAR app\n");
+        return 1;
+    }
+    for(i = 0; i < numDevices; i++){
+        dev = &devices[i];
+        dev->index = i;
+        dev->alive = 1;
+        dev->queue = malloc(numJobs * sizeof(int));
+        pthread_mutex_init(&dev->lock, NULL);
+    }
+    for(i = 0; i < numJobs; i++)    /* initial round robin sharding */
+        queuePush(&devices[i % numDevices], i);
+    remaining = numJobs;
+
+    start = apduTime();
+    for(i = 0; i < numDevices; i++)
+        pthread_create(&threads[i], NULL, deviceWorker, &devices[i]);
+    for(i = 0; i < numDevices; i++)
+        pthread_join(threads[i], NULL);
+    wall = apduTime() - start;
+
+    for(i = 0; i < numDevices; i++){
+        dev = &devices[i];
+        printf("device=%s jobs=%d failed=%d stolen=%d busy=%.2fs rate=%.1f/s%s\n", dev->serial, dev->jobsDone, dev->jobsFailed, dev->jobsStolen,
+               dev->busySeconds, dev->busySeconds > 0 ? dev->jobsDone / dev->busySeconds : 0, dev->alive ? "" : " (lost)");
+        if(dev->handle != NULL){
+            usb_release_interface(dev->handle, interface);
+            usb_close(dev->handle);
+        }
+        pthread_mutex_destroy(&dev->lock);
+        free(dev->queue);
+    }
+    for(i = 0; i < numJobs; i++){
+        if(jobs[i].status == SW_OK){
+            ok++;
+        }else if(jobs[i].status != 0){
+            failed++;
+        }
+        free(jobs[i].data);
+    }
+    free(jobs);
+    printf("total jobs=%d ok=%d failed=%d unfinished=%d wall=%.2fs rate=%.1f/s\n", numJobs, ok, failed, numJobs - ok - failed, wall, wall > 0 ? ok / wall : 0);
+    return ok == numJobs ? 0 : 1;
+}
+
+/* ------------------------------------------------------------------------- */
@@ -0,0 +1,41 @@
+/* Name: farm.h
+ * Project: usbtool
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt), GNU GPL v3 or proprietary (CommercialLicense.txt)
+ */
+
+/*
+General Description:
+Farm mode drives many devices running the NEAR app from one process. Every
+matching device is opened and probed once, then a file of signing and public
+key jobs is spread over them. Each device has its own job queue; a device
+whose queue runs dry steals from the tail of the longest other queue, so slow
+or busy devices don't hold up the rest. Jobs of a device that drops off the
+bus are handed to the remaining ones.
+
+Job file syntax, one job per line ('#' starts a comment):
+    pubkey <path>
+    sign <path> <hex encoded transaction>
+where <path> is a BIP32 path like 44'/397'/0'/0'/1.
+*/
+
+#ifndef __FARM_H_INCLUDED__
+#define __FARM_H_INCLUDED__
+
+#include <stdio.h>
+
+#define FARM_MAX_DEVICES    64
+
+int farmRun(char *jobFile, int busID, int vendorID, char *vendorNamePattern, int productID, char *productNamePattern, char *serialNamePattern, int interface, int timeout, int mockDevices, FILE *warningsFp);
+/* This function runs all jobs in 'jobFile' on every device matched by the
+ * given IDs and patterns (see usbOpenAllDevices()). 'vendorID' 0 defaults to
+ * the Ledger vendor ID. 'interface' is the HID interface to claim and
+ * 'timeout' the USB timeout in milliseconds; signing jobs wait for the user,
+ * so pick it generously. If 'mockDevices' is not 0, no USB device is used and
+ * that many simulated devices answer the jobs instead.
+ * Results are printed to stdout, one line per job, followed by a per device
+ * summary.
+ * Returns: 0 if all jobs succeeded, 1 otherwise.
+ */
+
+#endif /* __FARM_H_INCLUDED__ */
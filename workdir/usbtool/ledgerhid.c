@@ -0,0 +1,108 @@
+/* Name: ledgerhid.c
+ * Project: usbtool
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt), GNU GPL v3 or proprietary (CommercialLicense.txt)
+ */
+
+/*
+General Description:
+APDU exchange with Ledger devices over the 64 byte HID report framing.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "ledgerhid.h"
+
+#define HEADER_SIZE     5   /* channel (2), tag (1), sequence index (2) */
+
+/* ------------------------------------------------------------------------- */
+
+int ledgerHidClaim(usb_dev_handle *handle, int interface, FILE *warningsFp)
+{
+int     rval, retries = 1;
+
+    /* now try to claim the interface and detach the kernel HID driver on
+     * linux and other operating systems which support the call.
+     */
+    while((rval = usb_claim_interface(handle, interface)) != 0 && retries-- > 0){
+#ifdef LIBUSB_HAS_DETACH_KERNEL_DRIVER_NP
+        if(usb_detach_kernel_driver_np(handle, interface) < 0 && warningsFp != NULL){
+            fprintf(warningsFp, "Warning: could not detach kernel driver: %s\n", usb_strerror());
+        }
+#endif
+    }
+    if(rval != 0){
+        if(warningsFp != NULL)
+            fprintf(warningsFp, "Warning: could not claim interface: %s\n", usb_strerror());
+        return -1;
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void writeHeader(unsigned char *packet, int sequence)
+{
+    packet[0] = LEDGER_HID_CHANNEL >> 8;
+    packet[1] = LEDGER_HID_CHANNEL & 0xff;
+    packet[2] = LEDGER_HID_TAG_APDU;
+    packet[3] = sequence >> 8;
+    packet[4] = sequence & 0xff;
+}
+
+static int checkHeader(const unsigned char *packet, int sequence)
+{
+    return ((packet[0] << 8) | packet[1]) == LEDGER_HID_CHANNEL
+        && packet[2] == LEDGER_HID_TAG_APDU
+        && ((packet[3] << 8) | packet[4]) == sequence;
+}
+
+int ledgerHidExchange(usb_dev_handle *handle, const unsigned char *apdu, int apduLen, unsigned char *response, int responseMax, int timeout)
+{
+unsigned char   packet[LEDGER_HID_PACKET_SIZE];
+int             sequence, offset, chunk, len, total;
+
+    /* send */
+    offset = 0;
+    for(sequence = 0; sequence == 0 || offset < apduLen; sequence++){
+        memset(packet, 0, sizeof(packet));
+        writeHeader(packet, sequence);
+        len = HEADER_SIZE;
+        if(sequence == 0){
+            packet[len++] = apduLen >> 8;
+            packet[len++] = apduLen & 0xff;
+        }
+        chunk = apduLen - offset;
+        if(chunk > LEDGER_HID_PACKET_SIZE - len)
+            chunk = LEDGER_HID_PACKET_SIZE - len;
+        memcpy(packet + len, apdu + offset, chunk);
+        offset += chunk;
+        if(usb_interrupt_write(handle, LEDGER_HID_EP_OUT, (char *)packet, sizeof(packet), timeout) != sizeof(packet))
+            return LEDGERHID_ERR_IO;
+    }
+
+    /* receive */
+    offset = 0;
+    total = -1;
+    for(sequence = 0; total < 0 || offset < total; sequence++){
+        if(usb_interrupt_read(handle, LEDGER_HID_EP_IN, (char *)packet, sizeof(packet), timeout) != sizeof(packet))
+            return LEDGERHID_ERR_IO;
+        if(!checkHeader(packet, sequence))
+            return LEDGERHID_ERR_PROTOCOL;
+        len = HEADER_SIZE;
+        if(sequence == 0){
+            total = (packet[len] << 8) | packet[len + 1];
+            len += 2;
+            if(total > responseMax)
+                return LEDGERHID_ERR_OVERFLOW;
+        }
+        chunk = total - offset;
+        if(chunk > LEDGER_HID_PACKET_SIZE - len)
+            chunk = LEDGER_HID_PACKET_SIZE - len;
+        memcpy(response + offset, packet + len, chunk);
+        offset += chunk;
+    }
+    return total;
+}
+
+/* ------------------------------------------------------------------------- */
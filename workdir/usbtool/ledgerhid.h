@@ -0,0 +1,55 @@
+/* Name: ledgerhid.h
+ * Project: usbtool
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt), GNU GPL v3 or proprietary (CommercialLicense.txt)
+ */
+
+/*
+General Description:
+This module implements the APDU transport used by Ledger devices on their HID
+interface. APDUs are split into 64 byte interrupt reports, each starting with
+a 2 byte channel ID, a 1 byte command tag and a 2 byte sequence index. The
+first report of a message additionally carries the 2 byte APDU length. See
+doc/api.asc in the app for the protocol description.
+*/
+
+#ifndef __LEDGERHID_H_INCLUDED__
+#define __LEDGERHID_H_INCLUDED__
+
+#include <usb.h>    /* this is libusb, see http://libusb.sourceforge.net/ */
+#include <stdio.h>
+
+#define LEDGER_HID_VID          0x2c97  /* Ledger SAS vendor ID */
+#define LEDGER_HID_PACKET_SIZE  64      /* IO_HID_EP_LENGTH in the app */
+#define LEDGER_HID_CHANNEL      0x0101
+#define LEDGER_HID_TAG_APDU     0x05
+#define LEDGER_HID_EP_IN        0x82
+#define LEDGER_HID_EP_OUT       0x02
+
+#define LEDGER_APDU_MAX         (5 + 255)       /* short APDU: header + Lc bytes */
+#define LEDGER_RESPONSE_MAX     (256 + 2)       /* data + status word */
+
+int ledgerHidClaim(usb_dev_handle *handle, int interface, FILE *warningsFp);
+/* This function prepares a freshly opened device for ledgerHidExchange(): it
+ * detaches a kernel HID driver where the platform supports it and claims the
+ * given interface. Warnings are printed to 'warningsFp' if it is not NULL.
+ * Returns: 0 on success, a negative number if the interface can't be claimed.
+ */
+
+int ledgerHidExchange(usb_dev_handle *handle, const unsigned char *apdu, int apduLen, unsigned char *response, int responseMax, int timeout);
+/* This function sends the APDU in 'apdu' (of 'apduLen' bytes) to the device
+ * and waits at most 'timeout' milliseconds per report for the reply. The
+ * reply, including the trailing status word, is stored in 'response' which
+ * can hold 'responseMax' bytes.
+ * Returns: The length of the reply or a negative error code (see below).
+ */
+
+/* ledgerHidExchange() error codes: */
+#define LEDGERHID_ERR_IO        -1  /* USB transfer failed or timed out */
+#define LEDGERHID_ERR_PROTOCOL  -2  /* unexpected channel, tag or sequence */
+#define LEDGERHID_ERR_OVERFLOW  -3  /* reply does not fit into 'response' */
+
+/* Status word of a reply of 'len' bytes, 0 if the reply is too short. */
+#define LEDGER_SW(response, len) ((len) < 2 ? 0 : (((response)[(len) - 2] << 8) | (response)[(len) - 1]))
+
+#endif /* __LEDGERHID_H_INCLUDED__ */
@@ -14,6 +14,7 @@ libusb or libusb-win32.
 */
 
 #include <stdio.h>
+#include <string.h>
 #include "opendevice.h"
 
 /* ------------------------------------------------------------------------- */
@@ -205,3 +206,59 @@ int                 errorCode = USBOPEN_ERR_NOTFOUND;
 }
 
 /* ------------------------------------------------------------------------- */
+
+/* private interface: query the string descriptor 'index' into 'buf' and match
+ * it against 'pattern'. A device without the string matches as "". Returns 1
+ * on match, 0 otherwise.
+ */
+static int  matchDeviceString(usb_dev_handle *handle, struct usb_device *dev, int index, const char *what, char *pattern, char *buf, int buflen, FILE *warningsFp)
+{
+int     len = buf[0] = 0;
+
+    if(index > 0){
+        len = usbGetStringAscii(handle, index, buf, buflen);
+    }
+    if(len < 0){
+        if(warningsFp != NULL)
+            fprintf(warningsFp, "Warning: cannot query %s for VID=0x%04x PID=0x%04x: %s\n", what, dev->descriptor.idVendor, dev->descriptor.idProduct, usb_strerror());
+        return 0;
+    }
+    return shellStyleMatch(buf, pattern);
+}
+
+int usbOpenAllDevices(usb_dev_handle **devices, char (*serials)[USBOPEN_SERIAL_MAX], int maxDevices, int busID, int vendorID, char *vendorNamePattern, int productID, char *productNamePattern, char *serialNamePattern, int (*skipDevice)(struct usb_device *dev), FILE *warningsFp)
+{
+struct usb_bus      *bus;
+struct usb_device   *dev;
+usb_dev_handle      *handle;
+int                 count = 0;
+
+    for(bus = usb_get_busses(); bus && count < maxDevices; bus = bus->next){
+        for(dev = bus->devices; dev && count < maxDevices; dev = dev->next){  /* iterate over all devices on all busses */
+            char    vendor[256], product[256], serial[USBOPEN_SERIAL_MAX];
+            if((busID != 0 && bus->location != busID)
+                        || (vendorID != 0 && dev->descriptor.idVendor != vendorID)
+                        || (productID != 0 && dev->descriptor.idProduct != productID)
+                        || (skipDevice != NULL && skipDevice(dev)))
+                continue;
+            handle = usb_open(dev); /* we need to open the device in order to query strings */
+            if(!handle){
+                if(warningsFp != NULL)
+                    fprintf(warningsFp, "Warning: cannot open VID=0x%04x PID=0x%04x: %s\n", dev->descriptor.idVendor, dev->descriptor.idProduct, usb_strerror());
+                continue;
+            }
+            if(matchDeviceString(handle, dev, dev->descriptor.iManufacturer, "manufacturer", vendorNamePattern, vendor, sizeof(vendor), warningsFp)
+                        && matchDeviceString(handle, dev, dev->descriptor.iProduct, "product", productNamePattern, product, sizeof(product), warningsFp)
+                        && matchDeviceString(handle, dev, dev->descriptor.iSerialNumber, "serial", serialNamePattern, serial, sizeof(serial), warningsFp)){
+                devices[count] = handle;
+                strcpy(serials[count], serial);
+                count++;
+            }else{
+                usb_close(handle);
+            }
+        }
+    }
+    return count;
+}
+
+/* ------------------------------------------------------------------------- */
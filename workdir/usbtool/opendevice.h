@@ -58,6 +58,20 @@ int usbOpenDevice(usb_dev_handle **device, int busID, int vendorID, char *vendor
  * Returns: 0 on success, an error code (see defines below) on failure.
  */
 
+#define USBOPEN_SERIAL_MAX      64  /* size of a serial entry in usbOpenAllDevices() */
+
+int usbOpenAllDevices(usb_dev_handle **devices, char (*serials)[USBOPEN_SERIAL_MAX], int maxDevices, int busID, int vendorID, char *vendorNamePattern, int productID, char *productNamePattern, char *serialNamePattern, int (*skipDevice)(struct usb_device *dev), FILE *warningsFp);
+/* This function works like usbOpenDevice(), but instead of stopping at the
+ * first match it opens every matching device, up to 'maxDevices'. The handles
+ * are stored in 'devices' and the serial numbers (empty if the device has
+ * none) in 'serials'; both arrays must have room for 'maxDevices' entries.
+ * Names are always matched, even if both numeric IDs are given.
+ * Unlike usbOpenDevice(), it does not enumerate the busses: the caller calls
+ * usb_find_busses() and usb_find_devices() first. Devices for which
+ * 'skipDevice' returns nonzero are not opened; pass NULL to open all.
+ * Returns: The number of devices opened.
+ */
+
 /* usbOpenDevice() error codes: */
 #define USBOPEN_SUCCESS         0   /* no error */
 #define USBOPEN_ERR_ACCESS      1   /* not enough permissions to open device */
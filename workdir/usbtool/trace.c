@@ -0,0 +1,361 @@
+/* Name: trace.c
+ * Project: usbtool
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt), GNU GPL v3 or proprietary (CommercialLicense.txt)
+ */
+
+/*
+General Description:
+APDU trace recording and replay, see trace.h. Replay workers pull whole
+sessions from a shared counter, so a slow endpoint simply takes fewer of
+them. Round trip times go into per worker log-linear histograms (32 buckets
+per power of two, about 3% resolution) which are merged for the report;
+memory stays bounded however long the trace is.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "ledgerhid.h"
+#include "apduscript.h"
+#include "trace.h"
+
+#define HIST_SUB_BITS       5
+#define HIST_SUB_COUNT      (1 << HIST_SUB_BITS)
+#define HIST_LINEAR         (2 * HIST_SUB_COUNT)    /* values below are exact */
+#define HIST_BUCKETS        (HIST_LINEAR + (32 - HIST_SUB_BITS - 1) * HIST_SUB_COUNT)
+#define LATE_SECONDS        0.001   /* session start counted as late beyond this */
+#define MAX_REPORTED        20      /* mismatches printed in detail */
+
+typedef struct traceRecord {
+    int                 flags;
+    unsigned long       sendUs, latencyUs;
+    const unsigned char *apdu, *response;
+    int                 apduLen, responseLen;
+} traceRecord_t;
+
+typedef struct traceSession {
+    int     first, count;
+    double  start;      /* recorded start, relative to the first session */
+} traceSession_t;
+
+typedef struct traceWorker {
+    apduEndpoint_t  *endpoint;
+    unsigned long   *hist[256];     /* per INS, allocated on first use */
+    unsigned long   apdus, errors, mismatches, sessions, late;
+    double          maxLag;
+    pthread_t       thread;
+} traceWorker_t;
+
+static traceRecord_t    *records;
+static traceSession_t   *sessions;
+static int              numSessions, nextSession;
+static pthread_mutex_t  sessionLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t  outLock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long    reported;
+static double           replayRate, replayStart;
+static int              replayTimeout;
+static FILE             *replayOut;
+
+/* ------------------------------------------------------------------------- */
+
+static void putBE(unsigned char *p, unsigned long value, int size)
+{
+int     i;
+
+    for(i = size - 1; i >= 0; i--){
+        p[i] = value;
+        value >>= 8;
+    }
+}
+
+static unsigned long getBE(const unsigned char *p, int size)
+{
+unsigned long   value = 0;
+int             i;
+
+    for(i = 0; i < size; i++)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+static unsigned long toMicroseconds(double seconds)
+{
+    if(seconds <= 0)
+        return 0;
+    if(seconds >= 4294.967295)
+        return 0xffffffffUL;
+    return seconds * 1e6 + 0.5;
+}
+
+int traceWriteHeader(FILE *fp)
+{
+    return fwrite(TRACE_MAGIC, 1, 8, fp) == 8 ? 0 : -1;
+}
+
+int traceWriteRecord(FILE *fp, int flags, double sendTime, double latency, const unsigned char *apdu, int apduLen, const unsigned char *response, int responseLen)
+{
+unsigned char   header[11], length[2];
+
+    header[0] = flags;
+    putBE(header + 1, toMicroseconds(sendTime), 4);
+    putBE(header + 5, toMicroseconds(latency), 4);
+    putBE(header + 9, apduLen, 2);
+    putBE(length, responseLen, 2);
+    if(fwrite(header, 1, sizeof(header), fp) != sizeof(header) || fwrite(apdu, 1, apduLen, fp) != apduLen
+                || fwrite(length, 1, sizeof(length), fp) != sizeof(length) || fwrite(response, 1, responseLen, fp) != responseLen)
+        return -1;
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* Values below HIST_LINEAR microseconds get a bucket each, above that every
+ * power of two is split into HIST_SUB_COUNT buckets.
+ */
+static int  histIndex(unsigned long us)
+{
+int     exponent = 0;
+
+    if(us >= 0xffffffffUL)
+        us = 0xffffffffUL;
+    if(us < HIST_LINEAR)
+        return us;
+    while((us >> exponent) >= 2 * HIST_SUB_COUNT)
+        exponent++;
+    return HIST_LINEAR + (exponent - 1) * HIST_SUB_COUNT + ((us >> exponent) - HIST_SUB_COUNT);
+}
+
+/* upper bound of a bucket in microseconds */
+static unsigned long histValue(int index)
+{
+int     exponent;
+
+    if(index < HIST_LINEAR)
+        return index;
+    exponent = (index - HIST_LINEAR) / HIST_SUB_COUNT + 1;
+    return ((unsigned long)(HIST_SUB_COUNT + (index - HIST_LINEAR) % HIST_SUB_COUNT + 1) << exponent) - 1;
+}
+
+static double   histPercentile(unsigned long *hist, unsigned long count, double p)
+{
+unsigned long   rank = p * count, sum = 0;
+int             i;
+
+    if(rank < p * count)
+        rank++;
+    if(rank == 0)
+        rank = 1;
+    for(i = 0; i < HIST_BUCKETS; i++){
+        if((sum += hist[i]) >= rank)
+            break;
+    }
+    return histValue(i) / 1000.0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int  loadTrace(char *traceFile, unsigned char **data)
+{
+FILE            *fp;
+long            size, pos;
+int             numRecords = 0, capacity = 0, sessionCapacity = 0;
+traceRecord_t   *r;
+
+    if((fp = fopen(traceFile, "rb")) == NULL){
+        perror(traceFile);
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    *data = malloc(size + 1);
+    if(*data == NULL || fread(*data, 1, size, fp) != size || size < 8 || memcmp(*data, TRACE_MAGIC, 8) != 0){
+        fprintf(stderr, "%s: not an APDU trace\n", traceFile);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    for(pos = 8; pos < size; numRecords++){
+        if(numRecords == capacity){
+            capacity = capacity ? 2 * capacity : 1024;
+            records = realloc(records, capacity * sizeof(*records));
+        }
+        r = &records[numRecords];
+        if(pos + 11 > size || pos + 11 + getBE(*data + pos + 9, 2) + 2 > size)
+            break;
+        r->flags = (*data)[pos];
+        r->sendUs = getBE(*data + pos + 1, 4);
+        r->latencyUs = getBE(*data + pos + 5, 4);
+        r->apduLen = getBE(*data + pos + 9, 2);
+        r->apdu = *data + pos + 11;
+        pos += 11 + r->apduLen;
+        r->responseLen = getBE(*data + pos, 2);
+        r->response = *data + pos + 2;
+        pos += 2 + r->responseLen;
+        if(pos > size || r->apduLen < 5 || r->apduLen > LEDGER_APDU_MAX)
+            break;
+        if(numRecords == 0 || (r->flags & TRACE_FLAG_SESSION)){
+            if(numSessions == sessionCapacity){
+                sessionCapacity = sessionCapacity ? 2 * sessionCapacity : 256;
+                sessions = realloc(sessions, sessionCapacity * sizeof(*sessions));
+            }
+            sessions[numSessions].first = numRecords;
+            sessions[numSessions].count = 0;
+            sessions[numSessions].start = (r->sendUs - records[0].sendUs) / 1e6;
+            numSessions++;
+        }
+        sessions[numSessions - 1].count++;
+    }
+    if(pos != size){
+        fprintf(stderr, "%s: truncated or corrupt record %d\n", traceFile, numRecords + 1);
+        return -1;
+    }
+    return numRecords;
+}
+
+static void histAdd(traceWorker_t *worker, int ins, double seconds)
+{
+    if(worker->hist[ins] == NULL)
+        worker->hist[ins] = calloc(HIST_BUCKETS, sizeof(unsigned long));
+    worker->hist[ins][histIndex(toMicroseconds(seconds))]++;
+}
+
+/* Returns: -1 if the endpoint failed, 0 otherwise. */
+static int  runSession(traceWorker_t *worker, traceSession_t *session, int index)
+{
+unsigned char   response[LEDGER_RESPONSE_MAX];
+traceRecord_t   *r;
+int             i, len, sw, recordedSw;
+double          start;
+
+    for(i = 0; i < session->count; i++){
+        r = &records[session->first + i];
+        start = apduTime();
+        len = apduExchange(worker->endpoint, r->apdu, r->apduLen, response, sizeof(response), replayTimeout);
+        histAdd(worker, r->apdu[1], apduTime() - start);
+        worker->apdus++;
+        sw = len < 0 ? 0 : LEDGER_SW(response, len);
+        recordedSw = LEDGER_SW(r->response, r->responseLen);
+        if(len >= 0 && sw == recordedSw)
+            continue;
+        if(len < 0)
+            worker->errors++;
+        else
+            worker->mismatches++;
+        pthread_mutex_lock(&outLock);
+        if(reported++ < MAX_REPORTED){
+            if(len < 0)
+                fprintf(replayOut, "session=%d apdu=%d ins=0x%02x error=%d\n", index + 1, i + 1, r->apdu[1], len);
+            else
+                fprintf(replayOut, "session=%d apdu=%d ins=0x%02x sw=0x%04x recorded=0x%04x\n", index + 1, i + 1, r->apdu[1], sw, recordedSw);
+        }
+        pthread_mutex_unlock(&outLock);
+        if(len < 0)     /* the endpoint is gone, leave the rest to the others */
+            return -1;
+    }
+    return 0;
+}
+
+static void *workerThread(void *arg)
+{
+traceWorker_t   *worker = arg;
+int             index;
+double          due, now;
+
+    for(;;){
+        pthread_mutex_lock(&sessionLock);
+        index = nextSession++;
+        pthread_mutex_unlock(&sessionLock);
+        if(index >= numSessions)
+            break;
+        if(replayRate == TRACE_RATE_RECORDED){
+            due = replayStart + sessions[index].start;
+        }else if(replayRate > 0){
+            due = replayStart + index / replayRate;
+        }else{
+            due = 0;
+        }
+        if(due > 0){
+            if((now = apduTime()) < due){
+                usleep((due - now) * 1e6);
+            }else if(now - due > LATE_SECONDS){
+                worker->late++;
+                if(now - due > worker->maxLag)
+                    worker->maxLag = now - due;
+            }
+        }
+        worker->sessions++;
+        if(runSession(worker, &sessions[index], index) != 0)
+            break;
+    }
+    return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int traceReplay(char *traceFile, apduEndpoint_t *endpoints, int endpointCount, double rate, int timeout, FILE *out)
+{
+unsigned char   *data = NULL;
+traceWorker_t   *workers;
+unsigned long   *hist, count, apdus = 0, errors = 0, mismatches = 0, late = 0, sessionsRun = 0;
+double          elapsed, maxLag = 0;
+int             i, ins, numRecords;
+
+    if((numRecords = loadTrace(traceFile, &data)) < 0)
+        return -1;
+    replayRate = rate;
+    replayTimeout = timeout;
+    replayOut = out;
+    workers = calloc(endpointCount, sizeof(*workers));
+    replayStart = apduTime();
+    for(i = 0; i < endpointCount; i++){
+        workers[i].endpoint = &endpoints[i];
+        pthread_create(&workers[i].thread, NULL, workerThread, &workers[i]);
+    }
+    for(i = 0; i < endpointCount; i++)
+        pthread_join(workers[i].thread, NULL);
+    elapsed = apduTime() - replayStart;
+
+    hist = malloc(HIST_BUCKETS * sizeof(unsigned long));
+    for(ins = 0; ins < 256; ins++){
+        memset(hist, 0, HIST_BUCKETS * sizeof(unsigned long));
+        count = 0;
+        for(i = 0; i < endpointCount; i++){
+            int j;
+            if(workers[i].hist[ins] == NULL)
+                continue;
+            for(j = 0; j < HIST_BUCKETS; j++){
+                hist[j] += workers[i].hist[ins][j];
+                count += workers[i].hist[ins][j];
+            }
+            free(workers[i].hist[ins]);
+        }
+        if(count > 0)
+            fprintf(out, "ins=0x%02x apdus=%lu p50=%.2fms p99=%.2fms p999=%.2fms max=%.2fms\n", ins, count,
+                histPercentile(hist, count, 0.5), histPercentile(hist, count, 0.99), histPercentile(hist, count, 0.999), histPercentile(hist, count, 1.0));
+    }
+    for(i = 0; i < endpointCount; i++){
+        apdus += workers[i].apdus;
+        errors += workers[i].errors;
+        mismatches += workers[i].mismatches;
+        late += workers[i].late;
+        sessionsRun += workers[i].sessions;
+        if(workers[i].maxLag > maxLag)
+            maxLag = workers[i].maxLag;
+    }
+    fprintf(out, "sessions=%lu/%d apdus=%lu failed=%lu mismatched=%lu late=%lu maxlag=%.2fms concurrency=%d time=%.2fs rate=%.1f/s\n",
+        sessionsRun, numSessions, apdus, errors, mismatches, late, maxLag * 1000, endpointCount, elapsed, elapsed > 0 ? sessionsRun / elapsed : 0);
+    free(hist);
+    free(workers);
+    free(records);
+    free(sessions);
+    free(data);
+    return errors + mismatches + (numSessions - sessionsRun);
+}
+
+/* ------------------------------------------------------------------------- */
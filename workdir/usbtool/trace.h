@@ -0,0 +1,57 @@
+/* Name: trace.h
+ * Project: usbtool
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt), GNU GPL v3 or proprietary (CommercialLicense.txt)
+ */
+
+/*
+General Description:
+APDU traces record exchanges for later replay under controlled load. A trace
+file is the 8 byte magic "APDUTRC1" followed by one record per exchange, all
+numbers big endian:
+    1 byte      flags, TRACE_FLAG_SESSION on the first APDU of a session
+    4 bytes     send time in microseconds since the start of the recording
+    4 bytes     round trip time in microseconds
+    2 bytes     APDU length, followed by the APDU
+    2 bytes     reply length, followed by the reply including the status
+                word (length 0 if the exchange failed)
+A session is a sequence of APDUs which must run in order on one device,
+like the chunks of a signing request. Sessions are what the replay spreads
+over its concurrent endpoints.
+*/
+
+#ifndef __TRACE_H_INCLUDED__
+#define __TRACE_H_INCLUDED__
+
+#include <stdio.h>
+#include "apduscript.h"
+
+#define TRACE_MAGIC         "APDUTRC1"
+#define TRACE_FLAG_SESSION  0x01
+
+#define TRACE_RATE_RECORDED -1  /* replay sessions with their recorded spacing */
+#define TRACE_RATE_UNPACED  0   /* replay sessions back to back */
+
+int traceWriteHeader(FILE *fp);
+/* This function writes the trace file magic to 'fp'.
+ * Returns: 0 on success, -1 on a write error.
+ */
+
+int traceWriteRecord(FILE *fp, int flags, double sendTime, double latency, const unsigned char *apdu, int apduLen, const unsigned char *response, int responseLen);
+/* This function appends one exchange to the trace 'fp'. 'sendTime' and
+ * 'latency' are in seconds.
+ * Returns: 0 on success, -1 on a write error.
+ */
+
+int traceReplay(char *traceFile, apduEndpoint_t *endpoints, int endpointCount, double rate, int timeout, FILE *out);
+/* This function replays the sessions of 'traceFile' with one thread per
+ * endpoint, i.e. at a concurrency of 'endpointCount'. 'rate' is the number of
+ * sessions started per second, or one of TRACE_RATE_RECORDED and
+ * TRACE_RATE_UNPACED. Status words which differ from the recorded ones are
+ * reported to 'out', followed by the p50/p99/p999 round trip time for every
+ * INS and a summary. 'timeout' is passed to apduExchange().
+ * Returns: The number of failed or mismatching APDUs, or -1 if the trace
+ * can't be read.
+ */
+
+#endif /* __TRACE_H_INCLUDED__ */
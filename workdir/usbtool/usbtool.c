@@ -27,6 +27,12 @@ On Windows use libusb-win32 from http://libusb-win32.sourceforge.net/.
 
 #include <usb.h>        /* this is libusb, see http://libusb.sourceforge.net/ */
 #include "opendevice.h" /* common code moved to separate module */
+#include "ledgerhid.h"
+#include "apduscript.h"
+#include "apdutcp.h"
+#include "trace.h"
+#include "farm.h"
+#include "daemon.h"
 
 #define DEFAULT_USB_BID         0   /* any */
 #define DEFAULT_USB_VID         0   /* any */
@@ -56,12 +62,21 @@ static void usage(char *name)
         "  -w (suppress USB warnings, default is verbose)\n"
         "  -s (suppress set configuration)\n"
         "  -r (restart operation infinitely)\n"
+        "  -m <count> (farm: use simulated devices instead of USB)\n"
+        "  -T <host:port>[,...] (APDU endpoints over TCP instead of USB)\n"
+        "  -R <rate> (replay: sessions per second, '*' for unpaced)\n"
+        "  -C <count> (replay: concurrent endpoints, defaults to 1)\n"
         "\n"
         "Commands are:\n"
         "  list (list all matching devices by name)\n"
         "  control in|out <type> <recipient> <request> <value> <index> (send control request)\n"
         "  interrupt in|out (send or receive interrupt data)\n"
         "  bulk in|out (send or receive bulk data)\n"
+        "  apdu <scriptfile> (run an APDU script over Ledger HID framing, '-' for stdin)\n"
+        "  farm <jobfile> (run NEAR app jobs on all matching devices)\n"
+        "  daemon <socket> (keep devices open and serve APDUs on a Unix socket)\n"
+        "  record <scriptfile> <tracefile> (run an APDU script and record a trace)\n"
+        "  replay <tracefile> (replay a trace and report latency per INS)\n"
         "For valid enum values for <type> and <recipient> pass \"x\" for the value.\n"
         "Objective Development's free VID/PID pairs are:\n"
         "  5824/1500 for vendor class devices\n"
@@ -92,6 +107,10 @@ static int  usbTimeout = 5000;
 static int  usbCount = 128;
 static int  usbConfiguration = 1;
 static int  usbInterface = 0;
+static int  mockDevices = 0;
+static char *tcpEndpoints = NULL;
+static double replayRate = TRACE_RATE_RECORDED;
+static int  concurrency = 1;
 
 static int  usbDirection, usbType, usbRecipient, usbRequest, usbValue, usbIndex; /* arguments of control transfer */
 
@@ -117,6 +136,62 @@ char    *endPtr;
     return l;
 }
 
+/* Opens up to 'maxEndpoints' APDU endpoints: connections to the -T list
+ * (round robin if there are more endpoints than list entries) or claimed
+ * Ledger devices.
+ * Returns: The number of endpoints opened.
+ */
+static int  openEndpoints(apduEndpoint_t *endpoints, int maxEndpoints)
+{
+usb_dev_handle  *handles[FARM_MAX_DEVICES];
+char            serials[FARM_MAX_DEVICES][USBOPEN_SERIAL_MAX], *list, *s, *entries[FARM_MAX_DEVICES];
+FILE            *warningsFp = showWarnings ? stderr : NULL;
+int             i, count = 0, numEntries = 0;
+
+    if(tcpEndpoints != NULL){
+        list = strdup(tcpEndpoints);
+        for(s = strtok(list, ","); s != NULL && numEntries < FARM_MAX_DEVICES; s = strtok(NULL, ","))
+            entries[numEntries++] = s;
+        for(i = 0; i < maxEndpoints && numEntries > 0; i++){
+            endpoints[count].handle = NULL;
+            if((endpoints[count].fd = apduTcpConnect(entries[i % numEntries], warningsFp)) >= 0)
+                count++;
+        }
+        free(list);
+        return count;
+    }
+    if(vendorID == 0)
+        vendorID = LEDGER_HID_VID;
+    if(maxEndpoints > FARM_MAX_DEVICES)
+        maxEndpoints = FARM_MAX_DEVICES;
+    usb_find_busses();
+    usb_find_devices();
+    maxEndpoints = usbOpenAllDevices(handles, serials, maxEndpoints, busID, vendorID, vendorNamePattern, productID, productNamePattern, serialPattern, NULL, warningsFp);
+    for(i = 0; i < maxEndpoints; i++){
+        if(ledgerHidClaim(handles[i], usbInterface, warningsFp) != 0){
+            usb_close(handles[i]);
+            continue;
+        }
+        endpoints[count].handle = handles[i];
+        endpoints[count++].fd = -1;
+    }
+    return count;
+}
+
+static void closeEndpoints(apduEndpoint_t *endpoints, int count)
+{
+int     i;
+
+    for(i = 0; i < count; i++){
+        if(endpoints[i].handle != NULL){
+            usb_release_interface(endpoints[i].handle, usbInterface);
+            usb_close(endpoints[i].handle);
+        }else{
+            close(endpoints[i].fd);
+        }
+    }
+}
+
 static int  parseEnum(char *text, ...)
 {
 va_list vlist;
@@ -153,6 +228,11 @@ int     i, numEntries;
 #define ACTION_BULK         3
 #define ACTION_CONTROL_RAW  4
 #define ACTION_LOG          5
+#define ACTION_FARM         6
+#define ACTION_APDU         7
+#define ACTION_DAEMON       8
+#define ACTION_RECORD       9
+#define ACTION_REPLAY       10
 
 int main(int argc, char **argv)
 {
@@ -161,7 +241,7 @@ int             opt, len, action, argcnt;
 char            *myName = argv[0], *s, *rxBuffer = NULL;
 FILE            *fp;
 
-    while((opt = getopt(argc, argv, "?hv:p:b:V:P:S:d:D:O:e:n:t:awi:sr")) != -1){
+    while((opt = getopt(argc, argv, "?hv:p:b:V:P:S:d:D:O:e:n:t:awi:srm:T:R:C:")) != -1){
         switch(opt){
         case 'h':
         case '?':   /* -h or -? (print this help and exit) */
@@ -243,6 +323,18 @@ FILE            *fp;
         case 'r':
             retry = 1;
             break;
+        case 'm':   /* -m <count> (farm: use simulated devices instead of USB) */
+            mockDevices = myAtoi(optarg);
+            break;
+        case 'T':   /* -T <host:port>[,...] (APDU endpoints over TCP instead of USB) */
+            tcpEndpoints = optarg;
+            break;
+        case 'R':   /* -R <rate> (replay: sessions per second, '*' for unpaced) */
+            replayRate = strcmp(optarg, "*") == 0 ? TRACE_RATE_UNPACED : atof(optarg);
+            break;
+        case 'C':   /* -C <count> (replay: concurrent endpoints, defaults to 1) */
+            concurrency = myAtoi(optarg);
+            break;
         default:
             fprintf(stderr, "Option -%c unknown\n", opt);
             exit(1);
@@ -271,6 +363,17 @@ FILE            *fp;
         action = ACTION_INTERRUPT;
     }else if(strcasecmp(argv[0], "bulk") == 0){
         action = ACTION_BULK;
+    }else if(strcasecmp(argv[0], "farm") == 0){
+        action = ACTION_FARM;
+    }else if(strcasecmp(argv[0], "apdu") == 0){
+        action = ACTION_APDU;
+    }else if(strcasecmp(argv[0], "daemon") == 0){
+        action = ACTION_DAEMON;
+    }else if(strcasecmp(argv[0], "record") == 0){
+        action = ACTION_RECORD;
+        argcnt = 3;
+    }else if(strcasecmp(argv[0], "replay") == 0){
+        action = ACTION_REPLAY;
     }else{
         fprintf(stderr, "command %s not known\n", argv[0]);
         usage(myName);
@@ -285,6 +388,54 @@ FILE            *fp;
         fprintf(stderr, "Warning: only %d arguments expected, rest ignored.\n", argcnt);
     }
     usb_init();
+    if(action == ACTION_FARM){
+        exit(farmRun(argv[1], busID, vendorID, vendorNamePattern, productID, productNamePattern, serialPattern, usbInterface, usbTimeout, mockDevices, showWarnings ? stderr : NULL));
+    }
+    if(action == ACTION_DAEMON){
+        exit(daemonRun(argv[1], busID, vendorID, vendorNamePattern, productID, productNamePattern, serialPattern, usbInterface, usbTimeout, showWarnings ? stderr : NULL));
+    }
+    if(action == ACTION_APDU || action == ACTION_RECORD){
+        apduEndpoint_t  endpoint;
+        FILE            *traceFp = NULL;
+        int             failures;
+        fp = stdin;
+        if(strcmp(argv[1], "-") != 0 && (fp = fopen(argv[1], "r")) == NULL){
+            fprintf(stderr, "error opening %s: %s\n", argv[1], strerror(errno));
+            exit(1);
+        }
+        if(action == ACTION_RECORD && (traceFp = fopen(argv[2], "wb")) == NULL){
+            fprintf(stderr, "error opening %s: %s\n", argv[2], strerror(errno));
+            exit(1);
+        }
+        if(openEndpoints(&endpoint, 1) != 1){
+            fprintf(stderr, "Could not open an APDU endpoint\n");
+            exit(1);
+        }
+        failures = apduScriptRun(&endpoint, fp, usbTimeout, stdout, traceFp);
+        closeEndpoints(&endpoint, 1);
+        if(traceFp != NULL && fclose(traceFp) != 0){
+            fprintf(stderr, "error writing %s: %s\n", argv[2], strerror(errno));
+            exit(1);
+        }
+        exit(failures == 0 ? 0 : 1);
+    }
+    if(action == ACTION_REPLAY){
+        apduEndpoint_t  endpoints[FARM_MAX_DEVICES];
+        int             count, failures;
+        if(concurrency < 1 || concurrency > FARM_MAX_DEVICES){
+            fprintf(stderr, "concurrency must be between 1 and %d\n", FARM_MAX_DEVICES);
+            exit(1);
+        }
+        if((count = openEndpoints(endpoints, concurrency)) == 0){
+            fprintf(stderr, "Could not open an APDU endpoint\n");
+            exit(1);
+        }
+        if(count < concurrency && showWarnings)
+            fprintf(stderr, "Warning: only %d of %d endpoints opened\n", count, concurrency);
+        failures = traceReplay(argv[1], endpoints, count, replayRate, usbTimeout, stdout);
+        closeEndpoints(endpoints, count);
+        exit(failures == 0 ? 0 : 1);
+    }
 retry:
     if(usbOpenDevice(&handle, busID, vendorID, vendorNamePattern, productID, productNamePattern, serialPattern, action == ACTION_LIST ? stdout : NULL, showWarnings ? stderr : NULL) != 0){
         if (action == ACTION_LOG) {